@@ -1,10 +1,35 @@
 #include "LALR_table_generator.h"
 #include "LALR_parser_generator.h"
+#include "LALR_generation_cache.h"
+#include "LALR_grammar_loader.h"
+#include "LALR_location.h"
+#include "LALR_runtime.h"
+#include <atomic>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+// Generates parsers into `siicc_<name>.h` and `.cpp` (and `.tables` with
+// --blob):
+//
+//   BNF_driver_gen [options] [--jobs N] [--grammar <file.ebnf> <out dir>]...
+//
+// Every --grammar file is loaded with LoadEBNFGrammar and generated into its
+// directory, named after the file's stem. Without one, the EBNF grammar
+// below is generated into siicc_EBNF.h/.cpp in the working directory. The
+// grammars are generated concurrently on --jobs threads (default one per
+// hardware thread), each by its own generators on its own copy of the
+// grammar; reports, stats and traces are printed per grammar once all are
+// done.
 
 using namespace siicc::LALR;
 
-int main() {
+namespace {
+// The grammar of the EBNF files the generated siicc_EBNF parser reads.
+Grammar EBNFGrammar() {
   Grammar BNF;
   
   auto b_blank = NewBlank();
@@ -37,6 +62,7 @@ int main() {
   };
   
   BNF.blank_ = b_blank;
+  BNF.Keywords({t_or, t_equals, t_semicolon});
   BNF.productions_ = {
       std::make_shared<Production>(n_productions, TokenPtrVec{n_production}),
       std::make_shared<Production>(n_productions, TokenPtrVec{n_production, n_productions}),
@@ -57,19 +83,240 @@ int main() {
       std::make_shared<Production>(n_item, TokenPtrVec{t_nonterminator_repeated}),
       std::make_shared<Production>(n_item, TokenPtrVec{t_nonterminator_optional}),
   };
+  return BNF;
+}
 
-  LALRTableGenerator t_generator(BNF);
-  t_generator.GenerateLALRTable();
+struct DriverOptions {
+  std::string cache_dir_ = ".siicc_cache";
+  bool use_cache_ = true;
+  bool report_ = false;
+  // --stats prints phase timers and counters as text, --stats-json as JSON.
+  // Either one bypasses the cache lookup so there is a run to measure.
+  bool stats_text_ = false;
+  bool stats_json_ = false;
+  bool trace_ = false;
+  // Profile from a parser built with SIICC_PARSE_PROFILE, see LALR_profile.h.
+  std::string profile_path_;
+  std::string profile_text_;
+  RecordedProfile profile_;
+  // Embed the tables from siicc_<name>.tables instead of spelling them out,
+  // see ParserGeneratorOptions::blob_path_.
+  bool blob_ = false;
+  ConstructionMode mode_ = ConstructionMode::LALR;
+  // Keep the conflicts precedence can not settle and emit a GLR parser, see
+  // LALR_glr.h, instead of failing on them.
+  bool glr_ = false;
+  std::string stamp_;
+};
 
-  LALRParserGenerator p_generator(
-      t_generator.MoveAction(), t_generator.MoveReduce(),
-      t_generator.MoveClosures(), t_generator.MoveGrammar());
-  
-  std::string header_name = "siicc_EBNF.h";
-  std::string cpp_name = "siicc_EBNF.cpp";
-  std::ofstream header_file(header_name);
-  std::ofstream cpp_file(cpp_name);
-
-  p_generator.OutputHeader(header_file);
-  p_generator.OutputCpp(header_name, cpp_file);
-}
\ No newline at end of file
+struct Job {
+  // Empty for the built-in EBNF grammar.
+  std::string grammar_path_;
+  std::string out_dir_ = ".";
+  // What the job prints, written out after all jobs finished.
+  std::string log_;
+  std::exception_ptr error_;
+};
+
+Grammar LoadGrammarFile(const std::string &path) {
+  std::ifstream file(path);
+  if (!file) {
+    throw std::invalid_argument("Can not open " + path);
+  }
+  std::string text((std::istreambuf_iterator<char>(file)),
+                   std::istreambuf_iterator<char>());
+  std::istringstream is(text);
+  try {
+    return LoadEBNFGrammar(is);
+  } catch (const siicc::ParseError &error) {
+    siicc::LineIndex index(text);
+    auto location = index.Locate(error.Offset());
+    throw std::invalid_argument(path + ":" + location.to_string() + ": " +
+                                error.what() + "\n" +
+                                std::string(index.Line(location.line_)));
+  }
+}
+
+void Generate(Job &job, const DriverOptions &driver) {
+  std::stringstream log;
+  Grammar grammar;
+  std::string name = "EBNF";
+  if (job.grammar_path_.empty()) {
+    grammar = EBNFGrammar();
+  } else {
+    grammar = LoadGrammarFile(job.grammar_path_);
+    name = std::filesystem::path(job.grammar_path_).stem().string();
+  }
+  // Blank is declared but never used in the EBNF grammar, so it is dropped
+  // here.
+  auto reduction = ReduceGrammar(grammar);
+  if (driver.report_ && !reduction.Empty()) {
+    log << reduction.to_string();
+  }
+
+  std::string header_name = "siicc_" + name + ".h";
+  std::string cpp_name = "siicc_" + name + ".cpp";
+  std::string tables_name = "siicc_" + name + ".tables";
+
+  GenerationCache cache(driver.cache_dir_);
+  auto fingerprint = GrammarFingerprint(
+      grammar, driver.stamp_ + header_name + ConstructionModeName(driver.mode_) +
+                   (driver.glr_ ? "glr" : "") +
+                   (driver.blob_ ? tables_name : "") + driver.profile_text_);
+  std::optional<GeneratedParser> generated;
+  GenerationStats stats;
+  GenerationStats *stats_sink =
+      driver.stats_text_ || driver.stats_json_ ? &stats : nullptr;
+  if (driver.use_cache_ && stats_sink == nullptr) {
+    generated = cache.Lookup(fingerprint);
+  }
+  if (!generated.has_value()) {
+    LALRTableGenerator t_generator(grammar, driver.mode_, driver.glr_);
+    t_generator.SetStats(stats_sink);
+    if (driver.trace_) {
+      t_generator.SetTrace(&log);
+    }
+    t_generator.GenerateLALRTable();
+
+    ParserGeneratorOptions options;
+    options.stats_ = stats_sink;
+    if (!driver.profile_path_.empty()) {
+      options.profile_ = &driver.profile_;
+    }
+    if (driver.blob_) {
+      options.blob_path_ = tables_name;
+    }
+    LALRParserGenerator p_generator(
+        t_generator.MoveAction(), t_generator.MoveReduce(),
+        t_generator.MoveClosures(), t_generator.MoveGrammar(), options,
+        t_generator.MoveConflicts());
+
+    if (driver.report_) {
+      log << t_generator.Report().to_string();
+      log << p_generator.TableReport();
+    }
+
+    std::stringstream header_stream, cpp_stream, tables_stream;
+    p_generator.OutputHeader(header_stream);
+    p_generator.OutputCpp(header_name, cpp_stream);
+    p_generator.OutputBlob(tables_stream);
+    generated = GeneratedParser{header_stream.str(), cpp_stream.str(),
+                                tables_stream.str()};
+    if (driver.use_cache_) {
+      cache.Store(fingerprint, *generated);
+    }
+  }
+
+  auto dir = std::filesystem::path(job.out_dir_);
+  std::filesystem::create_directories(dir);
+  WriteIfChanged((dir / header_name).string(), generated->header_);
+  WriteIfChanged((dir / cpp_name).string(), generated->cpp_);
+  if (driver.blob_) {
+    WriteIfChanged((dir / tables_name).string(), generated->tables_);
+  }
+  if (driver.stats_text_) {
+    log << stats.to_string();
+  }
+  if (driver.stats_json_) {
+    log << stats.to_json();
+  }
+  job.log_ = log.str();
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  DriverOptions driver;
+  std::vector<Job> jobs;
+  uint32_t threads = std::max(1u, std::thread::hardware_concurrency());
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "--no-cache") == 0) {
+      driver.use_cache_ = false;
+    } else if (std::strcmp(argv[i], "--report") == 0) {
+      driver.report_ = true;
+    } else if (std::strcmp(argv[i], "--stats") == 0) {
+      driver.stats_text_ = true;
+    } else if (std::strcmp(argv[i], "--stats-json") == 0) {
+      driver.stats_json_ = true;
+    } else if (std::strcmp(argv[i], "--trace") == 0) {
+      driver.trace_ = true;
+    } else if (std::strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+      driver.profile_path_ = argv[++i];
+    } else if (std::strcmp(argv[i], "--glr") == 0) {
+      driver.glr_ = true;
+    } else if (std::strcmp(argv[i], "--blob") == 0) {
+      driver.blob_ = true;
+    } else if (std::strcmp(argv[i], "--cache-dir") == 0 && i + 1 < argc) {
+      driver.cache_dir_ = argv[++i];
+    } else if (std::strcmp(argv[i], "--mode") == 0 && i + 1 < argc) {
+      driver.mode_ = ParseConstructionMode(argv[++i]);
+    } else if (std::strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+      threads = std::max(1, std::atoi(argv[++i]));
+    } else if (std::strcmp(argv[i], "--grammar") == 0 && i + 2 < argc) {
+      jobs.emplace_back();
+      jobs.back().grammar_path_ = argv[++i];
+      jobs.back().out_dir_ = argv[++i];
+    } else {
+      throw std::invalid_argument(std::string("Unknown argument: ") + argv[i]);
+    }
+  }
+  if (jobs.empty()) {
+    jobs.emplace_back();
+  }
+
+  if (!driver.profile_path_.empty()) {
+    // Its state numbers only fit the grammar it was recorded with.
+    if (jobs.size() != 1) {
+      throw std::invalid_argument("--profile takes exactly one grammar");
+    }
+    std::ifstream is(driver.profile_path_);
+    if (!is) {
+      throw std::invalid_argument("Can not open profile " +
+                                  driver.profile_path_);
+    }
+    std::stringstream ss;
+    ss << is.rdbuf();
+    driver.profile_text_ = ss.str();
+    driver.profile_ = LoadParseProfile(ss);
+  }
+  driver.stamp_ = GeneratorStamp();
+
+  // Every thread, the calling one included, takes the next job until none
+  // are left.
+  std::atomic<size_t> next{0};
+  auto work = [&]() {
+    for (size_t i = next++; i < jobs.size(); i = next++) {
+      try {
+        Generate(jobs[i], driver);
+      } catch (...) {
+        jobs[i].error_ = std::current_exception();
+      }
+    }
+  };
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i < std::min<size_t>(threads, jobs.size()); i++) {
+    workers.emplace_back(work);
+  }
+  work();
+  for (auto &worker : workers) {
+    worker.join();
+  }
+
+  int status = 0;
+  for (const auto &job : jobs) {
+    bool several = jobs.size() > 1;
+    if (several && !job.log_.empty()) {
+      std::cerr << "== " << job.grammar_path_ << "\n";
+    }
+    std::cerr << job.log_;
+    if (job.error_) {
+      try {
+        std::rethrow_exception(job.error_);
+      } catch (const std::exception &error) {
+        std::cerr << (job.grammar_path_.empty() ? "EBNF" : job.grammar_path_)
+                  << ": " << error.what() << "\n";
+      }
+      status = 1;
+    }
+  }
+  return status;
+}
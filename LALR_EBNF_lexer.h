@@ -1,53 +1,77 @@
 #pragma once
 
 #include "siicc_EBNF.h"
+#include <cctype>
 #include <fstream>
 
 namespace siicc {
 
 class BNFLexer : public Lexer {
 public:
-  BNFLexer(std::ifstream &is) : is_(is) {}
+  BNFLexer(std::istream &is) : is_(is) {}
   virtual Token Next() override {
     std::string next;
-    is_ >> next;
-    if (is_.eof()) {
-      return Token(Token::TokenType::TOKEN_end, "$");
-    } else if (next.length() == 1 && next.front() == '|') {
-      return Token(Token::TokenType::TOKEN_or, "|");
-    } else if(next.length() == 1 && next.front() == ';') {
-      return Token(Token::TokenType::TOKEN_semicolon, ";");
-    } else if (next.front() == '{') {
+    auto ch = is_.get();
+    while (ch != std::char_traits<char>::eof() && std::isspace(ch)) {
+      offset_++;
+      ch = is_.get();
+    }
+    token_begin_ = offset_;
+    while (ch != std::char_traits<char>::eof() && !std::isspace(ch)) {
+      next.push_back(ch);
+      offset_++;
+      ch = is_.get();
+    }
+    token_end_ = offset_;
+    if (ch != std::char_traits<char>::eof()) {
+      offset_++;
+    }
+    if (next.empty()) {
+      return Token(Token::TokenType::TOKEN_end, "$", token_begin_);
+    }
+    if (auto keyword = MatchKeyword<ParserTables>(next.data(), next.size())) {
+      return Token(static_cast<Token::TokenType>(keyword), next, token_begin_);
+    }
+    if (next.front() == '{') {
       if (next.length() < 5) {
-        throw std::invalid_argument(std::string("Invalid Token") + next);
+        throw ParseError(std::string("Invalid Token") + next, token_begin_);
       }
       auto last = next.back();
       switch (last) {
         case '+' :
           next.erase(next.begin());
           next.pop_back();next.pop_back();
-          return Token(Token::TokenType::TOKEN_nonterminator_one_more, next);
+          return Token(Token::TokenType::TOKEN_nonterminator_one_more, next,
+                       token_begin_);
         case '*':
           next.erase(next.begin());
           next.pop_back();next.pop_back();
-          return Token(Token::TokenType::TOKEN_nonterminator_repreated, next);
+          return Token(Token::TokenType::TOKEN_nonterminator_repreated, next,
+                       token_begin_);
         case '?': 
           next.erase(next.begin());
           next.pop_back();next.pop_back();
-          return Token(Token::TokenType::TOKEN_nonterminator_optional, next);
+          return Token(Token::TokenType::TOKEN_nonterminator_optional, next,
+                       token_begin_);
         default:
-          throw std::invalid_argument(std::string("Invalid Token") + next);
+          throw ParseError(std::string("Invalid Token") + next, token_begin_);
       }
     } else if (next.front() == '<') {
-      return Token(Token::TokenType::TOKEN_nonterminator, next);
-    } else if (next == "::=") {
-      return Token(Token::TokenType::TOKEN_equals, "::=");
+      return Token(Token::TokenType::TOKEN_nonterminator, next, token_begin_);
     } else {
-      return Token(Token::TokenType::TOKEN_terminator, next);
+      return Token(Token::TokenType::TOKEN_terminator, next, token_begin_);
     } 
   }
 
+  // Byte range of the last token returned by Next(), relative to the start
+  // of the stream.
+  uint32_t TokenBegin() const { return token_begin_; }
+  uint32_t TokenEnd() const { return token_end_; }
+
 private:
-  std::ifstream& is_;
+  std::istream& is_;
+  uint32_t offset_ = 0;
+  uint32_t token_begin_ = 0;
+  uint32_t token_end_ = 0;
 };
-}
\ No newline at end of file
+}
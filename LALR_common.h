@@ -1,11 +1,13 @@
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
 #include <map>
 #include <memory>
 #include <optional>
 #include <set>
 #include <sstream>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
@@ -27,7 +29,18 @@ struct Token {
 };
 
 typedef std::shared_ptr<Token> TokenPtr;
-typedef std::set<TokenPtr> TokenPtrSet;
+
+// Orders tokens by kind and name rather than by address, so symbol ids and
+// everything emitted from them are stable from run to run.
+struct TokenPtrLess {
+  bool operator()(const TokenPtr &lhs, const TokenPtr &rhs) const {
+    if (lhs->type_ != rhs->type_) {
+      return lhs->type_ < rhs->type_;
+    }
+    return lhs->name_ < rhs->name_;
+  }
+};
+typedef std::set<TokenPtr, TokenPtrLess> TokenPtrSet;
 typedef std::vector<TokenPtr> TokenPtrVec;
 
 static inline TokenPtr NewTerminator(const std::string &name,
@@ -43,6 +56,13 @@ static inline TokenPtr NewEnd() {
   return std::make_shared<Token>(Token::Type::BLANK, "End", "End");
 }
 
+// yacc's `error`: a terminal the lexer never returns. After a syntax error
+// that can not be repaired locally the parser pops back to a state that
+// shifts it and resumes there.
+static inline TokenPtr NewErrorToken() {
+  return std::make_shared<Token>(Token::Type::Terminator, "error", "error");
+}
+
 static inline TokenPtr NewNonTerminator(const std::string &name) {
   return std::make_shared<Token>(Token::Type::Nonterminator, name, name);
 }
@@ -51,7 +71,12 @@ struct Production {
   TokenPtr head_;
   TokenPtrVec body_;
   uint32_t id_;
+  // Terminal whose precedence the production takes, like yacc's %prec. When
+  // unset the last terminal of the body with a declared precedence is used.
+  TokenPtr prec_;
   Production(TokenPtr head, TokenPtrVec body) : head_(head), body_(body) {}
+  Production(TokenPtr head, TokenPtrVec body, TokenPtr prec)
+      : head_(head), body_(body), prec_(prec) {}
   std::string to_string() const {
     std::stringstream ss;
     ss << head_->to_string() << " -> ";
@@ -65,6 +90,17 @@ struct Production {
 typedef std::shared_ptr<Production> ProductionPtr;
 typedef std::vector<ProductionPtr> ProductionPtrVec;
 
+enum class Associativity : uint32_t {
+  Left = 0,
+  Right = 1,
+  NonAssoc = 2,
+};
+
+struct Precedence {
+  uint32_t level_;
+  Associativity associativity_;
+};
+
 struct Grammar {
   TokenPtrSet nonterminators_;
   TokenPtrSet terminators_;
@@ -73,6 +109,122 @@ struct Grammar {
   TokenPtr start_;
   TokenPtr end_;
   TokenPtr blank_;
+  // Optional, see NewErrorToken.
+  TokenPtr error_;
+  std::map<TokenPtr, Precedence, TokenPtrLess> precedence_;
+  uint32_t precedence_levels_ = 0;
+  // Terminals spelled exactly as their debug_name_, see Keywords.
+  TokenPtrSet keywords_;
+
+  // yacc's %left, %right and %nonassoc: every call declares one level,
+  // binding tighter than all levels declared before it.
+  void Left(const TokenPtrVec &tokens) {
+    DeclarePrecedence(tokens, Associativity::Left);
+  }
+  void Right(const TokenPtrVec &tokens) {
+    DeclarePrecedence(tokens, Associativity::Right);
+  }
+  void NonAssoc(const TokenPtrVec &tokens) {
+    DeclarePrecedence(tokens, Associativity::NonAssoc);
+  }
+  void DeclarePrecedence(const TokenPtrVec &tokens,
+                         Associativity associativity) {
+    uint32_t level = ++precedence_levels_;
+    for (const auto &token : tokens) {
+      if (token->type_ != Token::Type::Terminator) {
+        throw std::invalid_argument("Precedence declared on nonterminator: " +
+                                    token->to_string());
+      }
+      precedence_[token] = Precedence{level, associativity};
+    }
+  }
+  // Declares terminals the lexer recognizes by their text, debug_name_. The
+  // generated tables then hold a perfect hash over them, see
+  // LALR_keywords.h.
+  void Keywords(const TokenPtrVec &tokens) {
+    for (const auto &token : tokens) {
+      if (token->type_ != Token::Type::Terminator ||
+          token->debug_name_.empty()) {
+        throw std::invalid_argument("Keyword is not a spelled terminator: " +
+                                    token->to_string());
+      }
+      for (const auto &keyword : keywords_) {
+        if (keyword != token && keyword->debug_name_ == token->debug_name_) {
+          throw std::invalid_argument("Keyword spelled twice: " +
+                                      token->debug_name_);
+        }
+      }
+      keywords_.insert(token);
+    }
+  }
+  std::optional<Precedence> PrecedenceOf(const TokenPtr &token) const {
+    auto iter = precedence_.find(token);
+    if (iter == precedence_.end()) {
+      return std::nullopt;
+    }
+    return iter->second;
+  }
+  std::optional<Precedence> PrecedenceOf(const ProductionPtr &production) const {
+    if (production->prec_) {
+      return PrecedenceOf(production->prec_);
+    }
+    for (auto iter = production->body_.rbegin();
+         iter != production->body_.rend(); iter++) {
+      if ((*iter)->type_ == Token::Type::Terminator) {
+        auto precedence = PrecedenceOf(*iter);
+        if (precedence.has_value()) {
+          return precedence;
+        }
+      }
+    }
+    return std::nullopt;
+  }
+
+  // A copy with its own tokens and productions, so the ids generators write
+  // into them (Token::id_, Production::id_) do not reach this grammar or
+  // another copy. productions_of_ is left to BuildProductionsOf.
+  Grammar Clone() const {
+    Grammar copy;
+    std::map<Token *, TokenPtr> tokens;
+    auto own = [&tokens](const TokenPtr &token) {
+      if (!token) {
+        return token;
+      }
+      auto &clone = tokens[token.get()];
+      if (!clone) {
+        clone = std::make_shared<Token>(*token);
+      }
+      return clone;
+    };
+    for (const auto &token : nonterminators_) {
+      copy.nonterminators_.insert(own(token));
+    }
+    for (const auto &token : terminators_) {
+      copy.terminators_.insert(own(token));
+    }
+    for (const auto &production : productions_) {
+      TokenPtrVec body;
+      for (const auto &token : production->body_) {
+        body.push_back(own(token));
+      }
+      copy.productions_.push_back(std::make_shared<Production>(
+          own(production->head_), body, own(production->prec_)));
+      copy.productions_.back()->id_ = production->id_;
+    }
+    copy.start_ = own(start_);
+    copy.end_ = own(end_);
+    copy.blank_ = own(blank_);
+    copy.error_ = own(error_);
+    for (const auto &[token, precedence] : precedence_) {
+      copy.precedence_[own(token)] = precedence;
+    }
+    copy.precedence_levels_ = precedence_levels_;
+    for (const auto &token : keywords_) {
+      copy.keywords_.insert(own(token));
+    }
+    return copy;
+  }
+
   void BuildProductionsOf() {
     for (const auto &production : productions_) {
       if (production->body_.empty()) {
@@ -107,54 +259,129 @@ struct Grammar {
     }
     return ss.str();
   }
-};
-
-typedef std::shared_ptr<Grammar> GrammarPtr;
-
-struct KernelItem {
-  ProductionPtr production_;
-  uint32_t matched_;
-  TokenPtrSet end_with_;
-  KernelItem(ProductionPtr production, uint32_t matched)
-      : production_(production), matched_(matched) {}
-  bool operator==(const KernelItem &other) const {
-    return production_ == other.production_ && matched_ == other.matched_;
-  }
-  bool operator<(const KernelItem &other) const {
-    return production_ == other.production_ ? matched_ < other.matched_
-                                            : production_ < other.production_;
+  // Textual form of everything that affects generation. Symbols are listed in
+  // TokenPtrSet order and productions in declaration order, so the result
+  // does not depend on where the tokens happen to be allocated.
+  std::string Canonical() const {
+    std::stringstream ss;
+    auto print_token = [&ss](const TokenPtr &token) {
+      ss << static_cast<uint32_t>(token->type_) << ":" << token->name_.size()
+         << ":" << token->name_ << ":" << token->debug_name_.size() << ":"
+         << token->debug_name_ << ";";
+    };
+    ss << "terminators ";
+    for (const auto &token : terminators_) {
+      print_token(token);
+    }
+    ss << "\nnonterminators ";
+    for (const auto &token : nonterminators_) {
+      print_token(token);
+    }
+    for (const auto &token : {start_, end_, blank_, error_}) {
+      ss << "\n";
+      if (token) {
+        print_token(token);
+      }
+    }
+    ss << "\nprecedence ";
+    for (const auto &[token, precedence] : precedence_) {
+      print_token(token);
+      ss << precedence.level_ << ":"
+         << static_cast<uint32_t>(precedence.associativity_) << ";";
+    }
+    ss << "\nkeywords ";
+    for (const auto &token : keywords_) {
+      print_token(token);
+    }
+    ss << "\nproductions\n";
+    for (const auto &production : productions_) {
+      print_token(production->head_);
+      ss << " ->";
+      for (const auto &token : production->body_) {
+        ss << " ";
+        print_token(token);
+      }
+      if (production->prec_) {
+        ss << " %prec ";
+        print_token(production->prec_);
+      }
+      ss << "\n";
+    }
+    return ss.str();
   }
-  std::string to_string() const;
 };
 
-struct NormalItem {
-  TokenPtr head_;
-  TokenPtrSet end_with_;
-  NormalItem(TokenPtr head) : head_(head) {}
+typedef std::shared_ptr<Grammar> GrammarPtr;
 
-  bool operator==(const NormalItem &other) const {
-    return head_ == other.head_;
-  }
-  bool operator<(const NormalItem &other) const { return head_ < other.head_; }
-  std::string
-  to_string(std::map<std::string, ProductionPtrVec> &production_of) const;
-};
+// An LR(0) item packed into one word: the index of the production in the
+// generator that built it, above the position of the dot.
+typedef uint32_t Item;
+typedef std::vector<Item> ItemVec;
+constexpr uint32_t ITEM_DOT_BITS = 8;
+constexpr uint32_t MAX_ITEM_DOT = (1u << ITEM_DOT_BITS) - 1;
 
-typedef std::vector<KernelItem> KernelItemVec;
-typedef std::vector<NormalItem> NormalItemVec;
+static inline Item MakeItem(uint32_t production, uint32_t dot) {
+  return production << ITEM_DOT_BITS | dot;
+}
+static inline uint32_t ItemProduction(Item item) {
+  return item >> ITEM_DOT_BITS;
+}
+static inline uint32_t ItemDot(Item item) { return item & MAX_ITEM_DOT; }
 
 struct Closure {
-  KernelItemVec kernel_items_;
-  NormalItemVec normal_items_;
+  // Kernel items in ascending order, and their lookaheads index for index.
+  ItemVec kernel_items_;
+  std::vector<TokenPtrSet> kernel_lookaheads_;
+  // The nonterminals the kernel predicts, in ascending order of their index
+  // in the generator. Each stands for all of its productions with the dot in
+  // front, which share the lookaheads in `normal_lookaheads_`.
+  std::vector<uint32_t> normal_items_;
+  std::vector<TokenPtrSet> normal_lookaheads_;
   uint32_t id_;
 
-  bool operator==(const KernelItemVec &other) const;
-  bool operator==(const Closure &other) const;
-  std::string
-  to_string(std::map<std::string, ProductionPtrVec> &production_of) const;
-
-  std::optional<size_t> GetNormalItem(TokenPtr token);
+  std::optional<size_t> GetKernelItem(Item item) const {
+    auto iter =
+        std::lower_bound(kernel_items_.begin(), kernel_items_.end(), item);
+    if (iter == kernel_items_.end() || *iter != item) {
+      return std::nullopt;
+    }
+    return iter - kernel_items_.begin();
+  }
+  std::optional<size_t> GetNormalItem(uint32_t nonterminal) const {
+    auto iter = std::lower_bound(normal_items_.begin(), normal_items_.end(),
+                                 nonterminal);
+    if (iter == normal_items_.end() || *iter != nonterminal) {
+      return std::nullopt;
+    }
+    return iter - normal_items_.begin();
+  }
 };
 typedef std::shared_ptr<Closure> ClosurePtr;
+
+// A transition of a state on `token_`.
+struct Edge {
+  TokenPtr token_;
+  ClosurePtr next_;
+};
+// The transitions of one state, sorted by token address, at most one per
+// token.
+typedef std::vector<Edge> EdgeVec;
+
+static inline bool EdgeLess(const Edge &lhs, const Edge &rhs) {
+  return lhs.token_.get() < rhs.token_.get();
+}
+
+static inline const Edge *FindEdge(const EdgeVec &edges,
+                                   const TokenPtr &token) {
+  auto iter = std::lower_bound(
+      edges.begin(), edges.end(), token.get(),
+      [](const Edge &edge, const Token *token) {
+        return edge.token_.get() < token;
+      });
+  if (iter == edges.end() || iter->token_ != token) {
+    return nullptr;
+  }
+  return &*iter;
+}
 } // namespace LALR
 } // namespace siicc
\ No newline at end of file
@@ -0,0 +1,253 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+namespace siicc {
+// A parse tree as one flat buffer that is read in place, e.g. from a cache
+// file mapped with MappedFlatTree, without rebuilding ASTNodes.
+//
+// Nodes are numbered in postorder, so children come before their parent and
+// the root is the last node. After the header come, each as 32 bit words:
+//
+//   type[nodes]            ASTNode::Type
+//   begin[nodes]           ASTNode::begin_ and end_
+//   end[nodes]
+//   value[nodes]           string id of ASTNode::value_
+//   child_begin[nodes + 1] children of node i are
+//                          child[child_begin[i], child_begin[i + 1])
+//   child[child_count]     node numbers
+//   string_begin[strings + 1]
+//
+// followed by the string pool: string i is
+// pool[string_begin[i], string_begin[i + 1]), equal values share one string.
+// Words are in the byte order of the writing machine. GLR alternatives_ are
+// not kept, only the derivation in children_.
+struct FlatTreeHeader {
+  static constexpr char MAGIC[8] = {'s', 'i', 'i', 'c', 'c', 'A', 'S', 'T'};
+  static constexpr uint32_t VERSION = 1;
+
+  char magic_[8];
+  uint32_t version_;
+  uint32_t node_count_;
+  uint32_t child_count_;
+  uint32_t string_count_;
+  uint32_t pool_bytes_;
+  uint32_t reserved_ = 0;
+};
+
+// Children of a node, as node numbers.
+struct FlatChildren {
+  const uint32_t *begin_;
+  const uint32_t *end_;
+
+  const uint32_t *begin() const { return begin_; }
+  const uint32_t *end() const { return end_; }
+  size_t size() const { return end_ - begin_; }
+  uint32_t operator[](size_t i) const { return begin_[i]; }
+};
+
+class FlatTreeView {
+public:
+  FlatTreeView() = default;
+
+  // Checks the header and that every section fits in `size` bytes; the
+  // contents are only checked by Verify. `data` has to stay alive and be 4
+  // byte aligned.
+  FlatTreeView(const void *data, size_t size) {
+    if (size < sizeof(FlatTreeHeader) ||
+        reinterpret_cast<uintptr_t>(data) % alignof(uint32_t) != 0) {
+      throw std::invalid_argument("Not a flat tree");
+    }
+    std::memcpy(&header_, data, sizeof(header_));
+    if (std::memcmp(header_.magic_, FlatTreeHeader::MAGIC,
+                    sizeof(header_.magic_)) != 0 ||
+        header_.version_ != FlatTreeHeader::VERSION) {
+      throw std::invalid_argument("Not a flat tree");
+    }
+    uint64_t nodes = header_.node_count_;
+    uint64_t words = 5 * nodes + 1 + header_.child_count_ +
+                     header_.string_count_ + 1;
+    if (sizeof(FlatTreeHeader) + words * 4 + header_.pool_bytes_ > size) {
+      throw std::invalid_argument("Truncated flat tree");
+    }
+    auto word = reinterpret_cast<const uint32_t *>(
+        static_cast<const char *>(data) + sizeof(FlatTreeHeader));
+    type_ = word;
+    begin_ = type_ + nodes;
+    end_ = begin_ + nodes;
+    value_ = end_ + nodes;
+    child_begin_ = value_ + nodes;
+    child_ = child_begin_ + nodes + 1;
+    string_begin_ = child_ + header_.child_count_;
+    pool_ = reinterpret_cast<const char *>(string_begin_ +
+                                           header_.string_count_ + 1);
+  }
+
+  // Walks every section once: child ranges and string ranges in bounds and
+  // ascending, every child numbered before its parent.
+  bool Verify() const {
+    uint32_t nodes = header_.node_count_;
+    if (child_begin_[0] != 0 || child_begin_[nodes] != header_.child_count_ ||
+        string_begin_[0] != 0 ||
+        string_begin_[header_.string_count_] != header_.pool_bytes_) {
+      return false;
+    }
+    for (uint32_t i = 0; i < nodes; i++) {
+      if (child_begin_[i] > child_begin_[i + 1] ||
+          value_[i] >= header_.string_count_) {
+        return false;
+      }
+      for (auto child : Children(i)) {
+        if (child >= i) {
+          return false;
+        }
+      }
+    }
+    for (uint32_t i = 0; i < header_.string_count_; i++) {
+      if (string_begin_[i] > string_begin_[i + 1]) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  uint32_t NodeCount() const { return header_.node_count_; }
+  bool Empty() const { return header_.node_count_ == 0; }
+  uint32_t Root() const { return header_.node_count_ - 1; }
+
+  uint32_t Type(uint32_t node) const { return type_[node]; }
+  uint32_t Begin(uint32_t node) const { return begin_[node]; }
+  uint32_t End(uint32_t node) const { return end_[node]; }
+  std::string_view Value(uint32_t node) const {
+    uint32_t id = value_[node];
+    return {pool_ + string_begin_[id],
+            string_begin_[id + 1] - string_begin_[id]};
+  }
+  FlatChildren Children(uint32_t node) const {
+    return {child_ + child_begin_[node], child_ + child_begin_[node + 1]};
+  }
+
+private:
+  FlatTreeHeader header_{};
+  const uint32_t *type_ = nullptr;
+  const uint32_t *begin_ = nullptr;
+  const uint32_t *end_ = nullptr;
+  const uint32_t *value_ = nullptr;
+  const uint32_t *child_begin_ = nullptr;
+  const uint32_t *child_ = nullptr;
+  const uint32_t *string_begin_ = nullptr;
+  const char *pool_ = nullptr;
+};
+
+// Writes the tree under `root` in the layout above. Iterative, so the deep
+// trees of long right recursive lists are fine.
+template <class NodePtr>
+void WriteFlatTree(const NodePtr &root, std::ostream &os) {
+  std::vector<uint32_t> type, begin, end, value, child_begin = {0}, child;
+  std::vector<uint32_t> string_begin = {0};
+  std::string pool;
+  std::unordered_map<std::string_view, uint32_t> string_id;
+  auto intern = [&](const std::string *text) {
+    std::string_view key = text ? std::string_view(*text) : std::string_view();
+    auto [iter, inserted] =
+        string_id.emplace(key, static_cast<uint32_t>(string_id.size()));
+    if (inserted) {
+      pool.append(key);
+      string_begin.push_back(pool.size());
+    }
+    return iter->second;
+  };
+
+  // Node numbers of finished nodes whose parent is not finished yet.
+  std::vector<uint32_t> done;
+  std::vector<std::pair<decltype(&*root), size_t>> stack;
+  stack.emplace_back(&*root, 0);
+  while (!stack.empty()) {
+    auto &[node, next] = stack.back();
+    if (next < node->children_.size()) {
+      stack.emplace_back(&*node->children_[next++], 0);
+      continue;
+    }
+    size_t count = node->children_.size();
+    child.insert(child.end(), done.end() - count, done.end());
+    done.resize(done.size() - count);
+    child_begin.push_back(child.size());
+    type.push_back(static_cast<uint32_t>(node->type_));
+    begin.push_back(node->begin_);
+    end.push_back(node->end_);
+    value.push_back(intern(node->value_.get()));
+    done.push_back(type.size() - 1);
+    stack.pop_back();
+  }
+
+  FlatTreeHeader header;
+  std::memcpy(header.magic_, FlatTreeHeader::MAGIC, sizeof(header.magic_));
+  header.version_ = FlatTreeHeader::VERSION;
+  header.node_count_ = type.size();
+  header.child_count_ = child.size();
+  header.string_count_ = string_id.size();
+  header.pool_bytes_ = pool.size();
+  os.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  for (const auto *section :
+       {&type, &begin, &end, &value, &child_begin, &child, &string_begin}) {
+    os.write(reinterpret_cast<const char *>(section->data()),
+             section->size() * sizeof(uint32_t));
+  }
+  os.write(pool.data(), pool.size());
+}
+
+// A flat tree file mapped read-only; loading costs the mmap call and the
+// header check, pages are read as the view touches them.
+class MappedFlatTree {
+public:
+  explicit MappedFlatTree(const std::string &path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw std::invalid_argument("Can not open " + path);
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size == 0) {
+      ::close(fd);
+      throw std::invalid_argument("Not a flat tree: " + path);
+    }
+    size_ = st.st_size;
+    data_ = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data_ == MAP_FAILED) {
+      data_ = nullptr;
+      throw std::invalid_argument("Can not map " + path);
+    }
+    try {
+      view_ = FlatTreeView(data_, size_);
+    } catch (...) {
+      ::munmap(data_, size_);
+      throw;
+    }
+  }
+  ~MappedFlatTree() {
+    if (data_) {
+      ::munmap(data_, size_);
+    }
+  }
+  MappedFlatTree(const MappedFlatTree &) = delete;
+  MappedFlatTree &operator=(const MappedFlatTree &) = delete;
+
+  const FlatTreeView &View() const { return view_; }
+
+private:
+  void *data_ = nullptr;
+  size_t size_ = 0;
+  FlatTreeView view_;
+};
+} // namespace siicc
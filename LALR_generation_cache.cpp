@@ -0,0 +1,104 @@
+#include "LALR_generation_cache.h"
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <thread>
+#include <unistd.h>
+
+namespace siicc {
+namespace LALR {
+static constexpr uint64_t FNV_OFFSET = 14695981039346656037ull;
+static constexpr uint64_t FNV_PRIME = 1099511628211ull;
+
+static uint64_t Fnv1a(const char *data, size_t size, uint64_t hash) {
+  for (size_t i = 0; i < size; i++) {
+    hash ^= static_cast<unsigned char>(data[i]);
+    hash *= FNV_PRIME;
+  }
+  return hash;
+}
+
+static std::optional<std::string> ReadFile(const std::string &path) {
+  std::ifstream is(path, std::ios::binary);
+  if (!is) {
+    return std::nullopt;
+  }
+  std::stringstream ss;
+  ss << is.rdbuf();
+  return ss.str();
+}
+
+std::string GrammarFingerprint(const Grammar &grammar,
+                               const std::string &options) {
+  auto canonical = grammar.Canonical();
+  uint64_t hash = Fnv1a(canonical.data(), canonical.size(), FNV_OFFSET);
+  hash = Fnv1a(options.data(), options.size(), hash);
+  std::stringstream ss;
+  ss << std::hex << std::setw(16) << std::setfill('0') << hash;
+  return ss.str();
+}
+
+std::string GeneratorStamp() {
+  auto binary = ReadFile("/proc/self/exe");
+  if (!binary.has_value()) {
+    return std::string(__DATE__ " " __TIME__);
+  }
+  std::stringstream ss;
+  ss << std::hex << Fnv1a(binary->data(), binary->size(), FNV_OFFSET);
+  return ss.str();
+}
+
+bool WriteIfChanged(const std::string &path, const std::string &content) {
+  auto old_content = ReadFile(path);
+  if (old_content.has_value() && *old_content == content) {
+    return false;
+  }
+  std::ofstream os(path, std::ios::binary | std::ios::trunc);
+  os << content;
+  if (!os) {
+    throw std::runtime_error("Failed to write " + path);
+  }
+  return true;
+}
+
+std::optional<GeneratedParser>
+GenerationCache::Lookup(const std::string &fingerprint) const {
+  auto base = std::filesystem::path(dir_) / fingerprint;
+  auto header = ReadFile(base.string() + ".h");
+  auto cpp = ReadFile(base.string() + ".cpp");
+  auto tables = ReadFile(base.string() + ".tables");
+  if (!header.has_value() || !cpp.has_value() || !tables.has_value()) {
+    return std::nullopt;
+  }
+  return GeneratedParser{std::move(*header), std::move(*cpp),
+                         std::move(*tables)};
+}
+
+void GenerationCache::Store(const std::string &fingerprint,
+                            const GeneratedParser &parser) {
+  std::filesystem::create_directories(dir_);
+  auto base = std::filesystem::path(dir_) / fingerprint;
+  // Write to temporaries and rename, so a concurrent or interrupted run never
+  // leaves a half written entry behind. The temporaries are per process and
+  // thread, as BNF_driver_gen jobs may store the same entry at once.
+  auto unique = "." + std::to_string(::getpid()) + "." +
+                std::to_string(
+                    std::hash<std::thread::id>()(std::this_thread::get_id()));
+  for (const auto &[suffix, content] :
+       {std::make_pair(".h", &parser.header_),
+        std::make_pair(".cpp", &parser.cpp_),
+        std::make_pair(".tables", &parser.tables_)}) {
+    auto path = base.string() + suffix;
+    auto tmp_path = path + unique + ".tmp";
+    {
+      std::ofstream os(tmp_path, std::ios::binary | std::ios::trunc);
+      os << *content;
+      if (!os) {
+        throw std::runtime_error("Failed to write " + tmp_path);
+      }
+    }
+    std::filesystem::rename(tmp_path, path);
+  }
+}
+} // namespace LALR
+} // namespace siicc
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "LALR_common.h"
+#include <optional>
+#include <string>
+
+namespace siicc {
+namespace LALR {
+struct GeneratedParser {
+  std::string header_;
+  std::string cpp_;
+  // Embedded tables, empty unless generated with a blob path.
+  std::string tables_;
+};
+
+// 64-bit FNV-1a over Grammar::Canonical() and `options`, as hex.
+std::string GrammarFingerprint(const Grammar &grammar,
+                               const std::string &options);
+
+// Identifies the running generator build, so outputs cached by an older
+// generator are never reused.
+std::string GeneratorStamp();
+
+// Writes `content` to `path` only if the file does not already hold exactly
+// that content. Returns true if the file was written.
+bool WriteIfChanged(const std::string &path, const std::string &content);
+
+// Generated parsers stored on disk under `dir`, keyed by fingerprint.
+class GenerationCache {
+public:
+  GenerationCache(const std::string &dir) : dir_(dir) {}
+
+  std::optional<GeneratedParser> Lookup(const std::string &fingerprint) const;
+  void Store(const std::string &fingerprint, const GeneratedParser &parser);
+
+private:
+  std::string dir_;
+};
+} // namespace LALR
+} // namespace siicc
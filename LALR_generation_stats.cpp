@@ -0,0 +1,70 @@
+#include "LALR_generation_stats.h"
+#include <algorithm>
+#include <sstream>
+#include <sys/resource.h>
+
+namespace siicc {
+namespace LALR {
+long PeakRssKb() {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+void GenerationStats::AddPhase(const std::string &name, double milliseconds) {
+  auto iter = std::find_if(phases_.begin(), phases_.end(),
+                           [&](const auto &phase) { return phase.first == name; });
+  if (iter == phases_.end()) {
+    phases_.emplace_back(name, milliseconds);
+  } else {
+    iter->second += milliseconds;
+  }
+}
+
+static std::vector<std::pair<const char *, uint64_t>>
+CountersOf(const GenerationStats &stats) {
+  return {{"closure_lookups", stats.closure_lookups_},
+          {"closure_hits", stats.closure_hits_},
+          {"states", stats.states_},
+          {"transitions", stats.transitions_},
+          {"kernel_items", stats.kernel_items_},
+          {"normal_items", stats.normal_items_},
+          {"max_items_per_state", stats.max_items_per_state_},
+          {"lookahead_visits", stats.lookahead_visits_},
+          {"emitted_bytes", stats.emitted_bytes_},
+          {"peak_rss_kb", static_cast<uint64_t>(stats.peak_rss_kb_)}};
+}
+
+std::string GenerationStats::to_string() const {
+  std::stringstream ss;
+  ss << "phases (ms):\n";
+  for (const auto &[name, milliseconds] : phases_) {
+    ss << "  " << name << ": " << milliseconds << "\n";
+  }
+  ss << "counters:\n";
+  for (const auto &[name, value] : CountersOf(*this)) {
+    ss << "  " << name << ": " << value << "\n";
+  }
+  if (states_ != 0) {
+    ss << "  items_per_state: "
+       << static_cast<double>(kernel_items_ + normal_items_) / states_ << "\n";
+  }
+  return ss.str();
+}
+
+std::string GenerationStats::to_json() const {
+  std::stringstream ss;
+  ss << "{\"phases_ms\": {";
+  for (size_t i = 0; i < phases_.size(); i++) {
+    ss << (i ? ", " : "") << "\"" << phases_[i].first
+       << "\": " << phases_[i].second;
+  }
+  ss << "}";
+  for (const auto &[name, value] : CountersOf(*this)) {
+    ss << ", \"" << name << "\": " << value;
+  }
+  ss << "}\n";
+  return ss.str();
+}
+} // namespace LALR
+} // namespace siicc
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace siicc {
+namespace LALR {
+// Peak resident set of the process so far, in KiB.
+long PeakRssKb();
+
+// Timers and counters the generators fill in when given one through
+// SetStats.
+struct GenerationStats {
+  // Milliseconds per phase in the order the phases first ran. A nested phase
+  // is also counted in the one around it.
+  std::vector<std::pair<std::string, double>> phases_;
+  // GetClosure calls, and those that found an existing state.
+  uint64_t closure_lookups_ = 0;
+  uint64_t closure_hits_ = 0;
+  uint64_t states_ = 0;
+  uint64_t transitions_ = 0;
+  uint64_t kernel_items_ = 0;
+  uint64_t normal_items_ = 0;
+  uint64_t max_items_per_state_ = 0;
+  // States taken off the lookahead propagation worklist.
+  uint64_t lookahead_visits_ = 0;
+  uint64_t emitted_bytes_ = 0;
+  long peak_rss_kb_ = 0;
+
+  void AddPhase(const std::string &name, double milliseconds);
+  std::string to_string() const;
+  std::string to_json() const;
+};
+
+// Adds the lifetime of the scope to a phase of `stats`. Does nothing, not
+// even reading the clock, when `stats` is null.
+class PhaseTimer {
+public:
+  PhaseTimer(GenerationStats *stats, const char *name)
+      : stats_(stats), name_(name) {
+    if (stats_) {
+      begin_ = std::chrono::steady_clock::now();
+    }
+  }
+  ~PhaseTimer() {
+    if (stats_) {
+      stats_->AddPhase(name_, std::chrono::duration<double, std::milli>(
+                                  std::chrono::steady_clock::now() - begin_)
+                                  .count());
+    }
+  }
+
+private:
+  GenerationStats *stats_;
+  const char *name_;
+  std::chrono::steady_clock::time_point begin_;
+};
+} // namespace LALR
+} // namespace siicc
@@ -0,0 +1,366 @@
+#pragma once
+
+#include "LALR_runtime.h"
+#include <algorithm>
+#include <utility>
+
+namespace siicc {
+// Generalized LR parser for tables with conflict cells (CONFLICT_COUNT > 0).
+// It runs as a plain LR parser on vector stacks on top of a graph-structured
+// stack (GSS). Only when the current state has conflicts, or a reduce reaches
+// a GSS node with several predecessors, are the stacks spilled into the GSS
+// and every top is advanced over the token. Reductions deriving the same
+// nonterminal over the same span share one node of the parse forest; other
+// derivations go to its `alternatives_`. As soon as a single top is left the
+// parser returns to the deterministic loop.
+template <class Tables> class GLRParser {
+public:
+  typedef typename Tables::Node Node;
+  typedef std::shared_ptr<Node> NodePtr;
+  typedef typename Tables::LexerType LexerType;
+
+  static NodePtr Parse(std::shared_ptr<LexerType> lexer) {
+    if constexpr (Tables::CONFLICT_COUNT == 0) {
+      return LRParser<Tables>::Parse(std::move(lexer));
+    } else {
+      GLRParser parser;
+      return parser.Run(*lexer);
+    }
+  }
+
+  // The recovering Parse of LRParser, for callers written against it. Input
+  // the GLR parser accepts gives the same forest as above and no errors.
+  // Otherwise the tokens are replayed to LRParser, which repairs them but
+  // follows only the first action of every conflict cell, so it may report
+  // errors another action would have avoided. Keeps every token until the
+  // parse ends.
+  static NodePtr Parse(std::shared_ptr<LexerType> lexer,
+                       std::vector<SyntaxError> &errors,
+                       const RecoveryOptions &options = RecoveryOptions()) {
+    if constexpr (Tables::CONFLICT_COUNT == 0) {
+      return LRParser<Tables>::Parse(std::move(lexer), errors, options);
+    } else {
+      auto replay = std::make_shared<ReplayLexer>(*lexer);
+      try {
+        GLRParser parser;
+        return parser.Run(*replay);
+      } catch (const ParseError &) {
+      }
+      replay->Rewind();
+      return LRParser<Tables>::Parse(replay, errors, options);
+    }
+  }
+
+private:
+  typedef decltype(std::declval<LexerType &>().Next()) Token;
+
+  // Hands out the tokens of `source_` and keeps them, so they can be read
+  // again from the start after Rewind.
+  class ReplayLexer : public LexerType {
+  public:
+    explicit ReplayLexer(LexerType &source) : source_(source) {}
+
+    Token Next() override {
+      if (next_ == tokens_.size()) {
+        tokens_.push_back(source_.Next());
+      }
+      return tokens_[next_++];
+    }
+
+    void Rewind() { next_ = 0; }
+
+  private:
+    LexerType &source_;
+    std::vector<Token> tokens_;
+    size_t next_ = 0;
+  };
+
+  struct StackNode;
+  typedef std::shared_ptr<StackNode> StackNodePtr;
+  struct Link {
+    StackNodePtr prev_;
+    NodePtr node_;
+  };
+  struct StackNode {
+    int32_t state_;
+    std::vector<Link> links_;
+  };
+  // Reduce by `production_` along paths from `top_` whose first link is in
+  // [link_begin_, link_end_). Links added later get their own reduction.
+  struct Reduction {
+    StackNodePtr top_;
+    size_t link_begin_;
+    size_t link_end_;
+    uint32_t production_;
+  };
+
+  static std::pair<const uint32_t *, const uint32_t *>
+  Conflicts(int32_t state, uint32_t terminal) {
+    if (!Tables::has_conflict[state]) {
+      return {nullptr, nullptr};
+    }
+    uint32_t cell = state * (Tables::TERMINATOR_COUNT + 1) + terminal;
+    auto end = Tables::conflict_cell + Tables::CONFLICT_COUNT;
+    auto iter = std::lower_bound(Tables::conflict_cell, end, cell);
+    if (iter == end || *iter != cell) {
+      return {nullptr, nullptr};
+    }
+    auto index = iter - Tables::conflict_cell;
+    return {Tables::conflict_reduce + Tables::conflict_begin[index],
+            Tables::conflict_reduce + Tables::conflict_begin[index + 1]};
+  }
+
+  int32_t CurrentState() const {
+    return state_stack_.empty() ? base_->state_ : state_stack_.back();
+  }
+
+  NodePtr Run(LexerType &lexer) {
+    base_ = std::make_shared<StackNode>();
+    base_->state_ = 0;
+    auto next_token = lexer.Next();
+    uint32_t next_id = static_cast<uint32_t>(next_token.type_);
+    while (true) {
+      int32_t current_state = CurrentState();
+      auto conflicts = Conflicts(current_state, next_id);
+      int32_t action = Tables::Action(current_state, next_id);
+      if (conflicts.first == conflicts.second) {
+        if (action > 0) {
+          ast_stack_.push_back(Tables::CreateNode(next_id, next_token.value_));
+          SpanToken(*ast_stack_.back(), next_token);
+          state_stack_.push_back(action);
+          next_token = lexer.Next();
+          next_id = static_cast<uint32_t>(next_token.type_);
+          continue;
+        }
+        if (action < 0) {
+          auto accepted = ReduceLinear(-action);
+          if (accepted.first) {
+            if (accepted.second) {
+              return accepted.second;
+            }
+            continue;
+          }
+        }
+      }
+
+      // Ambiguous region: advance all stack tops token by token until they
+      // collapse into one again.
+      std::vector<StackNodePtr> frontier = {Spill()};
+      while (true) {
+        auto leaf = Tables::CreateNode(next_id, next_token.value_);
+        SpanToken(*leaf, next_token);
+        auto accepted = Advance(frontier, next_id, leaf);
+        if (accepted) {
+          return accepted;
+        }
+        next_token = lexer.Next();
+        next_id = static_cast<uint32_t>(next_token.type_);
+        if (frontier.size() == 1) {
+          break;
+        }
+      }
+      base_ = std::move(frontier.front());
+    }
+  }
+
+  // Reduces on the vector stacks, continuing into the GSS while its nodes
+  // have a single predecessor. Returns false, without touching the stacks,
+  // when the path forks; otherwise the accepted tree, if any.
+  std::pair<bool, NodePtr> ReduceLinear(uint32_t production) {
+    uint32_t reduce_count = Tables::reduce_length[production];
+    uint32_t new_token = Tables::reduce_result[production];
+    auto new_AST_Node = Tables::CreateNode(new_token, nullptr);
+    if (reduce_count <= ast_stack_.size()) {
+      auto first_child = ast_stack_.end() - reduce_count;
+      new_AST_Node->children_.assign(std::make_move_iterator(first_child),
+                                     std::make_move_iterator(ast_stack_.end()));
+      ast_stack_.erase(first_child, ast_stack_.end());
+      state_stack_.resize(state_stack_.size() - reduce_count);
+    } else {
+      size_t below = reduce_count - ast_stack_.size();
+      auto bottom = base_;
+      for (size_t i = 0; i < below; i++) {
+        if (bottom->links_.size() != 1) {
+          return {false, nullptr};
+        }
+        bottom = bottom->links_.front().prev_;
+      }
+      auto &children = new_AST_Node->children_;
+      children.resize(reduce_count);
+      auto node = base_;
+      for (size_t i = below; i > 0; i--) {
+        children[i - 1] = node->links_.front().node_;
+        node = node->links_.front().prev_;
+      }
+      std::move(ast_stack_.begin(), ast_stack_.end(), children.begin() + below);
+      ast_stack_.clear();
+      state_stack_.clear();
+      base_ = std::move(bottom);
+    }
+    SpanChildren(*new_AST_Node);
+    if (new_token == Tables::ACCEPT_TOKEN) {
+      return {true, new_AST_Node};
+    }
+    state_stack_.push_back(Tables::Goto(CurrentState(), new_token));
+    ast_stack_.push_back(std::move(new_AST_Node));
+    return {true, nullptr};
+  }
+
+  // Moves the vector stacks into the GSS and returns the new top.
+  StackNodePtr Spill() {
+    auto top = base_;
+    for (size_t i = 0; i < state_stack_.size(); i++) {
+      auto node = std::make_shared<StackNode>();
+      node->state_ = state_stack_[i];
+      node->links_.push_back({std::move(top), std::move(ast_stack_[i])});
+      top = std::move(node);
+    }
+    state_stack_.clear();
+    ast_stack_.clear();
+    base_ = nullptr;
+    return top;
+  }
+
+  // Performs every reduction on `terminal` from the tops in `frontier`, then
+  // shifts `leaf` and replaces `frontier` with the shifted tops. Returns the
+  // accepted tree when the end token completes the start symbol.
+  NodePtr Advance(std::vector<StackNodePtr> &frontier, uint32_t terminal,
+                  const NodePtr &leaf) {
+    std::vector<Reduction> worklist;
+    auto enqueue = [&](const StackNodePtr &top, size_t link_begin) {
+      int32_t action = Tables::Action(top->state_, terminal);
+      size_t link_end = top->links_.size();
+      if (action < 0) {
+        worklist.push_back({top, link_begin, link_end,
+                            static_cast<uint32_t>(-action)});
+      }
+      auto conflicts = Conflicts(top->state_, terminal);
+      for (auto iter = conflicts.first; iter != conflicts.second; iter++) {
+        worklist.push_back({top, link_begin, link_end, *iter});
+      }
+    };
+    for (const auto &top : frontier) {
+      enqueue(top, 0);
+    }
+
+    NodePtr accepted;
+    std::vector<NodePtr> children;
+    while (!worklist.empty()) {
+      auto reduction = std::move(worklist.back());
+      worklist.pop_back();
+      uint32_t reduce_count = Tables::reduce_length[reduction.production_];
+      uint32_t new_token = Tables::reduce_result[reduction.production_];
+      children.resize(reduce_count);
+      ForEachPath(reduction, children, [&](const StackNodePtr &bottom) {
+        auto new_AST_Node = Tables::CreateNode(new_token, nullptr);
+        new_AST_Node->children_ = children;
+        SpanChildren(*new_AST_Node);
+        if (new_token == Tables::ACCEPT_TOKEN) {
+          if (accepted) {
+            Pack(accepted, std::move(new_AST_Node));
+          } else {
+            accepted = std::move(new_AST_Node);
+          }
+          return;
+        }
+        int32_t next_state = Tables::Goto(bottom->state_, new_token);
+        auto top = std::find_if(
+            frontier.begin(), frontier.end(),
+            [&](const StackNodePtr &node) { return node->state_ == next_state; });
+        if (top == frontier.end()) {
+          auto node = std::make_shared<StackNode>();
+          node->state_ = next_state;
+          node->links_.push_back({bottom, std::move(new_AST_Node)});
+          frontier.push_back(node);
+          enqueue(node, 0);
+          return;
+        }
+        for (auto &link : (*top)->links_) {
+          if (link.prev_ == bottom) {
+            Pack(link.node_, std::move(new_AST_Node));
+            return;
+          }
+        }
+        (*top)->links_.push_back({bottom, std::move(new_AST_Node)});
+        enqueue(*top, (*top)->links_.size() - 1);
+      });
+    }
+    if (accepted) {
+      return accepted;
+    }
+
+    std::vector<StackNodePtr> shifted;
+    for (const auto &top : frontier) {
+      int32_t action = Tables::Action(top->state_, terminal);
+      if (action <= 0) {
+        continue;
+      }
+      auto iter = std::find_if(
+          shifted.begin(), shifted.end(),
+          [&](const StackNodePtr &node) { return node->state_ == action; });
+      if (iter == shifted.end()) {
+        auto node = std::make_shared<StackNode>();
+        node->state_ = action;
+        shifted.push_back(node);
+        iter = shifted.end() - 1;
+      }
+      (*iter)->links_.push_back({top, leaf});
+    }
+    if (shifted.empty()) {
+      throw ParseError(std::string(Tables::DEBUG_INFO_TABLE[terminal - 1]) +
+                           " not accpeted",
+                       leaf->begin_);
+    }
+    frontier = std::move(shifted);
+    return nullptr;
+  }
+
+  // Calls `visit(bottom)` for every path of `children.size()` links below
+  // the reduction's top, with `children` holding the nodes along it.
+  template <class Visit>
+  static void ForEachPath(const Reduction &reduction,
+                          std::vector<NodePtr> &children, Visit &&visit) {
+    if (children.empty()) {
+      visit(reduction.top_);
+      return;
+    }
+    for (size_t i = reduction.link_begin_; i < reduction.link_end_; i++) {
+      // `visit` may add links to the nodes being walked, so copy them.
+      auto link = reduction.top_->links_[i];
+      children.back() = link.node_;
+      WalkPath(link.prev_, children, children.size() - 1, visit);
+    }
+  }
+
+  template <class Visit>
+  static void WalkPath(const StackNodePtr &node, std::vector<NodePtr> &children,
+                       size_t remain, Visit &visit) {
+    if (remain == 0) {
+      visit(node);
+      return;
+    }
+    for (size_t i = 0; i < node->links_.size(); i++) {
+      auto link = node->links_[i];
+      children[remain - 1] = link.node_;
+      WalkPath(link.prev_, children, remain - 1, visit);
+    }
+  }
+
+  // Adds `node` as another derivation of `packed`, unless it is one already.
+  static void Pack(const NodePtr &packed, NodePtr node) {
+    if (packed->children_ == node->children_) {
+      return;
+    }
+    for (const auto &alternative : packed->alternatives_) {
+      if (alternative->children_ == node->children_) {
+        return;
+      }
+    }
+    packed->alternatives_.push_back(std::move(node));
+  }
+
+  StackNodePtr base_;
+  std::vector<int32_t> state_stack_;
+  std::vector<NodePtr> ast_stack_;
+};
+} // namespace siicc
@@ -0,0 +1,284 @@
+#include "LALR_grammar_loader.h"
+#include "LALR_EBNF_lexer.h"
+#include <cctype>
+
+namespace siicc {
+namespace LALR {
+namespace {
+typedef ASTNode::Type NodeType;
+
+bool IsIdentifier(const std::string &name) {
+  if (name.empty() || std::isdigit(static_cast<unsigned char>(name[0]))) {
+    return false;
+  }
+  return std::all_of(name.begin(), name.end(), [](char ch) {
+    return std::isalnum(static_cast<unsigned char>(ch)) || ch == '_';
+  });
+}
+
+struct BodyItem {
+  TokenPtr token_;
+  bool optional_;
+};
+
+// Symbols interned by name while the productions are read.
+class GrammarBuilder {
+public:
+  GrammarBuilder() {
+    grammar_.blank_ = NewBlank();
+    grammar_.end_ = NewTerminator("end", "$");
+    grammar_.terminators_ = {grammar_.blank_, grammar_.end_};
+  }
+
+  // `text` as written in the file, `offset` for errors.
+  TokenPtr Symbol(const std::string &text, uint32_t offset) {
+    if (text.size() >= 2 && text.front() == '<' && text.back() == '>') {
+      auto name = text.substr(1, text.size() - 2);
+      if (!IsIdentifier(name) || name == "START" || lists_.count(name) ||
+          tails_.count(name)) {
+        throw ParseError("Invalid nonterminator name " + text, offset);
+      }
+      auto &token = nonterminators_[name];
+      if (!token) {
+        token = NewNonTerminator(name);
+        grammar_.nonterminators_.insert(token);
+      }
+      return token;
+    }
+    if (text.size() >= 3 && (text.front() == '\'' || text.front() == '"') &&
+        text.back() == text.front()) {
+      auto spelling = text.substr(1, text.size() - 2);
+      auto &token = keywords_[spelling];
+      if (!token) {
+        // Token and node names have to be identifiers.
+        std::string name = "kw_";
+        for (unsigned char ch : spelling) {
+          if (std::isalnum(ch) || ch == '_') {
+            name.push_back(ch);
+          } else {
+            const char *hex = "0123456789ABCDEF";
+            name += {'x', hex[ch >> 4], hex[ch & 15]};
+          }
+        }
+        token = NewTerminator(name, spelling);
+        grammar_.terminators_.insert(token);
+        grammar_.Keywords({token});
+      }
+      return token;
+    }
+    if (!IsIdentifier(text) || text == "end" || text == "Blank" ||
+        text.compare(0, 3, "kw_") == 0) {
+      throw ParseError("Invalid terminator name " + text, offset);
+    }
+    auto &token = terminators_[text];
+    if (!token) {
+      if (text == "error") {
+        token = grammar_.error_ = NewErrorToken();
+      } else {
+        token = NewTerminator(text, text);
+      }
+      grammar_.terminators_.insert(token);
+    }
+    return token;
+  }
+
+  // X_list -> X | X_list X, built once per X.
+  TokenPtr List(const TokenPtr &item, uint32_t offset) {
+    auto name = item->name_ + "_list";
+    auto &list = lists_[name];
+    if (!list) {
+      if (nonterminators_.count(name) || tails_.count(name)) {
+        throw ParseError("List of " + item->to_string() + " clashes with <" +
+                             name + ">",
+                         offset);
+      }
+      list = NewNonTerminator(name);
+      grammar_.nonterminators_.insert(list);
+      grammar_.productions_.push_back(
+          std::make_shared<Production>(list, TokenPtrVec{item}));
+      grammar_.productions_.push_back(
+          std::make_shared<Production>(list, TokenPtrVec{list, item}));
+    }
+    return list;
+  }
+
+  // Adds the productions of one alternative of `head`. Optional items are
+  // lowered from the back: the items from an optional one up to the next
+  // get a helper nonterminal deriving the non-empty strings of the rest of
+  // the alternative, so the productions grow linearly with the optional
+  // items. A single optional item needs no helper.
+  void Alternative(const TokenPtr &head, const std::vector<BodyItem> &items,
+                   uint32_t offset) {
+    std::vector<size_t> optionals;
+    for (size_t i = 0; i < items.size(); i++) {
+      if (items[i].optional_) {
+        optionals.push_back(i);
+      }
+    }
+    auto required = [&](size_t begin, size_t end) {
+      TokenPtrVec tokens;
+      for (size_t i = begin; i < end; i++) {
+        tokens.push_back(items[i].token_);
+      }
+      return tokens;
+    };
+    auto prefix = required(0, optionals.empty() ? items.size() : optionals[0]);
+    // The non-empty bodies of the suffix from the optional item being
+    // lowered, the helper for the suffix after it and whether that suffix
+    // can be empty.
+    std::vector<TokenPtrVec> bodies;
+    TokenPtr next;
+    bool rest_empty = true;
+    // Helpers are numbered in the order of their optional items.
+    uint32_t first_tail = tail_count_[head->name_] + 1;
+    if (!optionals.empty()) {
+      tail_count_[head->name_] += optionals.size() - 1;
+    }
+    for (size_t m = optionals.size(); m-- > 0;) {
+      auto end = m + 1 < optionals.size() ? optionals[m + 1] : items.size();
+      auto without = required(optionals[m] + 1, end);
+      auto with = without;
+      with.insert(with.begin(), items[optionals[m]].token_);
+      bodies.clear();
+      for (auto *part : {&with, &without}) {
+        if (next) {
+          bodies.push_back(*part);
+          bodies.back().push_back(next);
+        }
+        if (rest_empty && !part->empty()) {
+          bodies.push_back(*part);
+        }
+      }
+      rest_empty = rest_empty && without.empty();
+      if (m > 0) {
+        next = OptionalTail(head, first_tail + m - 1, offset);
+        for (auto &body : bodies) {
+          grammar_.productions_.push_back(
+              std::make_shared<Production>(next, std::move(body)));
+        }
+      }
+    }
+    if (optionals.empty() || rest_empty) {
+      if (prefix.empty()) {
+        throw ParseError("Alternative of " + head->to_string() +
+                             " can derive the empty string",
+                         offset);
+      }
+      grammar_.productions_.push_back(
+          std::make_shared<Production>(head, prefix));
+    }
+    for (const auto &body : bodies) {
+      auto tokens = prefix;
+      tokens.insert(tokens.end(), body.begin(), body.end());
+      grammar_.productions_.push_back(
+          std::make_shared<Production>(head, std::move(tokens)));
+    }
+  }
+
+  Grammar &Get() { return grammar_; }
+
+private:
+  // A new helper of `head` for the rest of an alternative after an
+  // optional item: <head>_opt_tail, then _opt_tail2 and so on.
+  TokenPtr OptionalTail(const TokenPtr &head, uint32_t number,
+                        uint32_t offset) {
+    auto name = head->name_ + "_opt_tail" +
+                (number > 1 ? std::to_string(number) : std::string());
+    if (nonterminators_.count(name) || lists_.count(name)) {
+      throw ParseError("Optional items of " + head->to_string() +
+                           " clash with <" + name + ">",
+                       offset);
+    }
+    auto &tail = tails_[name];
+    tail = NewNonTerminator(name);
+    grammar_.nonterminators_.insert(tail);
+    return tail;
+  }
+
+  Grammar grammar_;
+  std::map<std::string, TokenPtr> nonterminators_;
+  std::map<std::string, TokenPtr> terminators_;
+  std::map<std::string, TokenPtr> keywords_;
+  // By the list's name.
+  std::map<std::string, TokenPtr> lists_;
+  // Helpers of optional items by name, and how many each head has so far.
+  std::map<std::string, TokenPtr> tails_;
+  std::map<std::string, uint32_t> tail_count_;
+};
+} // namespace
+
+Grammar LoadEBNFGrammar(std::istream &is) {
+  auto root = Parse(std::make_shared<BNFLexer>(is));
+  // The parser checked the structure, so the leaves in order are enough:
+  // head, ::=, items separated by |, and ;. Collected without recursion,
+  // as long lists nest deeply.
+  std::vector<const ASTNode *> leaves;
+  std::vector<const ASTNode *> pending = {root.get()};
+  while (!pending.empty()) {
+    auto node = pending.back();
+    pending.pop_back();
+    if (node->children_.empty()) {
+      leaves.push_back(node);
+    }
+    for (auto iter = node->children_.rbegin(); iter != node->children_.rend();
+         iter++) {
+      pending.push_back(iter->get());
+    }
+  }
+
+  GrammarBuilder builder;
+  auto &grammar = builder.Get();
+  TokenPtr head;
+  // The items of the current alternative.
+  std::vector<BodyItem> items;
+  // Of the first item of the alternative.
+  std::optional<uint32_t> body_offset;
+  auto close_body = [&]() {
+    builder.Alternative(head, items, body_offset.value_or(0));
+    items.clear();
+    body_offset.reset();
+  };
+  for (auto leaf : leaves) {
+    const auto &text = leaf->value_ ? *leaf->value_ : std::string();
+    if (head && !body_offset && leaf->type_ != NodeType::LEAF_equals) {
+      body_offset = leaf->begin_;
+    }
+    switch (leaf->type_) {
+    case NodeType::LEAF_or:
+      close_body();
+      break;
+    case NodeType::LEAF_semicolon:
+      close_body();
+      head = nullptr;
+      break;
+    case NodeType::LEAF_nonterminator:
+      if (!head) {
+        head = builder.Symbol(text, leaf->begin_);
+        if (!grammar.start_) {
+          grammar.start_ = head;
+        }
+        break;
+      }
+      [[fallthrough]];
+    case NodeType::LEAF_terminator:
+      items.push_back({builder.Symbol(text, leaf->begin_), false});
+      break;
+    case NodeType::LEAF_nonterminator_one_more:
+    case NodeType::LEAF_nonterminator_repreated:
+    case NodeType::LEAF_nonterminator_optional: {
+      auto item = builder.Symbol(text, leaf->begin_);
+      if (leaf->type_ != NodeType::LEAF_nonterminator_optional) {
+        item = builder.List(item, leaf->begin_);
+      }
+      items.push_back(
+          {item, leaf->type_ != NodeType::LEAF_nonterminator_one_more});
+      break;
+    }
+    default:
+      break;
+    }
+  }
+  return std::move(grammar);
+}
+} // namespace LALR
+} // namespace siicc
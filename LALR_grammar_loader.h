@@ -0,0 +1,28 @@
+#pragma once
+
+#include "LALR_common.h"
+#include <istream>
+
+namespace siicc {
+namespace LALR {
+// Builds a Grammar from a file in the EBNF the generated siicc_EBNF parser
+// reads, symbols separated by white space:
+//
+//   <Expr> ::= <Expr> '+' <Term> | <Term> ;
+//   <Term> ::= number | '(' <Expr> ')' | {<Term>}+ ;
+//
+// The head of the first production is the start symbol. A quoted word is a
+// keyword spelled as quoted (see Grammar::Keywords), a bare word a terminal
+// the lexer returns by that name, and `error` the error token. {X}+ is one
+// or more X, through X_list -> X | X_list X, {X}* and {X}? zero or more and
+// at most one. As the runtime has no blank productions, optional items are
+// expanded into the alternatives with and without them, so an alternative
+// may not consist of optional items only. An alternative with one optional
+// item becomes two productions; with more, the rest of the alternative
+// after each optional item but the first goes to a helper nonterminal
+// <head>_opt_tail (then _opt_tail2 and so on) deriving its non-empty
+// strings, so the helpers show up in the tree. Errors are thrown as
+// ParseError with the offset of the offending symbol.
+Grammar LoadEBNFGrammar(std::istream &is);
+} // namespace LALR
+} // namespace siicc
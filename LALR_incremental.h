@@ -0,0 +1,626 @@
+#pragma once
+
+#include "LALR_runtime.h"
+#include <cstring>
+#include <istream>
+#include <streambuf>
+
+namespace siicc {
+// Read-only stream over a slice of a string, so relexing a damaged region
+// does not copy the rest of the text.
+class SpanBuf : public std::streambuf {
+public:
+  SpanBuf(const char *begin, const char *end) {
+    char *first = const_cast<char *>(begin);
+    setg(first, first, const_cast<char *>(end));
+  }
+};
+
+// Text with a gap at the last edit, so an edit moves the bytes between it and
+// the previous edit instead of the whole tail.
+class GapText {
+public:
+  explicit GapText(std::string text = std::string())
+      : buffer_(std::move(text)), gap_begin_(buffer_.size()),
+        gap_end_(buffer_.size()) {}
+
+  size_t Size() const { return buffer_.size() - (gap_end_ - gap_begin_); }
+
+  void Replace(size_t offset, size_t erase_length,
+               const std::string &insertion) {
+    MoveGap(offset);
+    gap_end_ += erase_length;
+    if (gap_end_ - gap_begin_ < insertion.size()) {
+      // At least doubles the buffer, so growing is amortized over the edits.
+      size_t grow = std::max(insertion.size(), buffer_.size());
+      buffer_.insert(gap_end_, grow, '\0');
+      gap_end_ += grow;
+    }
+    std::memcpy(buffer_.data() + gap_begin_, insertion.data(),
+                insertion.size());
+    gap_begin_ += insertion.size();
+  }
+
+  // Copies the text out.
+  std::string Str() const {
+    return buffer_.substr(0, gap_begin_) + buffer_.substr(gap_end_);
+  }
+
+  // Reads the text from `offset` on, stepping over the gap.
+  class Reader : public std::streambuf {
+  public:
+    Reader(const GapText &text, size_t offset) {
+      const char *data = text.buffer_.data();
+      rest_end_ = data + text.buffer_.size();
+      if (offset < text.gap_begin_) {
+        Set(data + offset, data + text.gap_begin_);
+        rest_begin_ = data + text.gap_end_;
+      } else {
+        Set(data + offset + (text.gap_end_ - text.gap_begin_), rest_end_);
+      }
+    }
+
+  protected:
+    int_type underflow() override {
+      if (gptr() == egptr() && rest_begin_) {
+        Set(rest_begin_, rest_end_);
+        rest_begin_ = nullptr;
+      }
+      return gptr() == egptr() ? traits_type::eof()
+                               : traits_type::to_int_type(*gptr());
+    }
+
+  private:
+    void Set(const char *begin, const char *end) {
+      setg(const_cast<char *>(begin), const_cast<char *>(begin),
+           const_cast<char *>(end));
+    }
+
+    const char *rest_begin_ = nullptr;
+    const char *rest_end_;
+  };
+
+private:
+  void MoveGap(size_t offset) {
+    char *data = buffer_.data();
+    if (offset < gap_begin_) {
+      size_t count = gap_begin_ - offset;
+      std::memmove(data + gap_end_ - count, data + offset, count);
+      gap_begin_ -= count;
+      gap_end_ -= count;
+    } else if (offset > gap_begin_) {
+      size_t count = offset - gap_begin_;
+      std::memmove(data + gap_begin_, data + gap_end_, count);
+      gap_begin_ += count;
+      gap_end_ += count;
+    }
+  }
+
+  std::string buffer_;
+  size_t gap_begin_;
+  size_t gap_end_;
+};
+
+// The tokens of a text in order, as an implicit treap. A token keeps its
+// distance from the end of the one before instead of its offset, so an edit
+// only rewrites the tokens it replaces and the gap of the next one. Looking a
+// token up by index or offset costs O(log n), replacing a range O(log n) plus
+// the tokens put in.
+class TokenSequence {
+public:
+  // Offsets are those in the text, the sequence works them out.
+  struct Token {
+    uint32_t type_;
+    std::shared_ptr<std::string> value_;
+    uint32_t begin_;
+    uint32_t end_;
+  };
+
+  size_t Size() const { return Count(root_); }
+
+  void Clear() {
+    nodes_.clear();
+    free_.clear();
+    root_ = -1;
+  }
+
+  Token Get(size_t index) const {
+    int32_t node = root_;
+    uint32_t base = 0;
+    while (true) {
+      const auto &item = nodes_[node];
+      size_t left = Count(item.left_);
+      if (index < left) {
+        node = item.left_;
+        continue;
+      }
+      base += Bytes(item.left_) + item.gap_;
+      if (index == left) {
+        return {item.type_, item.value_, base, base + item.length_};
+      }
+      base += item.length_;
+      index -= left + 1;
+      node = item.right_;
+    }
+  }
+
+  // The first token ending at or after `offset`, Size() if there is none.
+  size_t FirstEndingFrom(uint32_t offset) const {
+    return LowerBound(offset, true);
+  }
+  // The first token beginning at or after `offset`, Size() if there is none.
+  size_t FirstBeginningFrom(uint32_t offset) const {
+    return LowerBound(offset, false);
+  }
+
+  // Replaces the tokens [begin, end) with `tokens`. The offsets of the
+  // tokens after them move by `delta`.
+  void Replace(size_t begin, size_t end, const std::vector<Token> &tokens,
+               int64_t delta) {
+    int64_t next_begin = end < Size() ? Get(end).begin_ + delta : 0;
+    int32_t left, middle, right;
+    Split(root_, begin, left, middle);
+    Split(middle, end - begin, middle, right);
+    Free(middle);
+    // The bytes up to a token are the end of the one before.
+    uint32_t previous_end = Bytes(left);
+    middle = Build(tokens, previous_end);
+    if (!tokens.empty()) {
+      previous_end = tokens.back().end_;
+    }
+    if (right >= 0) {
+      int32_t first, rest;
+      Split(right, 1, first, rest);
+      nodes_[first].gap_ = static_cast<uint32_t>(next_begin - previous_end);
+      Update(first);
+      right = Merge(first, rest);
+    }
+    root_ = Merge(Merge(left, middle), right);
+  }
+
+private:
+  struct Node {
+    uint32_t type_;
+    std::shared_ptr<std::string> value_;
+    // From the end of the token before, or the start of the text.
+    uint32_t gap_;
+    uint32_t length_;
+    uint32_t priority_;
+    int32_t left_ = -1;
+    int32_t right_ = -1;
+    // Tokens in the subtree, and bytes from the start of its first token's
+    // gap to the end of its last token.
+    uint32_t count_;
+    uint32_t bytes_;
+  };
+
+  size_t Count(int32_t node) const {
+    return node < 0 ? 0 : nodes_[node].count_;
+  }
+  uint32_t Bytes(int32_t node) const {
+    return node < 0 ? 0 : nodes_[node].bytes_;
+  }
+
+  void Update(int32_t node) {
+    auto &item = nodes_[node];
+    item.count_ = Count(item.left_) + 1 + Count(item.right_);
+    item.bytes_ =
+        Bytes(item.left_) + item.gap_ + item.length_ + Bytes(item.right_);
+  }
+
+  size_t LowerBound(uint32_t offset, bool by_end) const {
+    size_t result = Size();
+    size_t index = 0;
+    uint32_t base = 0;
+    for (int32_t node = root_; node >= 0;) {
+      const auto &item = nodes_[node];
+      uint32_t begin = base + Bytes(item.left_) + item.gap_;
+      if ((by_end ? begin + item.length_ : begin) >= offset) {
+        result = index + Count(item.left_);
+        node = item.left_;
+      } else {
+        base = begin + item.length_;
+        index += Count(item.left_) + 1;
+        node = item.right_;
+      }
+    }
+    return result;
+  }
+
+  // The first `count` tokens of `node` go to `left`, the rest to `right`.
+  void Split(int32_t node, size_t count, int32_t &left, int32_t &right) {
+    if (node < 0) {
+      left = right = -1;
+      return;
+    }
+    auto &item = nodes_[node];
+    if (Count(item.left_) < count) {
+      Split(item.right_, count - Count(item.left_) - 1, item.right_, right);
+      left = node;
+    } else {
+      Split(item.left_, count, left, item.left_);
+      right = node;
+    }
+    Update(node);
+  }
+
+  int32_t Merge(int32_t left, int32_t right) {
+    if (left < 0 || right < 0) {
+      return left < 0 ? right : left;
+    }
+    if (nodes_[left].priority_ > nodes_[right].priority_) {
+      nodes_[left].right_ = Merge(nodes_[left].right_, right);
+      Update(left);
+      return left;
+    }
+    nodes_[right].left_ = Merge(left, nodes_[right].left_);
+    Update(right);
+    return right;
+  }
+
+  // A treap of `tokens` in linear time, keeping the right spine on a stack.
+  int32_t Build(const std::vector<Token> &tokens, uint32_t previous_end) {
+    std::vector<int32_t> spine;
+    for (const auto &token : tokens) {
+      int32_t node = Allocate();
+      auto &item = nodes_[node];
+      item.type_ = token.type_;
+      item.value_ = token.value_;
+      item.gap_ = token.begin_ - previous_end;
+      item.length_ = token.end_ - token.begin_;
+      previous_end = token.end_;
+      int32_t last = -1;
+      while (!spine.empty() &&
+             nodes_[spine.back()].priority_ < item.priority_) {
+        last = spine.back();
+        spine.pop_back();
+        Update(last);
+      }
+      item.left_ = last;
+      if (!spine.empty()) {
+        nodes_[spine.back()].right_ = node;
+      }
+      spine.push_back(node);
+    }
+    if (spine.empty()) {
+      return -1;
+    }
+    for (auto iter = spine.rbegin(); iter != spine.rend(); iter++) {
+      Update(*iter);
+    }
+    return spine.front();
+  }
+
+  int32_t Allocate() {
+    int32_t node;
+    if (free_.empty()) {
+      node = static_cast<int32_t>(nodes_.size());
+      nodes_.emplace_back();
+    } else {
+      node = free_.back();
+      free_.pop_back();
+      nodes_[node] = Node();
+    }
+    // xorshift32
+    seed_ ^= seed_ << 13;
+    seed_ ^= seed_ >> 17;
+    seed_ ^= seed_ << 5;
+    nodes_[node].priority_ = seed_;
+    return node;
+  }
+
+  void Free(int32_t node) {
+    std::vector<int32_t> pending;
+    if (node >= 0) {
+      pending.push_back(node);
+    }
+    while (!pending.empty()) {
+      auto &item = nodes_[pending.back()];
+      free_.push_back(pending.back());
+      pending.pop_back();
+      item.value_ = nullptr;
+      for (auto child : {item.left_, item.right_}) {
+        if (child >= 0) {
+          pending.push_back(child);
+        }
+      }
+    }
+  }
+
+  std::vector<Node> nodes_;
+  std::vector<int32_t> free_;
+  int32_t root_ = -1;
+  uint32_t seed_ = 2463534242u;
+};
+
+// Incremental LR parser in the style of Wagner/Graham. Every node of the kept
+// tree remembers the state it was pushed on (`state_`) and the number of
+// tokens it covers (`token_count_`). After an edit only the damaged tokens are
+// relexed, and untouched subtrees are shifted whole when the parser reaches
+// them in the same state they were built in.
+//
+// The text is a GapText and the tokens a TokenSequence, so finding and
+// splicing the damaged tokens costs O(log n) plus the relexed ones. The
+// reparse breaks down only the subtrees on the path to the damage, so an
+// edit costs what it relexes plus the depth of the damage in the tree, not
+// the size of the file. Lists nest as deep as they are long, so an edit in
+// the k-th element of a right recursive list walks k levels (the first k
+// for a left recursive one, from the end).
+//
+// `LexerT` must be constructible from `std::istream &` and report the byte
+// range of the last returned token through TokenBegin()/TokenEnd(). Node
+// spans (`begin_`, `end_`) are relative to the begin of the parent, those of
+// the root to the text, so a reused subtree keeps the spans inside it and
+// only its own are set when it is shifted. VisitSpans gives the offsets.
+template <class Tables, class LexerT> class IncrementalParser {
+public:
+  typedef typename Tables::Node Node;
+  typedef std::shared_ptr<Node> NodePtr;
+
+  NodePtr Parse(const std::string &text) {
+    text_ = GapText(text);
+    tokens_.Clear();
+    root_ = nullptr;
+    Relex(0, 0, 0);
+    return Reparse(0, 0, tokens_.Size());
+  }
+
+  // Replaces `erase_length` bytes at `offset` with `insertion` and reparses.
+  NodePtr Edit(size_t offset, size_t erase_length,
+               const std::string &insertion) {
+    if (offset + erase_length > text_.Size()) {
+      throw std::out_of_range("Edit out of range");
+    }
+    if (tokens_.Size() == 0) {
+      text_.Replace(offset, erase_length, insertion);
+      return Parse(text_.Str());
+    }
+
+    // The end token ends at the end of the text, so there is always one.
+    size_t damage_begin = tokens_.FirstEndingFrom(offset);
+    size_t old_damage_end = std::max(
+        damage_begin, tokens_.FirstBeginningFrom(offset + erase_length));
+    text_.Replace(offset, erase_length, insertion);
+    int64_t delta = static_cast<int64_t>(insertion.size()) -
+                    static_cast<int64_t>(erase_length);
+    size_t new_damage_end;
+    try {
+      new_damage_end = Relex(damage_begin, offset + insertion.size(),
+                             old_damage_end, delta);
+    } catch (...) {
+      tokens_.Clear();
+      root_ = nullptr;
+      throw;
+    }
+    old_damage_end = old_damage_end_;
+    return Reparse(damage_begin, old_damage_end, new_damage_end);
+  }
+
+  // Copies the text out.
+  std::string Text() const { return text_.Str(); }
+  NodePtr Root() const { return root_; }
+  // Hands the tree over and forgets the text, e.g. to free a tree too deep
+  // for the recursive destructor without recursing.
+  NodePtr Release() {
+    text_ = GapText();
+    tokens_.Clear();
+    return std::move(root_);
+  }
+  size_t TokenCount() const { return tokens_.Size(); }
+  size_t RelexedTokenCount() const { return relexed_tokens_; }
+  size_t ReusedTokenCount() const { return reused_tokens_; }
+
+private:
+  typedef TokenSequence::Token TokenRecord;
+
+  // Lexes from the end of token `damage_begin - 1` until a new token lines up
+  // with an old one at or after `resync_from` that lies past `edit_end`, then
+  // splices the fresh tokens in. Returns the end of the new damaged range.
+  size_t Relex(size_t damage_begin, size_t edit_end, size_t resync_from,
+               int64_t delta = 0) {
+    size_t start = damage_begin > 0 ? tokens_.Get(damage_begin - 1).end_ : 0;
+    GapText::Reader buf(text_, start);
+    std::istream is(&buf);
+    LexerT lexer(is);
+
+    std::vector<TokenRecord> fresh;
+    size_t old_index = resync_from;
+    while (true) {
+      auto token = Next(lexer, start);
+      TokenRecord record{static_cast<uint32_t>(token.type_), token.value_,
+                         static_cast<uint32_t>(start + lexer.TokenBegin()),
+                         static_cast<uint32_t>(start + lexer.TokenEnd())};
+      if (record.begin_ >= edit_end) {
+        // Offsets of the old tokens are still those before the edit.
+        TokenRecord old_token;
+        while (old_index < tokens_.Size()) {
+          old_token = tokens_.Get(old_index);
+          if (old_token.begin_ + delta >= record.begin_) {
+            break;
+          }
+          old_index++;
+        }
+        if (old_index < tokens_.Size() &&
+            SameToken(old_token, record, delta)) {
+          break;
+        }
+      }
+      bool is_end = record.begin_ == record.end_;
+      fresh.push_back(std::move(record));
+      if (is_end) {
+        old_index = tokens_.Size();
+        break;
+      }
+    }
+
+    old_damage_end_ = old_index;
+    relexed_tokens_ = fresh.size();
+    tokens_.Replace(damage_begin, old_index, fresh, delta);
+    return damage_begin + relexed_tokens_;
+  }
+
+  // The lexer reads from `start` on, so its errors are off by that much.
+  static auto Next(LexerT &lexer, size_t start) {
+    try {
+      return lexer.Next();
+    } catch (const ParseError &e) {
+      throw ParseError(e.what(), static_cast<uint32_t>(start + e.Offset()));
+    }
+  }
+
+  static bool SameToken(const TokenRecord &old_token,
+                        const TokenRecord &new_token, int64_t delta) {
+    return old_token.type_ == new_token.type_ &&
+           old_token.begin_ + delta == new_token.begin_ &&
+           old_token.end_ + delta == new_token.end_ &&
+           *old_token.value_ == *new_token.value_;
+  }
+
+  // Old tokens [damage_begin, old_damage_end) were replaced by new tokens
+  // [damage_begin, new_damage_end); everything else maps one to one.
+  NodePtr Reparse(size_t damage_begin, size_t old_damage_end,
+                  size_t new_damage_end) {
+    struct Pending {
+      NodePtr node_;
+      size_t begin_;
+    };
+    std::vector<Pending> pending;
+    if (root_) {
+      PushChildren(pending, root_, 0);
+    }
+    root_ = nullptr;
+    reused_tokens_ = 0;
+
+    std::vector<int32_t> state_stack;
+    std::vector<NodePtr> ast_stack;
+    int32_t current_state = 0;
+    state_stack.push_back(current_state);
+    size_t pos = 0;
+    while (true) {
+      // Reductions only look at the next terminal, which is also the first
+      // one of any subtree that could be shifted here, so they come first:
+      // a subtree only gets its state once the parser is ready to shift.
+      auto token = tokens_.Get(pos);
+      int32_t action = Tables::Action(current_state, token.type_);
+      if (action == 0) {
+        throw ParseError(
+            std::string(Tables::DEBUG_INFO_TABLE[token.type_ - 1]) +
+                " not accpeted",
+            token.begin_);
+      } else if (action < 0) {
+        uint32_t production = -action;
+        uint32_t reduce_count = Tables::reduce_length[production];
+        uint32_t new_token = Tables::reduce_result[production];
+        auto new_AST_Node = Tables::CreateNode(new_token, nullptr);
+        auto first_child = ast_stack.end() - reduce_count;
+        for (auto iter = first_child; iter != ast_stack.end(); iter++) {
+          new_AST_Node->token_count_ += (*iter)->token_count_;
+        }
+        new_AST_Node->children_.assign(std::make_move_iterator(first_child),
+                                       std::make_move_iterator(ast_stack.end()));
+        // Spans on the stack are offsets, those of children relative.
+        SpanChildren(*new_AST_Node);
+        for (const auto &child : new_AST_Node->children_) {
+          child->begin_ -= new_AST_Node->begin_;
+          child->end_ -= new_AST_Node->begin_;
+        }
+        ast_stack.erase(first_child, ast_stack.end());
+        state_stack.resize(state_stack.size() - reduce_count);
+        new_AST_Node->state_ = state_stack.back();
+        if (new_token == Tables::ACCEPT_TOKEN) {
+          root_ = new_AST_Node;
+          return root_;
+        }
+        current_state = Tables::Goto(state_stack.back(), new_token);
+        state_stack.push_back(current_state);
+        ast_stack.push_back(std::move(new_AST_Node));
+        continue;
+      }
+
+      NodePtr reuse;
+      if (pos < damage_begin || pos >= new_damage_end) {
+        size_t old_pos =
+            pos < damage_begin ? pos : pos - new_damage_end + old_damage_end;
+        while (!pending.empty()) {
+          auto top = pending.back();
+          size_t end = top.begin_ + top.node_->token_count_;
+          if (end <= old_pos) {
+            pending.pop_back();
+            continue;
+          }
+          if (Node::IsLeaf(top.node_->type_)) {
+            reuse = top.node_;
+            break;
+          }
+          bool intact = top.begin_ == old_pos &&
+                        (end < damage_begin || top.begin_ >= old_damage_end);
+          auto type = static_cast<uint32_t>(top.node_->type_);
+          if (intact && top.node_->state_ == current_state &&
+              Tables::Goto(current_state, type) > 0) {
+            reuse = top.node_;
+            break;
+          }
+          pending.pop_back();
+          PushChildren(pending, top.node_, top.begin_);
+        }
+      }
+
+      if (reuse && !Node::IsLeaf(reuse->type_)) {
+        reuse->begin_ = token.begin_;
+        reuse->end_ = tokens_.Get(pos + reuse->token_count_ - 1).begin_;
+        current_state =
+            Tables::Goto(current_state, static_cast<uint32_t>(reuse->type_));
+        state_stack.push_back(current_state);
+        pos += reuse->token_count_;
+        reused_tokens_ += reuse->token_count_;
+        ast_stack.push_back(std::move(reuse));
+        continue;
+      }
+
+      auto leaf = reuse ? reuse : Tables::CreateNode(token.type_, token.value_);
+      leaf->state_ = current_state;
+      leaf->token_count_ = 1;
+      leaf->begin_ = leaf->end_ = token.begin_;
+      ast_stack.push_back(std::move(leaf));
+      state_stack.push_back(action);
+      current_state = action;
+      pos++;
+    }
+  }
+
+  template <class PendingVec>
+  static void PushChildren(PendingVec &pending, const NodePtr &node,
+                           size_t begin) {
+    size_t end = begin + node->token_count_;
+    for (auto iter = node->children_.rbegin(); iter != node->children_.rend();
+         iter++) {
+      end -= (*iter)->token_count_;
+      pending.push_back({*iter, end});
+    }
+  }
+
+  GapText text_;
+  TokenSequence tokens_;
+  NodePtr root_;
+  size_t old_damage_end_ = 0;
+  size_t relexed_tokens_ = 0;
+  size_t reused_tokens_ = 0;
+};
+
+// Calls `visit(node, begin, end)` in preorder for every node of a tree built
+// by IncrementalParser, with its span as offsets into the text.
+template <class Node, class Visit>
+void VisitSpans(const std::shared_ptr<Node> &root, Visit &&visit) {
+  std::vector<std::pair<const Node *, uint32_t>> pending = {{root.get(), 0}};
+  while (!pending.empty()) {
+    auto [node, base] = pending.back();
+    pending.pop_back();
+    uint32_t begin = base + node->begin_;
+    visit(*node, begin, base + node->end_);
+    for (auto iter = node->children_.rbegin(); iter != node->children_.rend();
+         iter++) {
+      pending.push_back({iter->get(), begin});
+    }
+  }
+}
+} // namespace siicc
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+namespace siicc {
+// Keywords are the terminals a lexer recognizes by their exact text,
+// declared with Grammar::Keywords. The generator emits a minimal perfect
+// hash over them into the parser tables, so telling a word apart from every
+// keyword costs one hash and one memcmp however many keywords there are.
+//
+// The hash only reads the length and the bytes at the positions the
+// generator picked to tell the keywords apart: non-negative positions count
+// from the front, negative ones from the back (-1 is the last byte), and
+// positions past either end are left out. KeywordMix spreads the result
+// over the buckets and, with the seed of the bucket, over the slots.
+inline uint32_t KeywordKey(const char *text, size_t length,
+                           const int32_t *positions, size_t position_count) {
+  uint32_t key = static_cast<uint32_t>(length) * 0x9E3779B1u;
+  for (size_t i = 0; i < position_count; i++) {
+    int64_t index = positions[i] < 0
+                        ? static_cast<int64_t>(length) + positions[i]
+                        : positions[i];
+    if (index >= 0 && index < static_cast<int64_t>(length)) {
+      key = (key ^ static_cast<uint8_t>(text[index])) * 0x01000193u;
+    }
+  }
+  return key;
+}
+
+inline uint32_t KeywordMix(uint32_t key, uint32_t seed) {
+  key = (key ^ seed) * 0x85EBCA6Bu;
+  key ^= key >> 13;
+  key *= 0xC2B2AE35u;
+  return key ^ (key >> 16);
+}
+
+// The terminal id of the keyword spelled `text`, 0 if it is none.
+template <class Tables>
+inline uint32_t MatchKeyword(const char *text, size_t length) {
+  if constexpr (Tables::KEYWORD_COUNT == 0) {
+    return 0;
+  } else {
+    uint32_t key = KeywordKey(text, length, Tables::keyword_position,
+                              Tables::KEYWORD_POSITION_COUNT);
+    uint32_t bucket = KeywordMix(key, 0) % Tables::KEYWORD_BUCKET_COUNT;
+    uint32_t slot =
+        KeywordMix(key, Tables::keyword_seed[bucket]) % Tables::KEYWORD_COUNT;
+    if (Tables::keyword_length[slot] != length ||
+        std::memcmp(Tables::keyword_text[slot], text, length) != 0) {
+      return 0;
+    }
+    return Tables::keyword_id[slot];
+  }
+}
+} // namespace siicc
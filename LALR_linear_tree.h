@@ -0,0 +1,208 @@
+#pragma once
+
+#include "LALR_runtime.h"
+#include <array>
+#include <string_view>
+
+namespace siicc {
+template <class Tables> class LinearParser;
+
+// A parse tree as parallel arrays in postorder, the order an LR parser
+// reduces in, so building it only appends. The subtree of node i is the
+// nodes [i - SubtreeSize(i) + 1, i]: its last child is i - 1, the sibling
+// before a child c is c - SubtreeSize(c), and FirstChild(i) ends that walk.
+// Walks touch a few dense arrays instead of chasing ASTNode pointers.
+template <class Tables> class LinearTree {
+public:
+  static constexpr uint32_t NONE = UINT32_MAX;
+
+  uint32_t Size() const { return type_.size(); }
+  uint32_t Root() const { return Size() - 1; }
+
+  uint32_t Type(uint32_t node) const { return type_[node]; }
+  bool IsLeaf(uint32_t node) const { return first_child_[node] == NONE; }
+  // NONE for leaves.
+  uint32_t FirstChild(uint32_t node) const { return first_child_[node]; }
+  uint32_t SubtreeSize(uint32_t node) const { return size_[node]; }
+  // Byte offsets of the first and the last token, as ASTNode::begin_ and
+  // end_.
+  uint32_t Begin(uint32_t node) const { return begin_[node]; }
+  uint32_t End(uint32_t node) const { return end_[node]; }
+  // The token text of a leaf, empty for inner nodes.
+  std::string_view Value(uint32_t node) const {
+    return std::string_view(pool_).substr(
+        value_begin_[node], value_begin_[node + 1] - value_begin_[node]);
+  }
+
+  // Every node of the subtree under `root` after its children: a plain scan
+  // over the arrays.
+  class PostorderCursor {
+  public:
+    PostorderCursor(const LinearTree &tree, uint32_t root)
+        : next_(root + 1 - tree.size_[root]), end_(root + 1) {}
+    bool Next(uint32_t &node) {
+      if (next_ == end_) {
+        return false;
+      }
+      node = next_++;
+      return true;
+    }
+
+  private:
+    uint32_t next_;
+    uint32_t end_;
+  };
+
+  // Every node of the subtree under `root` before its children, children
+  // left to right. SkipSubtree() leaves out the descendants of the node
+  // returned last.
+  class PreorderCursor {
+  public:
+    PreorderCursor(const LinearTree &tree, uint32_t root)
+        : tree_(tree), pending_({root}) {}
+    bool Next(uint32_t &node) {
+      if (last_ != NONE && !tree_.IsLeaf(last_)) {
+        // Pushed last to first, so the first child is on top.
+        for (uint32_t child = last_ - 1;; child -= tree_.size_[child]) {
+          pending_.push_back(child);
+          if (child == tree_.first_child_[last_]) {
+            break;
+          }
+        }
+      }
+      if (pending_.empty()) {
+        last_ = NONE;
+        return false;
+      }
+      node = last_ = pending_.back();
+      pending_.pop_back();
+      return true;
+    }
+    void SkipSubtree() { last_ = NONE; }
+
+  private:
+    const LinearTree &tree_;
+    std::vector<uint32_t> pending_;
+    uint32_t last_ = NONE;
+  };
+
+  // The children of `node` left to right. A node has at most
+  // MAX_REDUCE_LENGTH of them, found by walking back from the last.
+  class ChildCursor {
+  public:
+    ChildCursor(const LinearTree &tree, uint32_t node) {
+      if (tree.IsLeaf(node)) {
+        return;
+      }
+      for (uint32_t child = node - 1;; child -= tree.size_[child]) {
+        children_[count_++] = child;
+        if (child == tree.first_child_[node]) {
+          break;
+        }
+      }
+    }
+    bool Next(uint32_t &child) {
+      if (count_ == 0) {
+        return false;
+      }
+      child = children_[--count_];
+      return true;
+    }
+
+  private:
+    std::array<uint32_t, Tables::MAX_REDUCE_LENGTH> children_;
+    uint32_t count_ = 0;
+  };
+
+private:
+  friend class LinearParser<Tables>;
+
+  void Reserve(size_t nodes) {
+    for (auto *column : {&type_, &first_child_, &size_, &begin_, &end_}) {
+      column->reserve(nodes);
+    }
+    value_begin_.reserve(nodes + 1);
+  }
+
+  template <class Token> uint32_t AddLeaf(uint32_t type, const Token &token) {
+    type_.push_back(type);
+    first_child_.push_back(NONE);
+    size_.push_back(1);
+    begin_.push_back(token.offset_);
+    end_.push_back(token.offset_);
+    if (token.value_) {
+      pool_.append(*token.value_);
+    }
+    value_begin_.push_back(pool_.size());
+    return Root();
+  }
+
+  // The children run from `first_child` to the current root; productions
+  // are never empty.
+  uint32_t AddNode(uint32_t type, uint32_t first_child) {
+    uint32_t last_child = Root();
+    uint32_t start = first_child + 1 - size_[first_child];
+    type_.push_back(type);
+    first_child_.push_back(first_child);
+    size_.push_back(last_child + 2 - start);
+    begin_.push_back(begin_[first_child]);
+    end_.push_back(end_[last_child]);
+    value_begin_.push_back(pool_.size());
+    return Root();
+  }
+
+  std::vector<uint32_t> type_;
+  std::vector<uint32_t> first_child_;
+  std::vector<uint32_t> size_;
+  std::vector<uint32_t> begin_;
+  std::vector<uint32_t> end_;
+  // Value of node i is pool_[value_begin_[i], value_begin_[i + 1]).
+  std::vector<uint32_t> value_begin_ = {0};
+  std::string pool_;
+};
+
+// LRParser building a LinearTree instead of ASTNodes. Errors are thrown as
+// by LRParser::Parse; there is no recovering variant.
+template <class Tables> class LinearParser {
+public:
+  typedef typename Tables::LexerType LexerType;
+  typedef LinearTree<Tables> Tree;
+
+  // `expected_nodes` presizes the arrays.
+  static Tree Parse(std::shared_ptr<LexerType> lexer,
+                    size_t expected_nodes = 0) {
+    Tree tree;
+    tree.Reserve(expected_nodes);
+    std::vector<int32_t> state_stack = {0};
+    std::vector<uint32_t> node_stack;
+    auto next_token = lexer->Next();
+    uint32_t next_id = static_cast<uint32_t>(next_token.type_);
+    while (true) {
+      int32_t current_state = state_stack.back();
+      int32_t action = Tables::Action(current_state, next_id);
+      if (action == 0) {
+        throw ParseError(std::string(Tables::DEBUG_INFO_TABLE[next_id - 1]) +
+                             " not accpeted",
+                         next_token.offset_);
+      } else if (action > 0) {
+        node_stack.push_back(tree.AddLeaf(next_id, next_token));
+        state_stack.push_back(action);
+        next_token = lexer->Next();
+        next_id = static_cast<uint32_t>(next_token.type_);
+      } else {
+        uint32_t reduce_count = Tables::reduce_length[-action];
+        uint32_t new_token = Tables::reduce_result[-action];
+        uint32_t node = tree.AddNode(
+            new_token, node_stack[node_stack.size() - reduce_count]);
+        if (new_token == Tables::ACCEPT_TOKEN) {
+          return tree;
+        }
+        node_stack.resize(node_stack.size() - reduce_count);
+        state_stack.resize(state_stack.size() - reduce_count);
+        state_stack.push_back(Tables::Goto(state_stack.back(), new_token));
+        node_stack.push_back(node);
+      }
+    }
+  }
+};
+} // namespace siicc
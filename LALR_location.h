@@ -0,0 +1,98 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace siicc {
+// 1-based line and column, the column counted in bytes.
+struct SourceLocation {
+  uint32_t line_;
+  uint32_t column_;
+
+  std::string to_string() const {
+    return std::to_string(line_) + ":" + std::to_string(column_);
+  }
+};
+
+// Maps the byte offsets kept by tokens and nodes (Token::offset_,
+// ASTNode::begin_ and end_, ParseError::Offset()) to lines and columns. The
+// line starts are only collected on the first lookup, so parsing never pays
+// for them. `text` has to outlive the index; offsets are 32 bit, so inputs
+// are limited to 4 GB. Not thread safe.
+class LineIndex {
+public:
+  explicit LineIndex(std::string_view text) : text_(text) {}
+
+  SourceLocation Locate(uint32_t offset) {
+    Build();
+    offset = std::min<uint32_t>(offset, text_.size());
+    uint32_t line = std::upper_bound(line_starts_.begin(), line_starts_.end(),
+                                     offset) -
+                    line_starts_.begin();
+    return {line, offset - line_starts_[line - 1] + 1};
+  }
+
+  // The text of line `line` without its line break.
+  std::string_view Line(uint32_t line) {
+    Build();
+    if (line == 0 || line > line_starts_.size()) {
+      return {};
+    }
+    size_t begin = line_starts_[line - 1];
+    size_t end = line < line_starts_.size() ? line_starts_[line] - 1
+                                            : text_.size();
+    if (end > begin && text_[end - 1] == '\r') {
+      end--;
+    }
+    return text_.substr(begin, end - begin);
+  }
+
+  size_t LineCount() {
+    Build();
+    return line_starts_.size();
+  }
+
+private:
+  void Build() {
+    if (!line_starts_.empty()) {
+      return;
+    }
+    line_starts_.push_back(0);
+    const char *data = text_.data();
+    size_t size = text_.size();
+    size_t i = 0;
+#if defined(__SSE2__)
+    // 16 bytes per step: compare against '\n' and walk the set bits of the
+    // match mask.
+    const __m128i newline = _mm_set1_epi8('\n');
+    for (; i + 16 <= size; i += 16) {
+      auto block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+      uint32_t mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, newline));
+      while (mask != 0) {
+        line_starts_.push_back(i + __builtin_ctz(mask) + 1);
+        mask &= mask - 1;
+      }
+    }
+#endif
+    while (i < size) {
+      auto found = static_cast<const char *>(
+          std::memchr(data + i, '\n', size - i));
+      if (found == nullptr) {
+        break;
+      }
+      i = found - data + 1;
+      line_starts_.push_back(i);
+    }
+  }
+
+  std::string_view text_;
+  std::vector<uint32_t> line_starts_;
+};
+} // namespace siicc
@@ -1,49 +1,11 @@
 #include "siicc_EBNF.h"
-#include "LALR_EBNF_lexer.h"
-#include "LALR_parser_generator.h"
-#include "LALR_table_generator.h"
+#include "LALR_grammar_loader.h"
+#include "LALR_location.h"
+#include <fstream>
+#include <iostream>
 
-class EBNFGrammarParserGenerator {
-public:
-    EBNFGrammarParserGenerator(siicc::ASTNodePtr root) : root_(root)  {}
-    
-    void generate();
-
-private:
-    void Visit(siicc::ASTNodePtr node) {        
-        for (const auto& child : node->children_) {
-            if (child->type_ == siicc::ASTNode::Type::NODE_START) {
-                throw std::invalid_argument("Error node start");
-            } else if (child->type_ == siicc::ASTNode::Type::LEAF_Blank) {
-                throw std::invalid_argument("Error node Blank");                
-            } 
-            if (child->type_ == siicc::ASTNode::Type::NODE_Production) {
-                CreateGrammarFromProduction(child);
-                return;
-            } 
-            Visit(child);
-        }
-    }
-    
-    siicc::LALR::TokenPtr GetTerminator(const std::string& name) {
-        //
-        throw "Not impl yet.";
-    }
-    
-    void CreateGrammarFromProduction(siicc::ASTNodePtr production_node) {
-        if (production_node->children_.at(0)->type_ != siicc::ASTNode::Type::LEAF_nonterminator) {
-            throw std::invalid_argument("First child of production is not nonterminator.");
-        }
-    }
-
-    siicc::ASTNodePtr root_;
-    siicc::LALR::GrammarPtr grammar_;
-    siicc::LALR::TokenPtrSet terminators_;
-    siicc::LALR::TokenPtrSet nonterminators_;
-    siicc::LALR::ProductionPtrVec productions_;
-    siicc::LALR::TokenPtr blank_;
-    siicc::LALR::TokenPtr start_;
-};
+// Loads every grammar file and prints its productions; BNF_driver_gen
+// generates parsers from them.
 
 int main(int argc, char**argv) {
     if (argc <= 1) {
@@ -51,7 +13,20 @@ int main(int argc, char**argv) {
     }
     for (int i = 1; i < argc; i++) {
         std::ifstream is(argv[i]);
-        auto lexer = std::make_shared<siicc::BNFLexer>(is);
-        auto result = Parse(lexer);
+        try {
+            auto grammar = siicc::LALR::LoadEBNFGrammar(is);
+            std::cout << grammar.to_string();
+        } catch (const siicc::ParseError& error) {
+            // The file is only read again to place the error.
+            std::ifstream file(argv[i]);
+            std::string text((std::istreambuf_iterator<char>(file)),
+                             std::istreambuf_iterator<char>());
+            siicc::LineIndex index(text);
+            auto location = index.Locate(error.Offset());
+            std::cerr << argv[i] << ":" << location.to_string() << ": "
+                      << error.what() << "\n"
+                      << index.Line(location.line_) << "\n";
+            return 1;
+        }
     }
 }
\ No newline at end of file
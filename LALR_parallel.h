@@ -0,0 +1,258 @@
+#pragma once
+
+#include "LALR_runtime.h"
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+namespace siicc {
+struct ParallelOptions {
+  // Threads parsing chunks, the calling thread included. 0 uses one per
+  // hardware thread.
+  uint32_t threads_ = 0;
+  // A chunk is closed at the first sync token after this many tokens.
+  size_t chunk_tokens_ = 1 << 16;
+};
+
+// Parses one input on several threads. When the generator found the input
+// to be a list of units (Tables::SYNC_LIST) and terminals that always end a
+// unit (Tables::is_sync_token), the parser is back in its start state after
+// each of them. The calling thread lexes and cuts the token stream at sync
+// tokens into chunks, every chunk is parsed on its own by an LRParser, and
+// the list chains of the chunks are linked into the tree the serial parser
+// builds. Errors are those of the serial parser: the first chunk in input
+// order that failed throws.
+//
+// Lexing stays on the calling thread, which also parses chunks when it runs
+// ahead of the others. Only the throwing Parse of LR tables is covered,
+// grammars without a list fall back to LRParser::Parse, and profiling
+// (SIICC_PARSE_PROFILE) is not supported.
+template <class Tables> class ParallelParser {
+public:
+  typedef LRParser<Tables> Serial;
+  typedef typename Serial::Node Node;
+  typedef typename Serial::NodePtr NodePtr;
+  typedef typename Serial::LexerType LexerType;
+  typedef typename Serial::Token Token;
+
+  static NodePtr Parse(std::shared_ptr<LexerType> lexer,
+                       const ParallelOptions &options = ParallelOptions()) {
+    uint32_t threads = options.threads_;
+    if (threads == 0) {
+      threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    if constexpr (Tables::SYNC_LIST == 0) {
+      return Serial::Parse(lexer);
+    } else {
+      if (threads == 1) {
+        return Serial::Parse(lexer);
+      }
+      return Run(*lexer, threads, std::max<size_t>(1, options.chunk_tokens_));
+    }
+  }
+
+private:
+  struct Chunk {
+    std::vector<Token> tokens_;
+    // Thrown by the lexer right after the last token, parsed as such.
+    std::exception_ptr lex_error_;
+    std::exception_ptr error_;
+    NodePtr root_;
+    // The list node, the node above it, and the end of its chain a
+    // neighbour is linked to: the last list node for right recursion, the
+    // first for left recursion.
+    NodePtr list_;
+    NodePtr holder_;
+    NodePtr link_;
+  };
+
+  class ChunkLexer : public LexerType {
+  public:
+    explicit ChunkLexer(Chunk &chunk) : chunk_(chunk) {}
+    Token Next() override {
+      if (next_ < chunk_.tokens_.size()) {
+        return std::move(chunk_.tokens_[next_++]);
+      }
+      if (chunk_.lex_error_) {
+        std::rethrow_exception(chunk_.lex_error_);
+      }
+      return Token(static_cast<decltype(Token::type_)>(Tables::END_TOKEN), "");
+    }
+
+  private:
+    Chunk &chunk_;
+    size_t next_ = 0;
+  };
+
+  class Queue {
+  public:
+    void Push(Chunk *chunk) {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_.push_back(chunk);
+      }
+      ready_.notify_one();
+    }
+    void Close() {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+      }
+      ready_.notify_all();
+    }
+    // Waits for a chunk, null once the queue is closed and empty.
+    Chunk *Pop() {
+      std::unique_lock<std::mutex> lock(mutex_);
+      ready_.wait(lock, [this] { return closed_ || !pending_.empty(); });
+      return TakeLocked();
+    }
+    Chunk *TryPop() {
+      std::lock_guard<std::mutex> lock(mutex_);
+      return TakeLocked();
+    }
+    size_t Size() {
+      std::lock_guard<std::mutex> lock(mutex_);
+      return pending_.size();
+    }
+
+  private:
+    Chunk *TakeLocked() {
+      if (pending_.empty()) {
+        return nullptr;
+      }
+      auto chunk = pending_.front();
+      pending_.pop_front();
+      return chunk;
+    }
+
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::deque<Chunk *> pending_;
+    bool closed_ = false;
+  };
+
+  static NodePtr Run(LexerType &lexer, uint32_t threads, size_t chunk_tokens) {
+    static_assert(!Serial::PROFILE,
+                  "SIICC_PARSE_PROFILE counters are not thread safe");
+    std::vector<std::unique_ptr<Chunk>> chunks;
+    Queue queue;
+    std::vector<std::thread> workers;
+    for (uint32_t i = 1; i < threads; i++) {
+      workers.emplace_back([&queue] {
+        while (auto chunk = queue.Pop()) {
+          ParseChunk(*chunk);
+        }
+      });
+    }
+
+    auto chunk = std::make_unique<Chunk>();
+    auto close_chunk = [&]() {
+      queue.Push(chunk.get());
+      chunks.push_back(std::move(chunk));
+      chunk = std::make_unique<Chunk>();
+      // Parse here rather than let unparsed tokens pile up.
+      while (queue.Size() > 2 * threads) {
+        if (auto pending = queue.TryPop()) {
+          ParseChunk(*pending);
+        }
+      }
+    };
+    while (true) {
+      try {
+        auto token = lexer.Next();
+        uint32_t id = static_cast<uint32_t>(token.type_);
+        if (id == Tables::END_TOKEN) {
+          break;
+        }
+        chunk->tokens_.push_back(std::move(token));
+        if (chunk->tokens_.size() >= chunk_tokens &&
+            Tables::is_sync_token[id]) {
+          close_chunk();
+        }
+      } catch (...) {
+        chunk->lex_error_ = std::current_exception();
+        break;
+      }
+    }
+    if (!chunk->tokens_.empty() || chunk->lex_error_ || chunks.empty()) {
+      close_chunk();
+    }
+    queue.Close();
+    while (auto pending = queue.Pop()) {
+      ParseChunk(*pending);
+    }
+    for (auto &worker : workers) {
+      worker.join();
+    }
+
+    for (const auto &chunk : chunks) {
+      if (chunk->error_) {
+        std::rethrow_exception(chunk->error_);
+      }
+    }
+    auto &first = *chunks.front();
+    uint32_t begin = first.list_->begin_;
+    uint32_t end = chunks.back()->list_->end_;
+    if constexpr (Tables::SYNC_LEFT_RECURSIVE) {
+      auto list = first.list_;
+      for (size_t i = 1; i < chunks.size(); i++) {
+        auto &link = chunks[i]->link_->children_;
+        link.insert(link.begin(), std::move(list));
+        list = chunks[i]->list_;
+      }
+      first.holder_->children_[0] = std::move(list);
+    } else {
+      for (size_t i = 1; i < chunks.size(); i++) {
+        chunks[i - 1]->link_->children_.push_back(chunks[i]->list_);
+      }
+    }
+    // The spans of the list nodes above a seam still stop at their chunk.
+    if (chunks.size() > 1) {
+      size_t next = Tables::SYNC_LEFT_RECURSIVE ? 0 : 1;
+      for (const auto &chunk : chunks) {
+        auto node = chunk->list_.get();
+        while (true) {
+          if constexpr (Tables::SYNC_LEFT_RECURSIVE) {
+            node->begin_ = begin;
+          } else {
+            node->end_ = end;
+          }
+          if (node == chunk->link_.get()) {
+            break;
+          }
+          node = node->children_[next].get();
+        }
+      }
+      for (auto node = first.root_.get();; node = node->children_[0].get()) {
+        node->end_ = end;
+        if (node == first.holder_.get()) {
+          break;
+        }
+      }
+    }
+    return first.root_;
+  }
+
+  static void ParseChunk(Chunk &chunk) {
+    try {
+      chunk.root_ = Serial::Parse(std::make_shared<ChunkLexer>(chunk));
+      std::vector<Token>().swap(chunk.tokens_);
+      chunk.holder_ = chunk.root_;
+      while (static_cast<uint32_t>(chunk.holder_->children_[0]->type_) !=
+             Tables::SYNC_LIST) {
+        chunk.holder_ = chunk.holder_->children_[0];
+      }
+      chunk.list_ = chunk.holder_->children_[0];
+      size_t next = Tables::SYNC_LEFT_RECURSIVE ? 0 : 1;
+      chunk.link_ = chunk.list_;
+      while (chunk.link_->children_.size() == 2) {
+        chunk.link_ = chunk.link_->children_[next];
+      }
+    } catch (...) {
+      chunk.error_ = std::current_exception();
+    }
+  }
+};
+} // namespace siicc
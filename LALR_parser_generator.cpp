@@ -1,8 +1,77 @@
 #include "LALR_parser_generator.h"
-#include <iomanip>
+#include "LALR_keywords.h"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
 
 namespace siicc {
 namespace LALR {
+// Collects emitted text and hands it to the stream in large blocks. Numbers
+// are formatted with std::to_chars instead of the stream's locale aware
+// formatting, which dominated emitting large tables.
+class OutputBuffer {
+public:
+  explicit OutputBuffer(std::ostream &os) : os_(os) {}
+  ~OutputBuffer() { Flush(); }
+
+  OutputBuffer &operator<<(std::string_view text) {
+    buffer_.append(text);
+    return MaybeFlush();
+  }
+  OutputBuffer &operator<<(char ch) {
+    buffer_.push_back(ch);
+    return MaybeFlush();
+  }
+  template <class T, std::enable_if_t<std::is_integral_v<T>, int> = 0>
+  OutputBuffer &operator<<(T value) {
+    return Number(value, 0);
+  }
+  // Right aligned in `width` columns, as with std::setw.
+  template <class T> OutputBuffer &Number(T value, size_t width) {
+    char digits[24];
+    char *end;
+    if constexpr (std::is_same_v<T, bool>) {
+      end = std::to_chars(digits, digits + sizeof(digits),
+                          static_cast<int>(value))
+                .ptr;
+    } else {
+      end = std::to_chars(digits, digits + sizeof(digits), value).ptr;
+    }
+    size_t length = end - digits;
+    if (length < width) {
+      buffer_.append(width - length, ' ');
+    }
+    buffer_.append(digits, length);
+    return MaybeFlush();
+  }
+
+  void Flush() {
+    os_.write(buffer_.data(), buffer_.size());
+    buffer_.clear();
+  }
+
+private:
+  static constexpr size_t FLUSH_SIZE = 1 << 16;
+
+  OutputBuffer &MaybeFlush() {
+    if (buffer_.size() >= FLUSH_SIZE) {
+      Flush();
+    }
+    return *this;
+  }
+
+  std::ostream &os_;
+  std::string buffer_;
+};
+
 class PrintHelper {
 public:
   PrintHelper(uint8_t default_indent = 2)
@@ -12,13 +81,13 @@ public:
   void Indent(uint32_t count) { indent_ += count; }
   void Deindent(uint32_t count) { indent_ -= count; }
   void Deindent() { indent_ -= default_indent_; }
-  std::ostream &operator<<(std::ostream &os) {
+  OutputBuffer &operator<<(OutputBuffer &os) {
     PrintIndent(os);
     return os;
   }
 
 private:
-  void PrintIndent(std::ostream &os) {
+  void PrintIndent(OutputBuffer &os) {
     for (int i = 0; i < indent_; i++) {
       os << " ";
     }
@@ -31,8 +100,17 @@ private:
 LALRParserGenerator::LALRParserGenerator(ActionType &&action,
                                          ReduceType &&reduce,
                                          std::vector<ClosurePtr> &&closures,
-                                         GrammarPtr grammar)
-    : action_(action), reduce_(reduce), closures_(closures), grammar_(grammar) {
+                                         GrammarPtr grammar,
+                                         ParserGeneratorOptions options,
+                                         ConflictType &&conflicts)
+    : action_(action), reduce_(reduce), closures_(closures), grammar_(grammar),
+      options_(options), conflicts_(conflicts) {
+  original_state_count_ = closures_.size();
+  auto stats = options_.stats_;
+  if (options_.merge_states_) {
+    PhaseTimer timer(stats, "merge states");
+    MergeEquivalentStates();
+  }
   uint32_t idx = 0;
   for (auto &token : grammar_->terminators_) {
     token->id_ = ++idx;
@@ -41,16 +119,703 @@ LALRParserGenerator::LALRParserGenerator(ActionType &&action,
     token->id_ = ++idx;
   }
   idx = 0;
-  for (auto &closure : closures) {
+  for (auto &closure : closures_) {
     closure->id_ = idx++;
   }
   idx = 0;
   for (auto &production : grammar_->productions_) {
     production->id_ = ++idx;
   }
+  if (options_.profile_) {
+    ReorderStatesByProfile();
+  }
+  {
+    PhaseTimer timer(stats, "tables");
+    BuildTables();
+    BuildConflictCells();
+  }
+  if (options_.default_reductions_) {
+    PhaseTimer timer(stats, "default reductions");
+    BuildDefaultReductions();
+  }
+  if (options_.terminal_classes_) {
+    PhaseTimer timer(stats, "terminal classes");
+    BuildTerminalClasses();
+  }
+  if (options_.share_rows_) {
+    PhaseTimer timer(stats, "share rows");
+    ShareRows();
+  }
+  FindSyncTokens();
+  {
+    PhaseTimer timer(stats, "keyword hash");
+    BuildKeywordHash();
+  }
+  if (!options_.blob_path_.empty()) {
+    BuildBlob();
+  }
+}
+
+// Partition refinement as in DFA minimization: start from blocks of states
+// with the same reduce entries, conflicts and transition symbols, then split
+// blocks until all members move to the same blocks on every symbol.
+void LALRParserGenerator::MergeEquivalentStates() {
+  std::map<ClosurePtr, size_t> index_of;
+  for (size_t i = 0; i < closures_.size(); i++) {
+    index_of[closures_[i]] = i;
+  }
+  typedef std::vector<std::pair<Token *, size_t>> Signature;
+  std::vector<size_t> block(closures_.size());
+  {
+    std::map<std::tuple<Signature, std::vector<Token *>, Signature>, size_t>
+        block_of;
+    for (size_t i = 0; i < closures_.size(); i++) {
+      std::tuple<Signature, std::vector<Token *>, Signature> key;
+      for (const auto &[token, production] : reduce_[closures_[i]]) {
+        std::get<0>(key).emplace_back(token.get(),
+                                      production ? production->id_ : 0);
+      }
+      for (const auto &[token, next] : action_[i]) {
+        std::get<1>(key).push_back(token.get());
+      }
+      auto conflicts = conflicts_.find(closures_[i]);
+      if (conflicts != conflicts_.end()) {
+        for (const auto &[token, productions] : conflicts->second) {
+          for (const auto &production : productions) {
+            std::get<2>(key).emplace_back(token.get(), production->id_);
+          }
+        }
+      }
+      block[i] = block_of.emplace(key, block_of.size()).first->second;
+    }
+  }
+  size_t block_count = 0;
+  while (true) {
+    std::map<std::pair<size_t, Signature>, size_t> block_of;
+    std::vector<size_t> new_block(closures_.size());
+    for (size_t i = 0; i < closures_.size(); i++) {
+      std::pair<size_t, Signature> key;
+      key.first = block[i];
+      for (const auto &[token, next] : action_[i]) {
+        key.second.emplace_back(token.get(), block[index_of[next]]);
+      }
+      new_block[i] = block_of.emplace(key, block_of.size()).first->second;
+    }
+    block = std::move(new_block);
+    if (block_of.size() == block_count) {
+      break;
+    }
+    block_count = block_of.size();
+  }
+  if (block_count == closures_.size()) {
+    return;
+  }
+
+  std::vector<ClosurePtr> representative(block_count);
+  std::vector<ClosurePtr> closures;
+  ActionType action;
+  for (size_t i = 0; i < closures_.size(); i++) {
+    if (!representative[block[i]]) {
+      representative[block[i]] = closures_[i];
+      closures.push_back(closures_[i]);
+      action.push_back(std::move(action_[i]));
+    } else {
+      reduce_.erase(closures_[i]);
+      conflicts_.erase(closures_[i]);
+    }
+  }
+  for (auto &edges : action) {
+    for (auto &[token, next] : edges) {
+      next = representative[block[index_of[next]]];
+    }
+  }
+  closures_ = std::move(closures);
+  action_ = std::move(action);
+}
+
+void LALRParserGenerator::ReorderStatesByProfile() {
+  const auto &profile = *options_.profile_;
+  if (profile.state_count_ != closures_.size() ||
+      profile.terminal_count_ != grammar_->terminators_.size() ||
+      profile.production_count_ != grammar_->productions_.size()) {
+    throw std::invalid_argument("Profile does not match the grammar");
+  }
+  // States are numbered by position here, so the order sorts action_ too.
+  std::vector<uint32_t> order(closures_.size());
+  for (uint32_t i = 0; i < order.size(); i++) {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin() + 1, order.end(),
+                   [&](uint32_t lhs, uint32_t rhs) {
+                     return profile.visits_[lhs] > profile.visits_[rhs];
+                   });
+  std::vector<ClosurePtr> closures;
+  ActionType action;
+  for (auto i : order) {
+    closures.push_back(closures_[i]);
+    action.push_back(std::move(action_[i]));
+  }
+  closures_ = std::move(closures);
+  action_ = std::move(action);
+  uint32_t idx = 0;
+  for (auto &closure : closures_) {
+    closure->id_ = idx++;
+  }
+}
+
+RecordedProfile LoadParseProfile(std::istream &is) {
+  std::string magic;
+  uint32_t version = 0;
+  is >> magic >> version;
+  if (magic != "siicc-profile" || version != 1) {
+    throw std::invalid_argument("Not a siicc profile");
+  }
+  RecordedProfile profile;
+  std::string key;
+  while (is >> key) {
+    if (key == "states") {
+      is >> profile.state_count_ >> key >> profile.production_count_ >> key >>
+          profile.terminal_count_;
+      profile.visits_.assign(profile.state_count_, 0);
+      profile.terminals_.assign(profile.terminal_count_ + 1, 0);
+    } else if (key == "visit" || key == "terminal") {
+      auto &counts = key == "visit" ? profile.visits_ : profile.terminals_;
+      uint64_t index = 0, count = 0;
+      is >> index >> count;
+      if (index >= counts.size()) {
+        throw std::invalid_argument("Profile entry out of range: " + key);
+      }
+      counts[index] = count;
+    } else {
+      std::string rest;
+      std::getline(is, rest);
+    }
+    if (!is) {
+      throw std::invalid_argument("Malformed profile near " + key);
+    }
+  }
+  return profile;
+}
+
+void LALRParserGenerator::BuildTables() {
+  reduce_result_.assign(grammar_->productions_.size() + 1, 0);
+  reduce_length_.assign(grammar_->productions_.size() + 1, 0);
+  for (const auto &production : grammar_->productions_) {
+    reduce_result_[production->id_] = production->head_->id_;
+    reduce_length_[production->id_] = production->body_.size();
+  }
+  for (const auto &closure : closures_) {
+    action_table_.emplace_back(
+        grammar_->terminators_.size() + grammar_->nonterminators_.size() + 1,
+        0);
+    const auto &edges = action_[closure->id_];
+    const auto &reduce = reduce_[closure];
+    for (const auto &terminator : grammar_->terminators_) {
+      auto reduce_iter = reduce.find(terminator);
+      if (reduce_iter != reduce.end()) {
+        if (reduce_iter->second) {
+          action_table_[closure->id_][terminator->id_] =
+              -1 * reduce_iter->second->id_;
+        }
+      } else if (auto edge = FindEdge(edges, terminator)) {
+        action_table_[closure->id_][terminator->id_] = edge->next_->id_;
+      }
+    }
+    for (const auto &nonterminator : grammar_->nonterminators_) {
+      if (auto edge = FindEdge(edges, nonterminator)) {
+        action_table_[closure->id_][nonterminator->id_] = edge->next_->id_;
+      }
+    }
+  }
+}
+
+void LALRParserGenerator::BuildConflictCells() {
+  std::vector<std::pair<uint32_t, std::vector<uint32_t>>> cells;
+  for (const auto &[closure, conflicts] : conflicts_) {
+    for (const auto &[token, productions] : conflicts) {
+      std::vector<uint32_t> reduces;
+      for (const auto &production : productions) {
+        reduces.push_back(production->id_);
+      }
+      cells.emplace_back(closure->id_ * (grammar_->terminators_.size() + 1) +
+                             token->id_,
+                         std::move(reduces));
+    }
+  }
+  std::sort(cells.begin(), cells.end());
+  conflict_cell_.clear();
+  conflict_begin_ = {0};
+  conflict_reduce_.clear();
+  for (const auto &[cell, reduces] : cells) {
+    conflict_cell_.push_back(cell);
+    conflict_reduce_.insert(conflict_reduce_.end(), reduces.begin(),
+                            reduces.end());
+    conflict_begin_.push_back(conflict_reduce_.size());
+  }
+}
+
+void LALRParserGenerator::BuildDefaultReductions() {
+  uint32_t terminator_count = grammar_->terminators_.size();
+  default_reduce_.assign(action_table_.size(), 0);
+  for (size_t state = 0; state < action_table_.size(); state++) {
+    // A GLR state has to see the lookahead to find its conflict cells.
+    if (conflicts_.count(closures_[state])) {
+      continue;
+    }
+    auto &row = action_table_[state];
+    int32_t reduce = 0;
+    bool consistent = true;
+    for (uint32_t id = 1; id <= terminator_count && consistent; id++) {
+      if (row[id] > 0 || (row[id] < 0 && reduce != 0 && row[id] != reduce)) {
+        consistent = false;
+      } else if (row[id] < 0) {
+        reduce = row[id];
+      }
+    }
+    // The accept reduction must see the end token, otherwise trailing input
+    // would be silently dropped.
+    if (!consistent || reduce == 0 ||
+        reduce_result_[-reduce] == grammar_->start_->id_) {
+      continue;
+    }
+    default_reduce_[state] = reduce;
+    std::fill(row.begin(), row.begin() + terminator_count + 1, 0);
+  }
+}
+
+// Partitions terminal ids (including the unused id 0) by identical action
+// columns and rewrites action_table_ to one column per class followed by the
+// nonterminal columns.
+void LALRParserGenerator::BuildTerminalClasses() {
+  uint32_t terminator_count = grammar_->terminators_.size();
+  std::map<std::vector<int32_t>, uint32_t> class_of_column;
+  terminal_class_.assign(terminator_count + 1, 0);
+  std::vector<uint32_t> representative;
+  for (uint32_t id = 0; id <= terminator_count; id++) {
+    std::vector<int32_t> column;
+    column.reserve(action_table_.size());
+    for (const auto &row : action_table_) {
+      column.push_back(row[id]);
+    }
+    auto iter = class_of_column.emplace(std::move(column),
+                                        class_of_column.size());
+    if (iter.second) {
+      representative.push_back(id);
+    }
+    terminal_class_[id] = iter.first->second;
+  }
+  class_count_ = representative.size();
+  if (options_.profile_) {
+    std::vector<uint64_t> hotness(class_count_, 0);
+    for (uint32_t id = 1; id <= terminator_count; id++) {
+      hotness[terminal_class_[id]] += options_.profile_->terminals_[id];
+    }
+    std::vector<uint32_t> order(class_count_);
+    for (uint32_t i = 0; i < class_count_; i++) {
+      order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t lhs, uint32_t rhs) {
+      return hotness[lhs] > hotness[rhs];
+    });
+    std::vector<uint32_t> new_class(class_count_);
+    std::vector<uint32_t> new_representative(class_count_);
+    for (uint32_t i = 0; i < class_count_; i++) {
+      new_class[order[i]] = i;
+      new_representative[i] = representative[order[i]];
+    }
+    for (auto &terminal_class : terminal_class_) {
+      terminal_class = new_class[terminal_class];
+    }
+    representative = std::move(new_representative);
+  }
+  for (auto &row : action_table_) {
+    std::vector<int32_t> packed_row;
+    packed_row.reserve(class_count_ + row.size() - terminator_count - 1);
+    for (auto id : representative) {
+      packed_row.push_back(row[id]);
+    }
+    packed_row.insert(packed_row.end(), row.begin() + terminator_count + 1,
+                      row.end());
+    row = std::move(packed_row);
+  }
+}
+
+void LALRParserGenerator::ShareRows() {
+  std::map<std::vector<int32_t>, uint32_t> row_index;
+  std::vector<std::vector<int32_t>> rows;
+  row_of_.clear();
+  for (auto &row : action_table_) {
+    auto iter = row_index.emplace(row, rows.size());
+    if (iter.second) {
+      rows.push_back(std::move(row));
+    }
+    row_of_.push_back(iter.first->second);
+  }
+  action_table_ = std::move(rows);
+}
+
+static const char *IndexType(size_t max_value) {
+  if (max_value <= UINT8_MAX) {
+    return "uint8_t";
+  } else if (max_value <= UINT16_MAX) {
+    return "uint16_t";
+  }
+  return "uint32_t";
+}
+
+static size_t IndexSize(size_t max_value) {
+  if (max_value <= UINT8_MAX) {
+    return 1;
+  } else if (max_value <= UINT16_MAX) {
+    return 2;
+  }
+  return 4;
+}
+
+static std::vector<bool> HasConflict(const std::vector<uint32_t> &conflict_cell,
+                                     size_t state_count,
+                                     uint32_t terminator_count) {
+  std::vector<bool> has_conflict(state_count, false);
+  for (auto cell : conflict_cell) {
+    has_conflict[cell / (terminator_count + 1)] = true;
+  }
+  return has_conflict;
+}
+
+// Looks for START -> ... -> L through nonterminals with one production of
+// one nonterminal, then L -> X | X L (or L -> X | L X), where none of them
+// occurs anywhere else. A terminal that appears only as the last symbol of X
+// productions then always ends a top level X: the tokens between two of them
+// parse as an L on their own, which is what LALR_parallel.h splits the input
+// at. GLR tables are left alone.
+void LALRParserGenerator::FindSyncTokens() {
+  if (!conflict_cell_.empty()) {
+    return;
+  }
+  std::map<TokenPtr, ProductionPtrVec> productions_of;
+  for (const auto &production : grammar_->productions_) {
+    productions_of[production->head_].push_back(production);
+  }
+  std::set<TokenPtr> wrappers;
+  auto list = grammar_->start_;
+  while (true) {
+    const auto &productions = productions_of[list];
+    if (productions.size() != 1 || productions[0]->body_.size() != 1 ||
+        productions[0]->body_[0]->type_ != Token::Type::Nonterminator ||
+        productions[0]->body_[0] == grammar_->start_ ||
+        wrappers.count(productions[0]->body_[0])) {
+      break;
+    }
+    wrappers.insert(list);
+    list = productions[0]->body_[0];
+  }
+  TokenPtr unit;
+  bool single = false, left = false, right = false;
+  for (const auto &production : productions_of[list]) {
+    const auto &body = production->body_;
+    auto item = body.size() == 2 ? body[body[0] == list ? 1 : 0] : body[0];
+    if (body.size() > 2 || item == list || wrappers.count(item) ||
+        item->type_ != Token::Type::Nonterminator || (unit && item != unit)) {
+      return;
+    }
+    unit = item;
+    if (body.size() == 1) {
+      single = true;
+    } else if (body[0] == list) {
+      left = true;
+    } else if (body[1] == list) {
+      right = true;
+    }
+  }
+  if (wrappers.empty() || !unit || !single || left == right) {
+    return;
+  }
+  // Terminals closing a unit, dropped again when seen anywhere else.
+  std::map<TokenPtr, bool> closes;
+  for (const auto &production : grammar_->productions_) {
+    const auto &body = production->body_;
+    bool own = production->head_ == list || wrappers.count(production->head_);
+    for (size_t i = 0; i < body.size(); i++) {
+      if (!own && (body[i] == list || body[i] == unit ||
+                   wrappers.count(body[i]))) {
+        return;
+      }
+      if (body[i]->type_ != Token::Type::Terminator) {
+        continue;
+      }
+      bool last = production->head_ == unit && i + 1 == body.size();
+      auto iter = closes.emplace(body[i], last).first;
+      iter->second = iter->second && last;
+    }
+  }
+  for (const auto &[token, last] : closes) {
+    if (last && token != grammar_->error_) {
+      sync_tokens_.push_back(token);
+    }
+  }
+  if (!sync_tokens_.empty()) {
+    sync_list_ = list->id_;
+    sync_left_recursive_ = left;
+  }
+}
+
+// Picks byte positions until the length and the bytes there set all
+// keywords apart, each time the position leaving the fewest collisions as
+// gperf does. The keywords are then placed by hash and displace: buckets,
+// largest first, try seeds until all their keywords land in free slots, so
+// there are exactly as many slots as keywords.
+void LALRParserGenerator::BuildKeywordHash() {
+  std::vector<std::string> texts;
+  TokenPtrVec tokens;
+  size_t longest = 0;
+  for (const auto &token : grammar_->keywords_) {
+    if (!grammar_->terminators_.count(token)) {
+      throw std::invalid_argument("Keyword is not a terminator: " +
+                                  token->to_string());
+    }
+    texts.push_back(token->debug_name_);
+    tokens.push_back(token);
+    longest = std::max(longest, token->debug_name_.size());
+  }
+  if (texts.empty()) {
+    return;
+  }
+  auto keys_of = [&texts](const std::vector<int32_t> &positions) {
+    std::vector<uint32_t> keys;
+    for (const auto &text : texts) {
+      keys.push_back(siicc::KeywordKey(text.data(), text.size(),
+                                       positions.data(), positions.size()));
+    }
+    return keys;
+  };
+  auto collisions = [&keys_of](const std::vector<int32_t> &positions) {
+    auto keys = keys_of(positions);
+    std::sort(keys.begin(), keys.end());
+    return keys.end() - std::unique(keys.begin(), keys.end());
+  };
+  std::vector<int32_t> candidates;
+  for (int32_t i = 0; i < static_cast<int32_t>(longest); i++) {
+    candidates.push_back(i);
+    candidates.push_back(-1 - i);
+  }
+  auto current = collisions(keyword_position_);
+  while (current > 0 && !candidates.empty()) {
+    size_t best = 0;
+    auto best_collisions = current;
+    for (size_t i = 0; i < candidates.size(); i++) {
+      keyword_position_.push_back(candidates[i]);
+      auto count = collisions(keyword_position_);
+      keyword_position_.pop_back();
+      if (i == 0 || count < best_collisions) {
+        best = i;
+        best_collisions = count;
+      }
+    }
+    keyword_position_.push_back(candidates[best]);
+    candidates.erase(candidates.begin() + best);
+    current = best_collisions;
+  }
+  if (current > 0) {
+    throw std::logic_error("Keyword hash can not tell the keywords apart");
+  }
+
+  auto keys = keys_of(keyword_position_);
+  uint32_t count = keys.size();
+  for (uint32_t bucket_count = (count + 1) / 2; bucket_count <= 4 * count;
+       bucket_count *= 2) {
+    std::vector<std::vector<uint32_t>> buckets(bucket_count);
+    for (uint32_t i = 0; i < count; i++) {
+      buckets[siicc::KeywordMix(keys[i], 0) % bucket_count].push_back(i);
+    }
+    std::vector<uint32_t> order(bucket_count);
+    for (uint32_t i = 0; i < bucket_count; i++) {
+      order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+      return buckets[a].size() > buckets[b].size();
+    });
+    std::vector<uint32_t> seeds(bucket_count, 0);
+    TokenPtrVec slots(count);
+    bool placed = true;
+    for (auto bucket : order) {
+      if (buckets[bucket].empty()) {
+        break;
+      }
+      bool found = false;
+      for (uint32_t seed = 1; seed < (1u << 16) && !found; seed++) {
+        std::vector<uint32_t> taken;
+        for (auto i : buckets[bucket]) {
+          uint32_t slot = siicc::KeywordMix(keys[i], seed) % count;
+          if (slots[slot] ||
+              std::find(taken.begin(), taken.end(), slot) != taken.end()) {
+            break;
+          }
+          taken.push_back(slot);
+        }
+        if (taken.size() == buckets[bucket].size()) {
+          for (size_t k = 0; k < taken.size(); k++) {
+            slots[taken[k]] = tokens[buckets[bucket][k]];
+          }
+          seeds[bucket] = seed;
+          found = true;
+        }
+      }
+      if (!found) {
+        placed = false;
+        break;
+      }
+    }
+    if (placed) {
+      keyword_seed_ = std::move(seeds);
+      keyword_slot_ = std::move(slots);
+      return;
+    }
+  }
+  throw std::logic_error("No perfect hash found for the keywords");
 }
 
-static inline void OutputTokenDef(PrintHelper &ph, std::ostream &os,
+// Lays the numeric tables out in blob_ with the element types the header
+// would spell them with, each array 4 byte aligned. Symbols are prefixed
+// with the blob's file name, so parsers linked together do not clash.
+void LALRParserGenerator::BuildBlob() {
+  auto prefix = std::filesystem::path(options_.blob_path_).stem().string();
+  for (auto &ch : prefix) {
+    if (!std::isalnum(static_cast<unsigned char>(ch))) {
+      ch = '_';
+    }
+  }
+  auto add = [&](const char *type, const char *name, std::string extent,
+                 const auto &values) {
+    size_t element_size = std::strcmp(type, "uint8_t") == 0 ||
+                                  std::strcmp(type, "bool") == 0
+                              ? 1
+                          : std::strcmp(type, "uint16_t") == 0 ? 2
+                                                                : 4;
+    blob_.resize((blob_.size() + 3) / 4 * 4, '\0');
+    blob_arrays_.push_back({type, name, prefix + "_" + name, std::move(extent),
+                            blob_.size(), values.size() * element_size});
+    for (auto value : values) {
+      auto append = [&](auto element) {
+        blob_.append(reinterpret_cast<const char *>(&element),
+                     sizeof(element));
+      };
+      if (element_size == 1) {
+        append(static_cast<uint8_t>(value));
+      } else if (element_size == 2) {
+        append(static_cast<uint16_t>(value));
+      } else {
+        append(static_cast<uint32_t>(value));
+      }
+    }
+  };
+  auto extent = [](size_t size) { return "[" + std::to_string(size) + "]"; };
+  add("uint32_t", "reduce_result", extent(reduce_result_.size()),
+      reduce_result_);
+  add("uint32_t", "reduce_length", extent(reduce_length_.size()),
+      reduce_length_);
+  if (!terminal_class_.empty()) {
+    add(IndexType(class_count_), "terminal_class",
+        extent(terminal_class_.size()), terminal_class_);
+  }
+  if (!default_reduce_.empty()) {
+    add("int32_t", "default_reduce", extent(default_reduce_.size()),
+        default_reduce_);
+  }
+  if (!row_of_.empty()) {
+    add(IndexType(action_table_.size()), "row_of", extent(row_of_.size()),
+        row_of_);
+  }
+  std::vector<int32_t> cells;
+  for (const auto &row : action_table_) {
+    cells.insert(cells.end(), row.begin(), row.end());
+  }
+  add("int32_t", "action_table",
+      extent(action_table_.size()) + extent(action_table_[0].size()), cells);
+  if (!conflict_cell_.empty()) {
+    auto has_conflict = HasConflict(conflict_cell_, closures_.size(),
+                                    grammar_->terminators_.size());
+    add("bool", "has_conflict", extent(has_conflict.size()), has_conflict);
+    add("uint32_t", "conflict_cell", extent(conflict_cell_.size()),
+        conflict_cell_);
+    add("uint32_t", "conflict_begin", extent(conflict_begin_.size()),
+        conflict_begin_);
+    add("uint32_t", "conflict_reduce", extent(conflict_reduce_.size()),
+        conflict_reduce_);
+  }
+}
+
+std::string LALRParserGenerator::TableReport() const {
+  size_t state_count = closures_.size();
+  size_t symbol_count =
+      grammar_->terminators_.size() + grammar_->nonterminators_.size() + 1;
+  size_t dense_bytes = original_state_count_ * symbol_count * sizeof(int32_t);
+  size_t bytes = action_table_.size() * action_table_[0].size() *
+                 sizeof(int32_t);
+  if (!terminal_class_.empty()) {
+    bytes += terminal_class_.size() * IndexSize(class_count_);
+  }
+  if (!default_reduce_.empty()) {
+    bytes += default_reduce_.size() * sizeof(int32_t);
+  }
+  if (!row_of_.empty()) {
+    bytes += row_of_.size() * IndexSize(action_table_.size());
+  }
+  if (!conflict_cell_.empty()) {
+    bytes += state_count + (conflict_cell_.size() + conflict_begin_.size() +
+                            conflict_reduce_.size()) *
+                               sizeof(uint32_t);
+  }
+  std::stringstream ss;
+  ss << "states: " << original_state_count_ << " -> " << state_count << "\n";
+  ss << "rows: " << action_table_.size() << " x " << action_table_[0].size()
+     << "\n";
+  if (!conflict_cell_.empty()) {
+    ss << "conflict cells: " << conflict_cell_.size() << "\n";
+  }
+  ss << "table bytes: " << dense_bytes << " -> " << bytes << " (saved "
+     << static_cast<int64_t>(dense_bytes) - static_cast<int64_t>(bytes)
+     << ")\n";
+  return ss.str();
+}
+
+// In blob mode the members of ParserTables that point at the embedded
+// tables, by table name.
+typedef std::map<std::string, std::string> BlobMembers;
+
+// Emits the blob member standing in for table `name`, if there is one.
+static bool OutputBlobMember(PrintHelper &ph, OutputBuffer &os,
+                             const BlobMembers &blob, const std::string &name) {
+  auto iter = blob.find(name);
+  if (iter == blob.end()) {
+    return false;
+  }
+  ph << os << iter->second << "\n";
+  return true;
+}
+
+// `str` escaped for a C string literal. Keyword spellings can hold any
+// byte, other bytes than printable ASCII are written in octal, as a hex
+// escape would run into a following digit.
+static std::string GetPrintStr(const std::string &str) {
+  std::string result;
+  for (char ch : str) {
+    uint8_t byte = ch;
+    if (ch == '\\' || ch == '"') {
+      result.push_back('\\');
+      result.push_back(ch);
+    } else if (byte >= 0x20 && byte < 0x7f) {
+      result.push_back(ch);
+    } else {
+      result.push_back('\\');
+      result.push_back('0' + (byte >> 6));
+      result.push_back('0' + (byte >> 3 & 7));
+      result.push_back('0' + (byte & 7));
+    }
+  }
+  return result;
+}
+
+static inline void OutputTokenDef(PrintHelper &ph, OutputBuffer &os,
                                   const TokenPtrSet &terminators) {
 
   ph << os << "struct Token {\n";
@@ -58,15 +823,23 @@ static inline void OutputTokenDef(PrintHelper &ph, std::ostream &os,
   ph << os << "enum class TokenType : int32_t {\n";
   ph.Indent();
   for (const auto &terminator : terminators) {
+    // Quoted when a trailing backslash would continue the comment.
+    auto spelling = GetPrintStr(terminator->debug_name_);
+    if (!spelling.empty() && spelling.back() == '\\') {
+      spelling = "\"" + spelling + "\"";
+    }
     ph << os << "TOKEN_" << terminator->name_ << " = " << terminator->id_
-       << ", // " << terminator->debug_name_ << "\n";
+       << ", // " << spelling << "\n";
   }
   ph.Deindent();
   ph << os << "};\n";
-  ph << os
-     << "Token(TokenType type, const std::string& value) : type_(type), "
-        "value_(std::make_shared<std::string>(value)) {}";
+  ph << os << "Token(TokenType type, const std::string& value, "
+              "uint32_t offset = 0)\n";
+  ph << os << "    : type_(type), offset_(offset), "
+              "value_(std::make_shared<std::string>(value)) {}\n";
   ph << os << "TokenType type_;\n";
+  ph << os << "// Byte offset of the token in the input.\n";
+  ph << os << "uint32_t offset_;\n";
   ph << os << "std::shared_ptr<std::string> value_;\n";
   ph.Deindent();
   ph << os << "};\n\n";
@@ -74,8 +847,8 @@ static inline void OutputTokenDef(PrintHelper &ph, std::ostream &os,
   ph << os << "class Lexer { public: virtual Token Next() = 0; };\n\n";
 }
 
-static inline void OutputNodeDef(PrintHelper &ph, std::ostream &os,
-                                 const GrammarPtr &grammar) {
+static inline void OutputNodeDef(PrintHelper &ph, OutputBuffer &os,
+                                 const GrammarPtr &grammar, bool glr) {
   ph << os << "struct ASTNode {\n";
   ph.Indent();
   ph << os << "enum class Type : int {\n";
@@ -91,55 +864,120 @@ static inline void OutputNodeDef(PrintHelper &ph, std::ostream &os,
   ph.Deindent();
   ph << os << "};\n";
   ph << os << "Type type_;\n";
+  ph << os << "// Byte offsets of the first and the last token covered, see "
+              "LALR_location.h.\n";
+  ph << os << "uint32_t begin_ = 0;\n";
+  ph << os << "uint32_t end_ = 0;\n";
   ph << os << "std::shared_ptr<std::string> value_;\n";
   ph << os << "std::vector<std::shared_ptr<ASTNode>> children_;\n";
+  ph << os << "int32_t state_ = 0;\n";
+  ph << os << "uint32_t token_count_ = 0;\n";
+  if (glr) {
+    ph << os << "// Other derivations of the same span, filled in by the GLR "
+                "parser.\n";
+    ph << os << "std::vector<std::shared_ptr<ASTNode>> alternatives_;\n";
+  }
   ph << os
      << "static bool IsLeaf(Type type) { return static_cast<int>(type) <= "
      << grammar->terminators_.size() << "; }\n";
   ph << os << "static std::string TypeToStr(Type type);\n";
   ph.Deindent();
   ph << os << "};\n";
-  ph << os << "typedef std::shared_ptr<ASTNode> ASTNodePtr;\n";
-  ph << os << "ASTNodePtr Parse(std::shared_ptr<Lexer> lexer);\n";
+  ph << os << "typedef std::shared_ptr<ASTNode> ASTNodePtr;\n\n";
 }
 
-void LALRParserGenerator::OutputHeader(std::ostream &os) {
-  os << "#pragma once\n";
-  os << "#include <string>\n";
-  os << "#include <memory>\n";
-  os << "#include <cstdint>\n";
-  os << "#include <vector>\n";
-  os << "namespace siicc {\n";
-  PrintHelper ph;
-  OutputTokenDef(ph, os, grammar_->terminators_);
-  OutputNodeDef(ph, os, grammar_);
-  os << "} // namespace sii\n";
+static void OutputAcceptDefine(PrintHelper &ph, OutputBuffer &os,
+                               const GrammarPtr &grammar) {
+  ph << os << "static constexpr uint32_t ACCEPT_TOKEN = "
+     << grammar->start_->id_ << ";\n";
+  ph << os << "static constexpr uint32_t END_TOKEN = " << grammar->end_->id_
+     << ";\n";
+  ph << os << "// 0 when the grammar has no error token.\n";
+  ph << os << "static constexpr uint32_t ERROR_TOKEN = "
+     << (grammar->error_ ? grammar->error_->id_ : 0) << ";\n";
 }
 
-static void OutputAcceptDefine(PrintHelper &ph, std::ostream &os,
-                               uint32_t accpeted) {
-  ph << os << "static constexpr uint32_t ACCPET_TOKEN = " << accpeted << ";\n";
+static void OutputSyncTokens(PrintHelper &ph, OutputBuffer &os,
+                             uint32_t list, bool left_recursive,
+                             const TokenPtrVec &tokens,
+                             size_t terminal_count) {
+  ph << os << "// The input is a list of SYNC_LIST units and every sync token "
+              "ends one,\n";
+  ph << os << "// see LALR_parallel.h. 0 when the grammar has no such list.\n";
+  ph << os << "static constexpr uint32_t SYNC_LIST = " << list << ";\n";
+  ph << os << "static constexpr bool SYNC_LEFT_RECURSIVE = "
+     << (left_recursive ? "true" : "false") << ";\n";
+  std::vector<bool> is_sync(terminal_count + 1);
+  for (const auto &token : tokens) {
+    is_sync[token->id_] = true;
+  }
+  ph << os << "static constexpr bool is_sync_token[" << is_sync.size()
+     << "] = {";
+  ph.Indent();
+  for (size_t i = 0; i < is_sync.size(); i++) {
+    if (i % 16 == 0) {
+      os << "\n";
+      ph << os;
+    }
+    os << (is_sync[i] ? "1" : "0") << (i + 1 == is_sync.size() ? "" : ", ");
+  }
+  ph.Deindent();
+  os << "\n";
+  ph << os << "};\n";
 }
 
-static std::string GetPrintStr(const std::string &str) {
-  std::string result;
-  for (auto ch : str) {
-    if (ch == '\'') {
-      result.append("\'");
-    } else if (ch == '\\') {
-      result.append("\\");
-    } else if (ch == '\"') {
-      result.append("\"");
-    } else {
-      result.push_back(ch);
-    }
+// Fixed-spelling terminals and their perfect hash, read by MatchKeyword.
+static void OutputKeywords(PrintHelper &ph, OutputBuffer &os,
+                           const std::vector<int32_t> &positions,
+                           const std::vector<uint32_t> &seeds,
+                           const TokenPtrVec &slots) {
+  ph << os << "// Keywords by hash slot, see LALR_keywords.h.\n";
+  ph << os << "static constexpr uint32_t KEYWORD_COUNT = " << slots.size()
+     << ";\n";
+  if (slots.empty()) {
+    return;
   }
-  return result;
+  auto output_array = [&](const char *type, const char *name, size_t size,
+                          auto &&element) {
+    ph << os << "static constexpr " << type
+       << (std::string_view(type).back() == '*' ? "" : " ") << name << "["
+       << std::max<size_t>(size, 1) << "] = {";
+    ph.Indent();
+    for (size_t i = 0; i < size; i++) {
+      if (i % 8 == 0) {
+        os << "\n";
+        ph << os;
+      }
+      element(i);
+      os << (i + 1 == size ? "" : ", ");
+    }
+    if (size == 0) {
+      os << "0";
+    }
+    ph.Deindent();
+    os << "\n";
+    ph << os << "};\n";
+  };
+  ph << os << "static constexpr uint32_t KEYWORD_POSITION_COUNT = "
+     << positions.size() << ";\n";
+  output_array("int32_t", "keyword_position", positions.size(),
+               [&](size_t i) { os << positions[i]; });
+  ph << os << "static constexpr uint32_t KEYWORD_BUCKET_COUNT = "
+     << seeds.size() << ";\n";
+  output_array("uint32_t", "keyword_seed", seeds.size(),
+               [&](size_t i) { os << seeds[i]; });
+  output_array("const char *", "keyword_text", slots.size(), [&](size_t i) {
+    os << "\"" << GetPrintStr(slots[i]->debug_name_) << "\"";
+  });
+  output_array("uint32_t", "keyword_length", slots.size(),
+               [&](size_t i) { os << slots[i]->debug_name_.size(); });
+  output_array("uint32_t", "keyword_id", slots.size(),
+               [&](size_t i) { os << slots[i]->id_; });
 }
 
-static void OutputDebugInfo(PrintHelper &ph, std::ostream &os,
+static void OutputDebugInfo(PrintHelper &ph, OutputBuffer &os,
                             const GrammarPtr &grammar) {
-  ph << os << "const char* DEBUG_INFO_TABLE["
+  ph << os << "static constexpr const char *DEBUG_INFO_TABLE["
      << grammar->nonterminators_.size() + grammar->terminators_.size()
      << "] = {\n";
   ph.Indent();
@@ -151,7 +989,38 @@ static void OutputDebugInfo(PrintHelper &ph, std::ostream &os,
   }
   ph.Deindent();
   ph << os << "};\n";
+}
 
+// With `lookup` the names are an array indexed by type instead of a switch,
+// which compiles much faster for large grammars.
+static void OutputTypeToStr(PrintHelper &ph, OutputBuffer &os,
+                            const GrammarPtr &grammar, bool lookup) {
+  if (lookup) {
+    auto count = grammar->terminators_.size() + grammar->nonterminators_.size();
+    ph << os << "static constexpr const char *TYPE_NAMES[" << count
+       << "] = {\n";
+    ph.Indent();
+    for (const auto &terminator : grammar->terminators_) {
+      ph << os << "\"" << terminator->name_ << "\",\n";
+    }
+    for (const auto &nonterminator : grammar->nonterminators_) {
+      ph << os << "\"" << nonterminator->name_ << "\",\n";
+    }
+    ph.Deindent();
+    ph << os << "};\n";
+    ph << os << "std::string ASTNode::TypeToStr(Type type) {\n";
+    ph.Indent();
+    ph << os << "auto index = static_cast<uint32_t>(type) - 1;\n";
+    ph << os << "if (index >= " << count << ") {\n";
+    ph.Indent();
+    ph << os << "throw std::invalid_argument(\"Invalid argument.\");\n";
+    ph.Deindent();
+    ph << os << "}\n";
+    ph << os << "return TYPE_NAMES[index];\n";
+    ph.Deindent();
+    ph << os << "}\n";
+    return;
+  }
   ph << os << "std::string ASTNode::TypeToStr(Type type) {\n";
   ph.Indent();
   ph << os << "switch (type) {\n";
@@ -176,52 +1045,184 @@ static void OutputDebugInfo(PrintHelper &ph, std::ostream &os,
   ph << os << "}\n";
 }
 
-static void OutputTables(PrintHelper &ph, std::ostream &os,
-                         const std::vector<uint32_t> reduce_result,
+static void OutputTables(PrintHelper &ph, OutputBuffer &os,
+                         const std::vector<uint32_t> &reduce_result,
                          const std::vector<uint32_t> &reduce_length,
-                         const std::vector<std::vector<int32_t>> &action_table,
-                         const GrammarPtr &grammar) {
-  ph << os << "uint32_t reduce_result[" << reduce_result.size() << "] = {\n";
+                         size_t state_count, const GrammarPtr &grammar,
+                         const BlobMembers &blob) {
+  uint32_t max_reduce_length = 0;
+  for (auto length : reduce_length) {
+    max_reduce_length = std::max(max_reduce_length, length);
+  }
+  ph << os << "static constexpr uint32_t TERMINATOR_COUNT = "
+     << grammar->terminators_.size() << ";\n";
+  ph << os << "static constexpr uint32_t SYMBOL_COUNT = "
+     << grammar->terminators_.size() + grammar->nonterminators_.size()
+     << ";\n";
+  ph << os << "static constexpr uint32_t STATE_COUNT = " << state_count
+     << ";\n";
+  ph << os << "static constexpr uint32_t MAX_REDUCE_LENGTH = "
+     << max_reduce_length << ";\n";
+  if (OutputBlobMember(ph, os, blob, "reduce_result")) {
+    OutputBlobMember(ph, os, blob, "reduce_length");
+    return;
+  }
+  ph << os << "static constexpr uint32_t reduce_result[" << reduce_result.size()
+     << "] = {\n";
   ph.Indent();
   for (size_t i = 0; i < reduce_result.size(); i++) {
     ph << os << reduce_result[i] << ", "[i + 1 == reduce_result.size()];
   }
   ph.Deindent();
-  ph << os << "\n};\n";
-  ph << os << "uint32_t reduce_length[" << reduce_length.size() << "] = {\n";
+  os << "\n";
+  ph << os << "};\n";
+  ph << os << "static constexpr uint32_t reduce_length[" << reduce_length.size()
+     << "] = {\n";
   ph.Indent();
   for (size_t i = 0; i < reduce_length.size(); i++) {
     ph << os << reduce_length[i] << ", "[i + 1 == reduce_length.size()];
   }
   ph.Deindent();
-  ph << os << "\n};\n";
-  ph << os << "int32_t action_table[" << action_table.size() << "]["
-     << action_table[0].size() << "] = {\n";
-  ph.Indent();
-  for (size_t i = 0; i < action_table.size(); i++) {
-    for (size_t j = 0; j < action_table[i].size(); j++) {
-      ph << os << std::setw(3) << action_table[i][j] << ",";
+  os << "\n";
+  ph << os << "};\n";
+}
+
+// Emits action_table with the Action/Goto accessors the runtime indexes it
+// through. Goto columns start right after the terminal columns, which are
+// either one per terminal id or one per class in `terminal_class`. With
+// `row_of` states share rows, with `default_reduce` consistent states reduce
+// without consulting the table.
+static void OutputActionTable(
+    PrintHelper &ph, OutputBuffer &os,
+    const std::vector<std::vector<int32_t>> &action_table,
+    const std::vector<uint32_t> &terminal_class, uint32_t class_count,
+    const std::vector<int32_t> &default_reduce,
+    const std::vector<uint32_t> &row_of, const GrammarPtr &grammar,
+    const BlobMembers &blob) {
+  uint32_t terminal_columns = grammar->terminators_.size() + 1;
+  if (!terminal_class.empty()) {
+    terminal_columns = class_count;
+    ph << os << "static constexpr uint32_t CLASS_COUNT = " << class_count
+       << ";\n";
+    if (!OutputBlobMember(ph, os, blob, "terminal_class")) {
+      ph << os << "static constexpr " << IndexType(class_count)
+         << " terminal_class[" << terminal_class.size() << "] = {";
+      for (size_t i = 0; i < terminal_class.size(); i++) {
+        os << terminal_class[i] << ", "[i + 1 == terminal_class.size()];
+      }
+      os << "};\n";
     }
-    ph << os << "\n";
+  }
+  if (!default_reduce.empty() &&
+      !OutputBlobMember(ph, os, blob, "default_reduce")) {
+    ph << os << "static constexpr int32_t default_reduce["
+       << default_reduce.size() << "] = {";
+    for (size_t i = 0; i < default_reduce.size(); i++) {
+      os << default_reduce[i] << ", "[i + 1 == default_reduce.size()];
+    }
+    os << "};\n";
+  }
+  std::string row = "state";
+  if (!row_of.empty()) {
+    row = "row_of[state]";
+    ph << os << "static constexpr uint32_t ROW_COUNT = " << action_table.size()
+       << ";\n";
+    if (!OutputBlobMember(ph, os, blob, "row_of")) {
+      ph << os << "static constexpr " << IndexType(action_table.size())
+         << " row_of[" << row_of.size() << "] = {";
+      for (size_t i = 0; i < row_of.size(); i++) {
+        os << row_of[i] << ", "[i + 1 == row_of.size()];
+      }
+      os << "};\n";
+    }
+  }
+  if (!OutputBlobMember(ph, os, blob, "action_table")) {
+    ph << os << "static constexpr int32_t action_table[" << action_table.size()
+       << "][" << action_table[0].size() << "] = {\n";
+    ph.Indent();
+    for (size_t i = 0; i < action_table.size(); i++) {
+      ph << os << "{";
+      for (size_t j = 0; j < action_table[i].size(); j++) {
+        os.Number(action_table[i][j], 3) << ",";
+      }
+      os << "},\n";
+    }
+    ph.Deindent();
+    ph << os << "};\n";
+  }
+  // The embedded tables are only known at link time.
+  const char *accessor = blob.empty() ? "static constexpr" : "static";
+  ph << os << accessor << " int32_t Action(uint32_t state, uint32_t "
+              "terminal) {\n";
+  ph.Indent();
+  std::string column =
+      terminal_class.empty() ? "terminal" : "terminal_class[terminal]";
+  if (!default_reduce.empty()) {
+    ph << os << "return default_reduce[state] ? default_reduce[state] : "
+       << "action_table[" << row << "][" << column << "];\n";
+  } else {
+    ph << os << "return action_table[" << row << "][" << column << "];\n";
   }
   ph.Deindent();
-  ph << os << "};\n";
-
-  ph << os << "static bool ShouldShift(uint32_t next_id) {\n";
+  ph << os << "}\n";
+  ph << os << accessor << " int32_t Goto(uint32_t state, uint32_t "
+              "nonterminal) {\n";
   ph.Indent();
-  ph << os << "return next_id < " << grammar->terminators_.size() + 1 << ";\n";
+  ph << os << "return action_table[" << row << "][nonterminal - "
+     << grammar->terminators_.size() + 1 - terminal_columns << "];\n";
   ph.Deindent();
-  ph << os << "};\n";
+  ph << os << "}\n";
 }
 
-static void OutputGenerateNode(PrintHelper &ph, std::ostream &os,
-                               const GrammarPtr &grammar) {
+static void OutputConflictCells(PrintHelper &ph, OutputBuffer &os,
+                                const std::vector<uint32_t> &conflict_cell,
+                                const std::vector<uint32_t> &conflict_begin,
+                                const std::vector<uint32_t> &conflict_reduce,
+                                size_t state_count, uint32_t terminator_count,
+                                const BlobMembers &blob) {
+  ph << os << "static constexpr uint32_t CONFLICT_COUNT = "
+     << conflict_cell.size() << ";\n";
+  if (conflict_cell.empty()) {
+    return;
+  }
+  auto has_conflict =
+      HasConflict(conflict_cell, state_count, terminator_count);
+  auto output_array = [&](const char *type, const char *name,
+                          const auto &values) {
+    if (OutputBlobMember(ph, os, blob, name)) {
+      return;
+    }
+    ph << os << "static constexpr " << type
+       << (std::string_view(type).back() == '*' ? "" : " ") << name << "["
+       << values.size() << "] = {";
+    for (size_t i = 0; i < values.size(); i++) {
+      os << values[i] << ", "[i + 1 == values.size()];
+    }
+    os << "};\n";
+  };
+  output_array("bool", "has_conflict", has_conflict);
+  output_array("uint32_t", "conflict_cell", conflict_cell);
+  output_array("uint32_t", "conflict_begin", conflict_begin);
+  output_array("uint32_t", "conflict_reduce", conflict_reduce);
+}
+
+static void OutputGenerateNode(PrintHelper &ph, OutputBuffer &os,
+                               const GrammarPtr &grammar, bool lookup) {
   ph << os
-     << R"""(ASTNodePtr CreateASTNode(uint32_t token_id, const std::string& value = "") {)"""
-     << "\n";
+     << "ASTNodePtr ParserTables::CreateNode(uint32_t token_id, "
+        "std::shared_ptr<std::string> value) {\n";
   ph.Indent();
+  ph << os << "static const auto empty_value = std::make_shared<std::string>();\n";
   ph << os << "auto result = std::make_shared<ASTNode>();\n";
-  ph << os << "result->value_ = std::make_shared<std::string>(value);\n";
+  ph << os << "result->value_ = value ? std::move(value) : empty_value;\n";
+  if (lookup) {
+    ph << os << "// Node types are numbered by token id.\n";
+    ph << os << "result->type_ = static_cast<ASTNode::Type>(token_id);\n";
+    ph << os << "return result;\n";
+    ph.Deindent();
+    ph << os << "}\n";
+    return;
+  }
   ph << os << "switch (token_id) {\n";
   ph.Indent();
   uint32_t idx = 1;
@@ -248,113 +1249,167 @@ static void OutputGenerateNode(PrintHelper &ph, std::ostream &os,
 
 }
 
-static void OutputAlgo(PrintHelper &ph, std::ostream &os) {
-
-  std::string algo = R"""(
-ASTNodePtr Parse(std::shared_ptr<Lexer> lexer) {
-	std::stack<int32_t> state_stack, next_token_id;
-	std::vector<std::shared_ptr<ASTNode>> ast_stack;
-	int32_t current_state = 0;
-	state_stack.push(current_state);
-	while (true) {
-		if (next_token_id.empty()) {
-			Token next_token = lexer->Next();
-			next_token_id.push(static_cast<int32_t>(next_token.type_));
-		}
-		int32_t next_id = next_token_id.top(); next_token_id.pop();
-		int32_t action = action_table[current_state][next_id];
-		if (action == 0) {
-			throw std::invalid_argument(std::string(DEBUG_INFO_TABLE[next_id - 1]) + " not accpeted");
-		} else if (action > 0) {
-			if (ShouldShift(next_id)) {
-				auto new_AST_Node = CreateASTNode(next_id, DEBUG_INFO_TABLE[next_id - 1]);
-				ast_stack.push_back(new_AST_Node);
-			}
-			state_stack.push(action);
-			current_state = action;
-		} else {
-			action *= -1;
-			next_token_id.push(next_id);
-			int32_t reduce_count = reduce_length[action];
-			auto new_token = reduce_result[action];
-			auto new_AST_Node = CreateASTNode(new_token);
-			for (size_t i = 0; i < reduce_count; i++) {
-				new_AST_Node->children_.push_back(ast_stack.at(ast_stack.size() + i - reduce_count));
-			}
-			if (new_token == ACCPET_TOKEN) {
-				return new_AST_Node;
-			}
-			for (int i = 0; i < reduce_count; i++) {
-				state_stack.pop();
-				ast_stack.pop_back();
-			}
-			next_token_id.push(new_token);
-			ast_stack.push_back(new_AST_Node);
-			current_state = state_stack.top();
-		}
-#ifdef DEBUG_MODE
-    for (int i = 0; i < ast_stack.size(); i++) {
-      auto& item = ast_stack[i];
-      if (ASTNode::IsLeaf(item->type_)) {
-        std::cerr << *ast_stack[i]->value_ << " ";
-      } else {
-        std::cerr << DEBUG_INFO_TABLE[static_cast<int>(ast_stack[i]->type_) - 1] << " ";
-      }
-    } std::cerr << "\n";
-#endif
-	}
+// Defines the blob arrays by embedding their bytes with .incbin.
+static void OutputBlobAsm(PrintHelper &ph, OutputBuffer &os,
+                          const std::vector<BlobArray> &arrays,
+                          const std::string &blob_path) {
+  // Quoted for the assembler, then for the C++ string literal.
+  std::string path;
+  for (auto ch : blob_path) {
+    if (ch == '"' || ch == '\\') {
+      path += "\\\\";
+      path += ch == '"' ? "\\\"" : "\\\\";
+    } else {
+      path.push_back(ch);
+    }
+  }
+  ph << os << "#if !defined(__ELF__)\n";
+  ph << os << "#error \"Embedded parser tables need an ELF target\"\n";
+  ph << os << "#endif\n";
+  ph << os << "__asm__(\".pushsection .rodata\\n\"\n";
+  ph.Indent(8);
+  for (const auto &array : arrays) {
+    ph << os << "\".balign 4\\n\"\n";
+    ph << os << "\".globl " << array.symbol_ << "\\n\"\n";
+    ph << os << "\".type " << array.symbol_ << ", @object\\n\"\n";
+    ph << os << "\".size " << array.symbol_ << ", " << array.bytes_
+       << "\\n\"\n";
+    ph << os << "\"" << array.symbol_ << ":\\n\"\n";
+    ph << os << "\".incbin \\\"" << path << "\\\", " << array.offset_ << ", "
+       << array.bytes_ << "\\n\"\n";
+  }
+  ph << os << "\".popsection\\n\");\n";
+  ph.Deindent(8);
 }
-)""";
 
-  ph << os << algo;
+static void OutputAlgo(PrintHelper &ph, OutputBuffer &os, bool glr) {
+  const char *parser = glr ? "GLRParser" : "LRParser";
+  ph << os << "ASTNodePtr Parse(std::shared_ptr<Lexer> lexer) {\n";
+  ph.Indent();
+  ph << os << "return " << parser << "<ParserTables>::Parse(lexer);\n";
+  ph.Deindent();
+  ph << os << "}\n";
+  ph << os << "ASTNodePtr Parse(std::shared_ptr<Lexer> lexer, "
+              "std::vector<SyntaxError> &errors,\n";
+  ph << os << "                 const RecoveryOptions &options) {\n";
+  ph.Indent();
+  ph << os << "return " << parser
+     << "<ParserTables>::Parse(lexer, errors, options);\n";
+  ph.Deindent();
+  ph << os << "}\n";
+}
+
+void LALRParserGenerator::OutputHeader(std::ostream &stream) {
+  PhaseTimer timer(options_.stats_, "emit header");
+  auto begin = stream.tellp();
+  OutputBuffer os(stream);
+  os << "#pragma once\n";
+  os << "#include <string>\n";
+  os << "#include <memory>\n";
+  os << "#include <cstdint>\n";
+  os << "#include <vector>\n";
+  os << "#include \""
+     << (conflict_cell_.empty() ? "LALR_runtime.h" : "LALR_glr.h") << "\"\n";
+  os << "namespace siicc {\n";
+  PrintHelper ph;
+  OutputTokenDef(ph, os, grammar_->terminators_);
+  OutputNodeDef(ph, os, grammar_, !conflict_cell_.empty());
+
+  BlobMembers blob;
+  if (!blob_arrays_.empty()) {
+    ph << os << "// Embedded by the source file from " << options_.blob_path_
+       << ".\n";
+    ph << os << "extern \"C\" {\n";
+    for (const auto &array : blob_arrays_) {
+      ph << os << "extern const " << array.type_ << " " << array.symbol_
+         << array.extent_ << ";\n";
+      // A pointer to the first element, or to the first row of a matrix.
+      auto inner = array.extent_.substr(array.extent_.find(']') + 1);
+      auto pointer = inner.empty() ? "*" + array.name_
+                                   : "(*" + array.name_ + ")" + inner;
+      blob[array.name_] = "static constexpr const " + array.type_ + " " +
+                          pointer + " = " + array.symbol_ + ";";
+    }
+    ph << os << "}\n\n";
+  }
+
+  ph << os << "struct ParserTables {\n";
+  ph.Indent();
+  ph << os << "typedef ASTNode Node;\n";
+  ph << os << "typedef Lexer LexerType;\n";
+  OutputTables(ph, os, reduce_result_, reduce_length_, closures_.size(),
+               grammar_, blob);
+  OutputActionTable(ph, os, action_table_, terminal_class_, class_count_,
+                    default_reduce_, row_of_, grammar_, blob);
+  OutputConflictCells(ph, os, conflict_cell_, conflict_begin_,
+                      conflict_reduce_, closures_.size(),
+                      grammar_->terminators_.size(), blob);
+  OutputAcceptDefine(ph, os, grammar_);
+  OutputSyncTokens(ph, os, sync_list_, sync_left_recursive_, sync_tokens_,
+                   grammar_->terminators_.size());
+  OutputKeywords(ph, os, keyword_position_, keyword_seed_, keyword_slot_);
+  OutputDebugInfo(ph, os, grammar_);
+  ph << os << "static ASTNodePtr CreateNode(uint32_t token_id, "
+              "std::shared_ptr<std::string> value);\n";
+  ph.Deindent();
+  ph << os << "};\n\n";
+  ph << os << "ASTNodePtr Parse(std::shared_ptr<Lexer> lexer);\n";
+  if (conflict_cell_.empty()) {
+    ph << os << "// Repairs syntax errors and reports them in `errors`.\n";
+  } else {
+    ph << os << "// Repairs syntax errors and reports them in `errors`, see\n";
+    ph << os << "// GLRParser::Parse for how conflicts are repaired.\n";
+  }
+  ph << os << "ASTNodePtr Parse(std::shared_ptr<Lexer> lexer, "
+              "std::vector<SyntaxError> &errors,\n";
+  ph << os << "                 const RecoveryOptions &options = {});\n";
+  os << "} // namespace sii\n";
+  os.Flush();
+  CountEmitted(stream, begin);
 }
 
 void LALRParserGenerator::OutputCpp(const std::string &header_name,
-                                    std::ostream &os) {
+                                    std::ostream &stream) {
+  PhaseTimer timer(options_.stats_, "emit cpp");
+  auto begin = stream.tellp();
+  OutputBuffer os(stream);
   PrintHelper ph;
   ph << os << "#include \"" << header_name << "\"\n";
   ph << os << "#include <iostream>\n";
-  ph << os << "#include <stack>\n";
   ph << os << "#include <stdexcept>\n";
+  if (!blob_arrays_.empty()) {
+    OutputBlobAsm(ph, os, blob_arrays_, options_.blob_path_);
+  }
   ph << os << "namespace siicc {\n";
 
-  std::vector<uint32_t> reduce_result(grammar_->productions_.size() + 1);
-  std::vector<uint32_t> reduce_length(grammar_->productions_.size() + 1);
-  std::vector<std::vector<int32_t>> action_table;
-  for (const auto &production : grammar_->productions_) {
-    reduce_result[production->id_] = production->head_->id_;
-    reduce_length[production->id_] = production->body_.size();
-  }
-  for (const auto &closure : closures_) {
-    action_table.emplace_back(
-        grammar_->terminators_.size() + grammar_->nonterminators_.size(), 0);
-    const auto &action = action_[closure];
-    const auto &reduce = reduce_[closure];
-    for (const auto &terminator : grammar_->terminators_) {
-      auto action_iter = action.find(terminator);
-      auto reduce_iter = reduce.find(terminator);
-      if (action_iter != action.end()) {
-        action_table[closure->id_][terminator->id_] = action_iter->second->id_;
-      } else if (reduce_iter != reduce.end()) {
-        action_table[closure->id_][terminator->id_] =
-            -1 * reduce_iter->second->id_;
-      }
-    }
-    for (const auto &nonterminator : grammar_->nonterminators_) {
-      auto action_iter = action.find(nonterminator);
-      if (action_iter != action.end()) {
-        action_table[closure->id_][nonterminator->id_] =
-            action_iter->second->id_;
-      }
-    }
-  }
-  OutputTables(ph, os, reduce_result, reduce_length, action_table, grammar_);
-  OutputDebugInfo(ph, os, grammar_);
-  OutputAcceptDefine(ph, os, grammar_->start_->id_);
-  OutputGenerateNode(ph, os, grammar_);
-  OutputAlgo(ph, os);
+  bool lookup = !options_.blob_path_.empty();
+  OutputTypeToStr(ph, os, grammar_, lookup);
+  OutputGenerateNode(ph, os, grammar_, lookup);
+  OutputAlgo(ph, os, !conflict_cell_.empty());
 
   ph << os << "} // namespace siicc \n";
+  os.Flush();
+  CountEmitted(stream, begin);
+}
+
+void LALRParserGenerator::OutputBlob(std::ostream &os) {
+  PhaseTimer timer(options_.stats_, "emit blob");
+  auto begin = os.tellp();
+  os.write(blob_.data(), blob_.size());
+  CountEmitted(os, begin);
+}
+
+void LALRParserGenerator::CountEmitted(std::ostream &os,
+                                       std::streampos begin) {
+  auto stats = options_.stats_;
+  if (stats == nullptr) {
+    return;
+  }
+  auto end = os.tellp();
+  if (begin != std::streampos(-1) && end != std::streampos(-1)) {
+    stats->emitted_bytes_ += end - begin;
+  }
+  stats->peak_rss_kb_ = std::max(stats->peak_rss_kb_, PeakRssKb());
 }
 } // namespace LALR
 } // namespace siicc
\ No newline at end of file
@@ -1,25 +1,145 @@
 #pragma once
 
 #include "LALR_common.h"
+#include "LALR_generation_stats.h"
 
 namespace siicc {
 namespace LALR {
-typedef std::map<ClosurePtr, std::map<TokenPtr, ClosurePtr>> ActionType;
+// Transitions of closures[i] at [i], for the closures passed along.
+typedef std::vector<EdgeVec> ActionType;
+// A reduce entry takes priority over a shift on the same token, and a null
+// production is an explicit error (from %nonassoc).
 typedef std::map<ClosurePtr, std::map<TokenPtr, ProductionPtr>> ReduceType;
+// Extra reductions of a GLR table, on top of the action or reduce entry for
+// the same token.
+typedef std::map<ClosurePtr, std::map<TokenPtr, ProductionPtrVec>>
+    ConflictType;
+
+// Counts read back from a profile written by a parser built with
+// SIICC_PARSE_PROFILE, see LALR_profile.h. State numbers are those of a
+// parser generated from the same grammar and options without a profile.
+struct RecordedProfile {
+  uint32_t state_count_ = 0;
+  uint32_t production_count_ = 0;
+  uint32_t terminal_count_ = 0;
+  std::vector<uint64_t> visits_;
+  std::vector<uint64_t> terminals_;
+};
+
+RecordedProfile LoadParseProfile(std::istream &is);
+
+struct ParserGeneratorOptions {
+  // Terminals whose action columns are identical in every state share one
+  // column, the generated parser maps token ids to columns through a byte
+  // array.
+  bool terminal_classes_ = true;
+  // Merge states whose reduce entries match and whose transitions lead to
+  // merged states, i.e. states the parser can not tell apart.
+  bool merge_states_ = true;
+  // States whose only terminal action is one reduce take it without looking
+  // at the lookahead. Errors are still reported before the next shift.
+  bool default_reductions_ = true;
+  // Identical rows are emitted once and reached through a per-state index.
+  bool share_rows_ = true;
+  // When set, states are numbered by descending visit count (the start state
+  // stays 0) and terminal classes by descending token count, so the hot rows
+  // and columns of the emitted table are adjacent.
+  const RecordedProfile *profile_ = nullptr;
+  // When set, the numeric tables are not spelled out in the header but read
+  // from a binary blob, written by OutputBlob, that the source file embeds
+  // with .incbin; node types and names are array lookups instead of
+  // switches. Large grammars then compile in seconds. The path goes into the
+  // .incbin directive as is, so it is absolute or relative to the directory
+  // the source is compiled in (or to one passed with -Wa,-I). Needs an ELF
+  // target and a GNU compatible assembler, and the blob is in the byte order
+  // of the generating machine.
+  std::string blob_path_;
+  // Phase timers and emitted bytes go to `stats_` when set.
+  GenerationStats *stats_ = nullptr;
+};
+
+// A table embedded from the blob, see ParserGeneratorOptions::blob_path_:
+// an extern "C" array of `type_` and `extent_` named `symbol_`, standing in
+// for the ParserTables member `name_`.
+struct BlobArray {
+  std::string type_;
+  std::string name_;
+  std::string symbol_;
+  std::string extent_;
+  size_t offset_;
+  size_t bytes_;
+};
 
 class LALRParserGenerator {
 public:
   LALRParserGenerator(ActionType &&action, ReduceType &&reduce,
-                      std::vector<ClosurePtr> &&closures, GrammarPtr grammar);
+                      std::vector<ClosurePtr> &&closures, GrammarPtr grammar,
+                      ParserGeneratorOptions options = {},
+                      ConflictType &&conflicts = {});
 
   void OutputHeader(std::ostream &os);
   void OutputCpp(const std::string &header_name, std::ostream &os);
+  // The tables embedded by the source file, empty without blob_path_.
+  void OutputBlob(std::ostream &os);
+
+  // State count and table bytes before and after the size reductions.
+  std::string TableReport() const;
 
 private:
+  void MergeEquivalentStates();
+  void ReorderStatesByProfile();
+  void BuildTables();
+  void BuildConflictCells();
+  void BuildDefaultReductions();
+  void BuildTerminalClasses();
+  void ShareRows();
+  void BuildBlob();
+  void FindSyncTokens();
+  void BuildKeywordHash();
+  void CountEmitted(std::ostream &os, std::streampos begin);
+
   GrammarPtr grammar_;
   ActionType action_;
   ReduceType reduce_;
   std::vector<ClosurePtr> closures_;
+  ParserGeneratorOptions options_;
+  ConflictType conflicts_;
+
+  std::vector<uint32_t> reduce_result_;
+  std::vector<uint32_t> reduce_length_;
+  std::vector<std::vector<int32_t>> action_table_;
+  // Column of every terminal id in action_table_, empty when terminals are
+  // not merged.
+  std::vector<uint32_t> terminal_class_;
+  uint32_t class_count_ = 0;
+  // Per state reduce (as a negative action) taken regardless of lookahead,
+  // 0 if none. Empty when default reductions are off.
+  std::vector<int32_t> default_reduce_;
+  // Row of action_table_ used by every state, empty when rows are not
+  // shared.
+  std::vector<uint32_t> row_of_;
+  // GLR conflict cells as `state * (terminals + 1) + terminal`, sorted, with
+  // the reductions of cell i in
+  // conflict_reduce_[conflict_begin_[i], conflict_begin_[i + 1]).
+  std::vector<uint32_t> conflict_cell_;
+  std::vector<uint32_t> conflict_begin_;
+  std::vector<uint32_t> conflict_reduce_;
+  size_t original_state_count_ = 0;
+  // The input as a list of independent units, see FindSyncTokens: the list
+  // nonterminal (0 if there is none), its recursion side and the terminals
+  // that always close a unit.
+  uint32_t sync_list_ = 0;
+  bool sync_left_recursive_ = false;
+  TokenPtrVec sync_tokens_;
+  // Minimal perfect hash over Grammar::keywords_, see LALR_keywords.h: the
+  // byte positions it reads, the seed of every bucket and the keyword in
+  // every slot.
+  std::vector<int32_t> keyword_position_;
+  std::vector<uint32_t> keyword_seed_;
+  TokenPtrVec keyword_slot_;
+  // Where each numeric table lives in blob_ when blob_path_ is set.
+  std::vector<BlobArray> blob_arrays_;
+  std::string blob_;
 };
 } // namespace LALR
 } // namespace siicc
\ No newline at end of file
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <ostream>
+
+namespace siicc {
+// Counters of the parser generated into `Tables`, filled in by LRParser when
+// built with SIICC_PARSE_PROFILE defined. Without it nothing here is
+// instantiated. The profile is written at exit to $SIICC_PROFILE_FILE, or
+// siicc.profile, in the format below; LoadParseProfile in the generator
+// reads it back. Counting is not synchronized, profile one thread at a time.
+//
+//   siicc-profile 1
+//   states <n> productions <n> terminals <n>
+//   lexer_calls <n>
+//   max_stack_depth <n>
+//   nodes <n>
+//   visit <state> <count>         table lookups made in the state
+//   shift <state> <count>         per state the shift was taken in
+//   reduce <production> <count>
+//   terminal <id> <count>         tokens returned by the lexer
+template <class Tables> class ParseProfile {
+public:
+  static constexpr size_t PRODUCTION_COUNT = std::size(Tables::reduce_length);
+
+  static ParseProfile &Get() {
+    static ParseProfile profile;
+    return profile;
+  }
+
+  void Visit(int32_t state) { visits_[state]++; }
+  void Token(uint32_t terminal) {
+    lexer_calls_++;
+    terminals_[terminal]++;
+  }
+  void Shift(int32_t state, size_t stack_depth) {
+    shifts_[state]++;
+    nodes_++;
+    max_stack_depth_ = std::max<uint64_t>(max_stack_depth_, stack_depth);
+  }
+  void Reduce(uint32_t production) {
+    reductions_[production]++;
+    nodes_++;
+  }
+
+  void Dump(std::ostream &os) const {
+    os << "siicc-profile 1\n";
+    os << "states " << Tables::STATE_COUNT << " productions "
+       << PRODUCTION_COUNT - 1 << " terminals " << Tables::TERMINATOR_COUNT
+       << "\n";
+    os << "lexer_calls " << lexer_calls_ << "\n";
+    os << "max_stack_depth " << max_stack_depth_ << "\n";
+    os << "nodes " << nodes_ << "\n";
+    for (uint32_t i = 0; i < Tables::STATE_COUNT; i++) {
+      if (visits_[i]) {
+        os << "visit " << i << " " << visits_[i] << "\n";
+      }
+    }
+    for (uint32_t i = 0; i < Tables::STATE_COUNT; i++) {
+      if (shifts_[i]) {
+        os << "shift " << i << " " << shifts_[i] << "\n";
+      }
+    }
+    for (uint32_t i = 1; i < PRODUCTION_COUNT; i++) {
+      if (reductions_[i]) {
+        os << "reduce " << i << " " << reductions_[i] << "\n";
+      }
+    }
+    for (uint32_t i = 1; i <= Tables::TERMINATOR_COUNT; i++) {
+      if (terminals_[i]) {
+        os << "terminal " << i << " " << terminals_[i] << "\n";
+      }
+    }
+  }
+
+  ~ParseProfile() {
+    const char *path = std::getenv("SIICC_PROFILE_FILE");
+    std::ofstream os(path ? path : "siicc.profile");
+    Dump(os);
+  }
+
+private:
+  uint64_t visits_[Tables::STATE_COUNT] = {};
+  uint64_t shifts_[Tables::STATE_COUNT] = {};
+  uint64_t reductions_[PRODUCTION_COUNT] = {};
+  uint64_t terminals_[Tables::TERMINATOR_COUNT + 1] = {};
+  uint64_t lexer_calls_ = 0;
+  uint64_t max_stack_depth_ = 0;
+  uint64_t nodes_ = 0;
+};
+} // namespace siicc
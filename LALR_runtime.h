@@ -0,0 +1,430 @@
+#pragma once
+
+#include "LALR_keywords.h"
+#include "LALR_profile.h"
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace siicc {
+// A syntax error met by the recovering Parse and how it was repaired.
+struct SyntaxError {
+  // Index of the offending token in the lexer output.
+  size_t token_index_;
+  std::string message_;
+  // Byte offset of the offending token, see LALR_location.h.
+  uint32_t offset_ = 0;
+};
+
+// Thrown on a syntax error the parser does not repair.
+class ParseError : public std::invalid_argument {
+public:
+  ParseError(const std::string &message, uint32_t offset)
+      : std::invalid_argument(message), offset_(offset) {}
+  // Byte offset of the offending token.
+  uint32_t Offset() const { return offset_; }
+
+private:
+  uint32_t offset_;
+};
+
+// Node spans: a leaf covers its token, an inner node runs from the first
+// token of its first child to the last token of its last child.
+template <class Node, class Token>
+inline void SpanToken(Node &leaf, const Token &token) {
+  leaf.begin_ = leaf.end_ = token.offset_;
+}
+template <class Node> inline void SpanChildren(Node &node) {
+  node.begin_ = node.children_.front()->begin_;
+  node.end_ = node.children_.back()->end_;
+}
+
+// Bounds of the local repair search. One error costs at most
+// max_candidates_ trial parses of max_edits_ + check_tokens_ tokens.
+struct RecoveryOptions {
+  // Tokens inserted, deleted or replaced by one repair.
+  uint32_t max_edits_ = 2;
+  // Tokens after the repair that have to parse for it to be taken.
+  uint32_t check_tokens_ = 3;
+  // Inserted terminals tried before falling back to the error token.
+  uint32_t max_candidates_ = 2048;
+};
+
+// Table driven LR parser shared by every generated parser. `Tables` is the
+// struct emitted by LALRParserGenerator, all of its sizes are constexpr so the
+// bounds below fold at compile time.
+template <class Tables> class LRParser {
+public:
+  typedef typename Tables::Node Node;
+  typedef std::shared_ptr<Node> NodePtr;
+  typedef typename Tables::LexerType LexerType;
+  typedef decltype(std::declval<LexerType &>().Next()) Token;
+
+  static constexpr uint32_t TERMINATOR_COUNT = Tables::TERMINATOR_COUNT;
+  static constexpr uint32_t ACCEPT_TOKEN = Tables::ACCEPT_TOKEN;
+  static constexpr uint32_t MAX_REDUCE_LENGTH = Tables::MAX_REDUCE_LENGTH;
+  static constexpr size_t INITIAL_STACK_SIZE = 16 * (MAX_REDUCE_LENGTH + 1);
+#ifdef SIICC_PARSE_PROFILE
+  static constexpr bool PROFILE = true;
+#else
+  static constexpr bool PROFILE = false;
+#endif
+
+  // Whether a lexer's token id is a terminal, so it indexes the action
+  // columns and not the goto ones.
+  static constexpr bool ShouldShift(uint32_t next_id) {
+    return next_id > 0 && next_id <= TERMINATOR_COUNT;
+  }
+
+  static NodePtr Parse(std::shared_ptr<LexerType> lexer) {
+    return Run<false>(*lexer, nullptr, RecoveryOptions());
+  }
+
+  // Repairs syntax errors instead of throwing and reports them in `errors`.
+  // Throws only when neither a local repair nor the error token applies.
+  static NodePtr Parse(std::shared_ptr<LexerType> lexer,
+                       std::vector<SyntaxError> &errors,
+                       const RecoveryOptions &options = RecoveryOptions()) {
+    return Run<true>(*lexer, &errors, options);
+  }
+
+private:
+  // Tokens read ahead by the repair search, handed out before the lexer is
+  // asked again.
+  struct Lookahead {
+    std::deque<Token> pending_;
+    size_t read_ = 0;
+  };
+
+  template <bool RECOVER>
+  static NodePtr Run(LexerType &lexer, std::vector<SyntaxError> *errors,
+                     const RecoveryOptions &options) {
+    std::vector<int32_t> state_stack;
+    std::vector<NodePtr> ast_stack;
+    state_stack.reserve(INITIAL_STACK_SIZE);
+    ast_stack.reserve(INITIAL_STACK_SIZE);
+    int32_t current_state = 0;
+    state_stack.push_back(current_state);
+
+    Lookahead lookahead;
+    auto next = [&]() {
+      if constexpr (RECOVER) {
+        if (!lookahead.pending_.empty()) {
+          auto token = std::move(lookahead.pending_.front());
+          lookahead.pending_.pop_front();
+          return token;
+        }
+        lookahead.read_++;
+      }
+      return Lex(lexer);
+    };
+    auto next_token = next();
+    uint32_t next_id = static_cast<uint32_t>(next_token.type_);
+    while (true) {
+      if constexpr (PROFILE) {
+        ParseProfile<Tables>::Get().Visit(current_state);
+      }
+      int32_t action = Tables::Action(current_state, next_id);
+      if (action == 0) {
+        if constexpr (RECOVER) {
+          Recover(state_stack, ast_stack, next_token, lookahead, lexer,
+                  *errors, options);
+          current_state = state_stack.back();
+          next_id = static_cast<uint32_t>(next_token.type_);
+          continue;
+        } else {
+          throw ParseError(std::string(Tables::DEBUG_INFO_TABLE[next_id - 1]) +
+                               " not accpeted",
+                           next_token.offset_);
+        }
+      } else if (action > 0) {
+        if constexpr (PROFILE) {
+          ParseProfile<Tables>::Get().Shift(current_state, state_stack.size());
+        }
+        ast_stack.push_back(Tables::CreateNode(next_id, next_token.value_));
+        SpanToken(*ast_stack.back(), next_token);
+        state_stack.push_back(action);
+        current_state = action;
+        next_token = next();
+        next_id = static_cast<uint32_t>(next_token.type_);
+      } else {
+        auto accepted = Reduce(state_stack, ast_stack, -action);
+        if (accepted) {
+          return accepted;
+        }
+        current_state = state_stack.back();
+      }
+    }
+  }
+
+  static Token Lex(LexerType &lexer) {
+    auto token = lexer.Next();
+    if (!ShouldShift(static_cast<uint32_t>(token.type_))) {
+      throw ParseError("Token id " +
+                           std::to_string(static_cast<uint32_t>(token.type_)) +
+                           " is not a terminal",
+                       token.offset_);
+    }
+    if constexpr (PROFILE) {
+      ParseProfile<Tables>::Get().Token(static_cast<uint32_t>(token.type_));
+    }
+    return token;
+  }
+
+  // Returns the tree once the start symbol is reduced, null otherwise.
+  static NodePtr Reduce(std::vector<int32_t> &state_stack,
+                        std::vector<NodePtr> &ast_stack, uint32_t production) {
+    if constexpr (PROFILE) {
+      ParseProfile<Tables>::Get().Reduce(production);
+    }
+    uint32_t reduce_count = Tables::reduce_length[production];
+    uint32_t new_token = Tables::reduce_result[production];
+    auto new_AST_Node = Tables::CreateNode(new_token, nullptr);
+    auto first_child = ast_stack.end() - reduce_count;
+    new_AST_Node->children_.assign(std::make_move_iterator(first_child),
+                                   std::make_move_iterator(ast_stack.end()));
+    SpanChildren(*new_AST_Node);
+    if (new_token == ACCEPT_TOKEN) {
+      return new_AST_Node;
+    }
+    ast_stack.erase(first_child, ast_stack.end());
+    state_stack.resize(state_stack.size() - reduce_count);
+    state_stack.push_back(Tables::Goto(state_stack.back(), new_token));
+    ast_stack.push_back(std::move(new_AST_Node));
+    return nullptr;
+  }
+
+  // Reduces as needed and shifts a token the trial parse has accepted. The
+  // token is not in the input, its leaf spans `offset`.
+  static void Shift(std::vector<int32_t> &state_stack,
+                    std::vector<NodePtr> &ast_stack, uint32_t terminal,
+                    uint32_t offset) {
+    while (true) {
+      int32_t action = Tables::Action(state_stack.back(), terminal);
+      if (action > 0) {
+        if constexpr (PROFILE) {
+          ParseProfile<Tables>::Get().Shift(state_stack.back(),
+                                            state_stack.size());
+        }
+        ast_stack.push_back(Tables::CreateNode(terminal, nullptr));
+        ast_stack.back()->begin_ = ast_stack.back()->end_ = offset;
+        state_stack.push_back(action);
+        return;
+      }
+      if (action == 0 || Reduce(state_stack, ast_stack, -action)) {
+        throw std::logic_error("Repair rejected by the parser");
+      }
+    }
+  }
+
+  // State stack of a trial parse: the untouched bottom of the real stack
+  // plus what the trial pushed, so a trial never copies the real stack.
+  struct TrialStack {
+    const std::vector<int32_t> *base_;
+    size_t base_size_;
+    std::vector<int32_t> pushed_;
+
+    int32_t Top() const {
+      return pushed_.empty() ? (*base_)[base_size_ - 1] : pushed_.back();
+    }
+    void Pop(size_t count) {
+      size_t from_pushed = std::min(count, pushed_.size());
+      pushed_.resize(pushed_.size() - from_pushed);
+      base_size_ -= count - from_pushed;
+    }
+  };
+
+  enum class Trial { Error, Shifted, Accepted };
+
+  static Trial Feed(TrialStack &stack, uint32_t terminal) {
+    while (true) {
+      int32_t action = Tables::Action(stack.Top(), terminal);
+      if (action == 0) {
+        return Trial::Error;
+      } else if (action > 0) {
+        stack.pushed_.push_back(action);
+        return Trial::Shifted;
+      }
+      uint32_t production = -action;
+      uint32_t new_token = Tables::reduce_result[production];
+      if (new_token == ACCEPT_TOKEN) {
+        return Trial::Accepted;
+      }
+      stack.Pop(Tables::reduce_length[production]);
+      stack.pushed_.push_back(Tables::Goto(stack.Top(), new_token));
+    }
+  }
+
+  static bool Check(TrialStack stack, const uint32_t *begin,
+                    const uint32_t *end) {
+    for (auto iter = begin; iter != end; iter++) {
+      auto result = Feed(stack, *iter);
+      if (result == Trial::Error) {
+        return false;
+      } else if (result == Trial::Accepted) {
+        return true;
+      }
+    }
+    return true;
+  }
+
+  // Depth first over `remain` more inserted terminals, each of which has to
+  // be shifted, followed by the check tokens [begin, end).
+  static bool TryInsertions(const TrialStack &stack, uint32_t remain,
+                            const uint32_t *begin, const uint32_t *end,
+                            std::vector<uint32_t> &inserted, size_t &budget) {
+    if (remain == 0) {
+      return Check(stack, begin, end);
+    }
+    for (uint32_t terminal = 1; terminal <= TERMINATOR_COUNT && budget > 0;
+         terminal++) {
+      if (terminal == Tables::END_TOKEN || terminal == Tables::ERROR_TOKEN) {
+        continue;
+      }
+      budget--;
+      TrialStack trial = stack;
+      if (Feed(trial, terminal) != Trial::Shifted) {
+        continue;
+      }
+      inserted.push_back(terminal);
+      if (TryInsertions(trial, remain - 1, begin, end, inserted, budget)) {
+        return true;
+      }
+      inserted.pop_back();
+    }
+    return false;
+  }
+
+  static std::string Describe(const char *what,
+                              const std::vector<uint32_t> &terminals) {
+    std::string result;
+    for (auto terminal : terminals) {
+      result += result.empty() ? what : " ";
+      result += Tables::DEBUG_INFO_TABLE[terminal - 1];
+    }
+    return result;
+  }
+
+  // Tries the cheapest local repair first: up to max_edits_ tokens inserted
+  // before or deleted at the error token (an insertion and a deletion
+  // together count as one replacement) such that the next check_tokens_
+  // tokens parse. Failing that, pops to the nearest state that shifts the
+  // error token and skips input until it fits again.
+  static void Recover(std::vector<int32_t> &state_stack,
+                      std::vector<NodePtr> &ast_stack, Token &next_token,
+                      Lookahead &lookahead, LexerType &lexer,
+                      std::vector<SyntaxError> &errors,
+                      const RecoveryOptions &options) {
+    size_t token_index = lookahead.read_ - 1 - lookahead.pending_.size();
+    uint32_t error_id = static_cast<uint32_t>(next_token.type_);
+    uint32_t error_offset = next_token.offset_;
+    std::string message = std::string("unexpected ") +
+                          Tables::DEBUG_INFO_TABLE[error_id - 1];
+
+    std::vector<uint32_t> window = {error_id};
+    for (const auto &token : lookahead.pending_) {
+      if (window.back() == Tables::END_TOKEN) {
+        break;
+      }
+      window.push_back(static_cast<uint32_t>(token.type_));
+    }
+    while (window.back() != Tables::END_TOKEN &&
+           window.size() < options.max_edits_ + options.check_tokens_ + 1) {
+      lookahead.pending_.push_back(Lex(lexer));
+      lookahead.read_++;
+      window.push_back(static_cast<uint32_t>(lookahead.pending_.back().type_));
+    }
+    auto advance = [&]() {
+      if (lookahead.pending_.empty()) {
+        lookahead.read_++;
+        next_token = Lex(lexer);
+      } else {
+        next_token = std::move(lookahead.pending_.front());
+        lookahead.pending_.pop_front();
+      }
+    };
+
+    // The end token is never deleted.
+    size_t deletable = window.size() - (window.back() == Tables::END_TOKEN);
+    TrialStack stack{&state_stack, state_stack.size(), {}};
+    size_t budget = options.max_candidates_;
+    std::vector<uint32_t> inserted;
+    for (uint32_t cost = 1; cost <= options.max_edits_ && budget > 0; cost++) {
+      for (uint32_t deleted = 0; deleted <= std::min<size_t>(cost, deletable);
+           deleted++) {
+        for (uint32_t insert_count = 0; insert_count <= cost; insert_count++) {
+          if (std::max(deleted, insert_count) != cost) {
+            continue;
+          }
+          size_t check_end = std::min<size_t>(
+              window.size(), deleted + options.check_tokens_);
+          if (!TryInsertions(stack, insert_count, window.data() + deleted,
+                             window.data() + check_end, inserted, budget)) {
+            continue;
+          }
+          std::vector<uint32_t> removed(window.begin(),
+                                        window.begin() + deleted);
+          for (uint32_t i = 0; i < deleted; i++) {
+            advance();
+          }
+          for (auto terminal : inserted) {
+            Shift(state_stack, ast_stack, terminal, error_offset);
+          }
+          errors.push_back(
+              {token_index,
+               message + Describe(", deleted ", removed) +
+                   Describe(", inserted ", inserted),
+               error_offset});
+          return;
+        }
+      }
+    }
+
+    if (Tables::ERROR_TOKEN == 0) {
+      throw ParseError(std::string(Tables::DEBUG_INFO_TABLE[error_id - 1]) +
+                           " not accpeted",
+                       error_offset);
+    }
+    while (true) {
+      TrialStack trial{&state_stack, state_stack.size(), {}};
+      if (Feed(trial, Tables::ERROR_TOKEN) == Trial::Shifted) {
+        break;
+      }
+      if (state_stack.size() == 1) {
+        throw ParseError(
+            std::string(Tables::DEBUG_INFO_TABLE[error_id - 1]) +
+                " not accpeted",
+            error_offset);
+      }
+      state_stack.pop_back();
+      ast_stack.pop_back();
+    }
+    Shift(state_stack, ast_stack, Tables::ERROR_TOKEN, error_offset);
+    size_t skipped = 0;
+    while (true) {
+      uint32_t terminal = static_cast<uint32_t>(next_token.type_);
+      TrialStack trial{&state_stack, state_stack.size(), {}};
+      if (Feed(trial, terminal) != Trial::Error) {
+        break;
+      }
+      if (terminal == Tables::END_TOKEN) {
+        throw ParseError(
+            std::string(Tables::DEBUG_INFO_TABLE[error_id - 1]) +
+                " not accpeted",
+            error_offset);
+      }
+      advance();
+      skipped++;
+    }
+    errors.push_back({token_index,
+                      message + ", resumed at error, skipped " +
+                          std::to_string(skipped) + " tokens",
+                      error_offset});
+  }
+};
+} // namespace siicc
@@ -1,82 +1,189 @@
 #include "LALR_table_generator.h"
+#include <chrono>
 
 namespace siicc {
 namespace LALR {
+const char *ConstructionModeName(ConstructionMode mode) {
+  switch (mode) {
+  case ConstructionMode::LR0:
+    return "lr0";
+  case ConstructionMode::SLR:
+    return "slr";
+  case ConstructionMode::LALR:
+    return "lalr";
+  case ConstructionMode::IELR:
+    return "ielr";
+  case ConstructionMode::LR1:
+    return "lr1";
+  }
+  return "";
+}
 
-std::string KernelItem::to_string() const {
-  std::stringstream ss;
-  ss << production_->head_->to_string() << " -> ";
-  for (uint32_t i = 0; i < production_->body_.size(); i++) {
-    if (i == matched_) {
-      ss << "*";
+ConstructionMode ParseConstructionMode(const std::string &name) {
+  for (auto mode : {ConstructionMode::LR0, ConstructionMode::SLR,
+                    ConstructionMode::LALR, ConstructionMode::IELR,
+                    ConstructionMode::LR1}) {
+    if (name == ConstructionModeName(mode)) {
+      return mode;
     }
-    ss << production_->body_[i]->to_string() << " ";
-  }
-  if (matched_ == production_->body_.size())
-    ss << "*";
-  ss << "    : ";
-  for (const auto &token : end_with_) {
-    ss << token->to_string() << " ";
   }
-  ss << "\n";
-  return ss.str();
+  throw std::invalid_argument("Unknown construction mode: " + name);
 }
 
-std::string NormalItem::to_string(
-    std::map<std::string, ProductionPtrVec> &production_of) const {
-  const auto &productions = production_of[head_->name_];
+std::string GrammarReduction::to_string() const {
   std::stringstream ss;
-  for (const auto &production : productions) {
-    ss << head_->to_string() << " -> *";
-    for (const auto &token : production->body_) {
-      ss << token->to_string() << " ";
+  auto list = [&ss](const char *title, const TokenPtrVec &tokens) {
+    if (tokens.empty()) {
+      return;
     }
-    ss << "    : ";
-    for (const auto &token : end_with_) {
-      ss << token->to_string() << " ";
+    ss << title << ":";
+    for (const auto &token : tokens) {
+      ss << " " << token->to_string();
     }
     ss << "\n";
+  };
+  list("unproductive nonterminators", unproductive_);
+  list("unreachable nonterminators", unreachable_);
+  list("unused terminators", unused_terminators_);
+  if (!removed_productions_.empty()) {
+    ss << "removed productions: " << removed_productions_.size() << "\n";
   }
   return ss.str();
 }
 
-bool Closure::operator==(const KernelItemVec &other) const {
-  if (kernel_items_.size() != other.size())
-    return false;
-  for (const auto &kernel_item : kernel_items_) {
-    if (std::find(other.cbegin(), other.cend(), kernel_item) == other.end()) {
-      return false;
-    }
+GrammarReduction ReduceGrammar(Grammar &grammar) {
+  if (grammar.start_ == nullptr) {
+    throw std::invalid_argument("start not specified.");
   }
-  return true;
-}
+  GrammarReduction reduction;
+  auto drop_productions = [&](const TokenPtrSet &gone) {
+    auto &productions = grammar.productions_;
+    auto mentions = [&gone](const ProductionPtr &production) {
+      return gone.count(production->head_) ||
+             std::any_of(production->body_.begin(), production->body_.end(),
+                         [&gone](const TokenPtr &token) {
+                           return gone.count(token) > 0;
+                         });
+    };
+    for (const auto &production : productions) {
+      if (mentions(production)) {
+        reduction.removed_productions_.push_back(production);
+      }
+    }
+    productions.erase(
+        std::remove_if(productions.begin(), productions.end(), mentions),
+        productions.end());
+    for (const auto &token : gone) {
+      grammar.nonterminators_.erase(token);
+    }
+  };
 
-bool Closure::operator==(const Closure &other) const {
-  return *this == other.kernel_items_;
-}
+  // A nonterminal is productive once one of its productions has nothing
+  // but terminals, blank and productive nonterminals.
+  TokenPtrSet productive;
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (const auto &production : grammar.productions_) {
+      if (productive.count(production->head_)) {
+        continue;
+      }
+      if (std::all_of(production->body_.begin(), production->body_.end(),
+                      [&productive](const TokenPtr &token) {
+                        return token->type_ != Token::Type::Nonterminator ||
+                               productive.count(token) > 0;
+                      })) {
+        productive.insert(production->head_);
+        changed = true;
+      }
+    }
+  }
+  if (!productive.count(grammar.start_)) {
+    throw std::invalid_argument("Start symbol derives no terminal string: " +
+                                grammar.start_->to_string());
+  }
+  TokenPtrSet unproductive;
+  for (const auto &token : grammar.nonterminators_) {
+    if (!productive.count(token)) {
+      unproductive.insert(token);
+      reduction.unproductive_.push_back(token);
+    }
+  }
+  drop_productions(unproductive);
 
-std::string Closure::to_string(
-    std::map<std::string, ProductionPtrVec> &production_of) const {
-  std::stringstream ss;
-  for (const auto &item : kernel_items_) {
-    ss << item.to_string();
+  std::map<TokenPtr, ProductionPtrVec, TokenPtrLess> productions_of;
+  for (const auto &production : grammar.productions_) {
+    productions_of[production->head_].push_back(production);
   }
-  for (const auto &item : normal_items_) {
-    ss << item.to_string(production_of);
+  TokenPtrSet reachable = {grammar.start_};
+  TokenPtrSet used_terminators;
+  std::vector<TokenPtr> pending = {grammar.start_};
+  while (!pending.empty()) {
+    auto head = pending.back();
+    pending.pop_back();
+    for (const auto &production : productions_of[head]) {
+      // A %prec tag such as UMINUS may appear in no body at all.
+      if (production->prec_) {
+        used_terminators.insert(production->prec_);
+      }
+      const auto &body = production->body_;
+      for (const auto &token : body) {
+        // Blank is only kept by a production of blank alone, elsewhere
+        // BuildProductionsOf strips it.
+        if (token->type_ == Token::Type::BLANK && body.size() > 1) {
+          continue;
+        }
+        if (token->type_ != Token::Type::Nonterminator) {
+          used_terminators.insert(token);
+        } else if (reachable.insert(token).second) {
+          pending.push_back(token);
+        }
+      }
+    }
   }
-  return ss.str();
-}
+  TokenPtrSet unreachable;
+  for (const auto &token : grammar.nonterminators_) {
+    if (!reachable.count(token)) {
+      unreachable.insert(token);
+      reduction.unreachable_.push_back(token);
+    }
+  }
+  drop_productions(unreachable);
 
-std::optional<size_t> Closure::GetNormalItem(TokenPtr token) {
-  for (size_t i = 0; i < normal_items_.size(); i++) {
-    if (normal_items_[i] == token) {
-      return i;
+  for (const auto &token : {grammar.end_, grammar.error_}) {
+    if (token) {
+      used_terminators.insert(token);
+    }
+  }
+  for (auto iter = grammar.terminators_.begin();
+       iter != grammar.terminators_.end();) {
+    if (used_terminators.count(*iter)) {
+      iter++;
+      continue;
     }
+    reduction.unused_terminators_.push_back(*iter);
+    grammar.keywords_.erase(*iter);
+    grammar.precedence_.erase(*iter);
+    iter = grammar.terminators_.erase(iter);
   }
-  return std::nullopt;
+  grammar.productions_of_.clear();
+  return reduction;
 }
 
-LALRTableGenerator::LALRTableGenerator(const Grammar &grammar) {
+std::string GenerationReport::to_string() const {
+  std::stringstream ss;
+  ss << "mode: " << ConstructionModeName(mode_) << "\n";
+  ss << "states: " << state_count_ << "\n";
+  ss << "table bytes: " << table_bytes_ << "\n";
+  ss << "generation time: " << milliseconds_ << " ms\n";
+  ss << "peak rss: " << peak_rss_kb_ << " KiB\n";
+  return ss.str();
+}
+
+
+LALRTableGenerator::LALRTableGenerator(const Grammar &grammar,
+                                       ConstructionMode mode, bool glr)
+    : mode_(mode), glr_(glr) {
   if (grammar.blank_ == nullptr) {
     throw std::invalid_argument("blank not specified.");
   }
@@ -87,15 +194,19 @@ LALRTableGenerator::LALRTableGenerator(const Grammar &grammar) {
     throw std::invalid_argument("start not specified.");
   }
   
-  GrammarPtr new_grammer = std::make_shared<Grammar>();
-  *new_grammer = grammar;
+  // A deep copy: the ids written below and by LALRParserGenerator stay
+  // with this generator, so one grammar can feed several at once.
+  GrammarPtr new_grammer = std::make_shared<Grammar>(grammar.Clone());
+  auto old_start = new_grammer->start_;
   auto new_start = NewNonTerminator("START");
 
-
   new_grammer->start_ = new_start;
   new_grammer->nonterminators_.insert(new_start);
+  if (new_grammer->error_) {
+    new_grammer->terminators_.insert(new_grammer->error_);
+  }
   auto new_production =
-      std::make_shared<Production>(new_start, TokenPtrVec{grammar.start_});
+      std::make_shared<Production>(new_start, TokenPtrVec{old_start});
   new_grammer->productions_.insert(new_grammer->productions_.begin(),
                                    new_production);
   new_grammer->BuildProductionsOf();
@@ -113,65 +224,911 @@ LALRTableGenerator::LALRTableGenerator(const Grammar &grammar) {
   for (auto &nonterminator : grammar_->nonterminators_) {
     nonterminator->id_ = ++idx;
   }
+  IndexGrammar();
+}
+
+// Numbers productions and nonterminals for the items and precomputes what
+// building closures needs from the grammar.
+void LALRTableGenerator::IndexGrammar() {
+  productions_.assign(1, nullptr);
+  for (const auto &production : grammar_->productions_) {
+    if (production->body_.size() > MAX_ITEM_DOT) {
+      throw std::invalid_argument("Production body longer than " +
+                                  std::to_string(MAX_ITEM_DOT) +
+                                  " symbols: " + production->to_string());
+    }
+    productions_.push_back(production);
+  }
+  if (productions_.size() > (1ull << (32 - ITEM_DOT_BITS))) {
+    throw std::invalid_argument("Too many productions");
+  }
+  nonterminals_.assign(grammar_->nonterminators_.begin(),
+                       grammar_->nonterminators_.end());
+  nonterminal_index_.clear();
+  for (uint32_t i = 0; i < nonterminals_.size(); i++) {
+    nonterminal_index_[nonterminals_[i]] = i;
+  }
+  productions_by_head_.assign(nonterminals_.size(), {});
+  body_nonterminals_.assign(productions_.size(), {});
+  symbols_ = nonterminals_;
+  std::map<TokenPtr, uint32_t, TokenPtrLess> symbol_index(
+      nonterminal_index_.begin(), nonterminal_index_.end());
+  body_symbols_.assign(productions_.size(), {});
+  for (uint32_t i = 1; i < productions_.size(); i++) {
+    const auto &production = productions_[i];
+    auto head = nonterminal_index_.find(production->head_);
+    if (head == nonterminal_index_.end()) {
+      throw std::invalid_argument("Production head is not a nonterminator: " +
+                                  production->to_string());
+    }
+    productions_by_head_[head->second].push_back(i);
+    for (const auto &token : production->body_) {
+      auto iter = token->type_ == Token::Type::Nonterminator
+                      ? nonterminal_index_.find(token)
+                      : nonterminal_index_.end();
+      body_nonterminals_[i].push_back(
+          iter == nonterminal_index_.end() ? NOT_NONTERMINAL : iter->second);
+      auto symbol = symbol_index.emplace(token, symbols_.size());
+      if (symbol.second) {
+        symbols_.push_back(token);
+      }
+      body_symbols_[i].push_back(symbol.first->second);
+    }
+  }
+  bucket_of_symbol_.assign(symbols_.size(), NO_BUCKET);
+  ComputePredictions();
+}
+
+// Every nonterminal predicts itself and the nonterminals its productions
+// start with, and then whatever those predict.
+void LALRTableGenerator::ComputePredictions() {
+  size_t words = (nonterminals_.size() + 63) / 64;
+  predictions_.assign(nonterminals_.size(), std::vector<uint64_t>(words, 0));
+  std::vector<std::vector<uint32_t>> starts(nonterminals_.size());
+  auto set = [](std::vector<uint64_t> &bits, uint32_t i) {
+    bits[i / 64] |= uint64_t(1) << (i % 64);
+  };
+  for (uint32_t i = 0; i < nonterminals_.size(); i++) {
+    set(predictions_[i], i);
+    for (auto production : productions_by_head_[i]) {
+      auto first = body_nonterminals_[production].front();
+      if (first != NOT_NONTERMINAL) {
+        starts[i].push_back(first);
+        set(predictions_[i], first);
+      }
+    }
+  }
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (uint32_t i = 0; i < nonterminals_.size(); i++) {
+      for (auto start : starts[i]) {
+        for (size_t w = 0; w < words; w++) {
+          auto merged = predictions_[i][w] | predictions_[start][w];
+          if (merged != predictions_[i][w]) {
+            predictions_[i][w] = merged;
+            changed = true;
+          }
+        }
+      }
+    }
+  }
+}
+
+std::string LALRTableGenerator::ClosureToString(const Closure &closure) const {
+  std::stringstream ss;
+  auto print_item = [&](const ProductionPtr &production, uint32_t dot,
+                        const TokenPtrSet &lookaheads) {
+    ss << production->head_->to_string() << " -> ";
+    for (uint32_t i = 0; i < production->body_.size(); i++) {
+      if (i == dot) {
+        ss << "*";
+      }
+      ss << production->body_[i]->to_string() << " ";
+    }
+    if (dot == production->body_.size())
+      ss << "*";
+    ss << "    : ";
+    for (const auto &token : lookaheads) {
+      ss << token->to_string() << " ";
+    }
+    ss << "\n";
+  };
+  for (size_t i = 0; i < closure.kernel_items_.size(); i++) {
+    auto item = closure.kernel_items_[i];
+    print_item(ProductionOf(item), ItemDot(item),
+               closure.kernel_lookaheads_[i]);
+  }
+  for (size_t i = 0; i < closure.normal_items_.size(); i++) {
+    for (auto production : productions_by_head_[closure.normal_items_[i]]) {
+      print_item(productions_[production], 0, closure.normal_lookaheads_[i]);
+    }
+  }
+  return ss.str();
 }
 
 void LALRTableGenerator::GenerateLALRTable() {
-  KernelItem begin_closure_kernel_item(
-      grammar_->productions_of_[grammar_->start_->name_][0], 0);
-  begin_closure_kernel_item.end_with_ = {grammar_->end_};
+  auto begin_time = std::chrono::steady_clock::now();
+  closures_.clear();
+  action_.clear();
+  reduce_.clear();
+  conflicts_.clear();
+  closure_index_.clear();
+  {
+    PhaseTimer timer(stats_, "first sets");
+    ComputeFirstSets();
+  }
 
-  auto begin_closure_pair = GetClosure({begin_closure_kernel_item});
+  // Production 1 is START -> start.
+  auto begin_closure_pair = GetClosure({MakeItem(1, 0)}, {{grammar_->end_}});
   auto &begin_closure = begin_closure_pair.second;
 
   std::queue<ClosurePtr> queue;
   queue.push(begin_closure);
+  {
+    PhaseTimer timer(stats_, "states");
+    BuildStates(queue);
+  }
+  {
+    PhaseTimer timer(stats_, "lookaheads");
+    switch (mode_) {
+    case ConstructionMode::LR0:
+    case ConstructionMode::SLR:
+      AssignLR0Lookaheads();
+      break;
+    case ConstructionMode::LALR:
+      PropagateLookaheads(closures_);
+      break;
+    case ConstructionMode::IELR:
+      MergeLR1States();
+      break;
+    case ConstructionMode::LR1:
+      break;
+    }
+  }
+  {
+    PhaseTimer timer(stats_, "reduces");
+    for (const auto &closure : closures_) {
+      BuildReduces(closure);
+    }
+  }
+
+  report_.mode_ = mode_;
+  report_.state_count_ = closures_.size();
+  report_.table_bytes_ =
+      closures_.size() *
+      (grammar_->terminators_.size() + grammar_->nonterminators_.size()) *
+      sizeof(int32_t);
+  report_.milliseconds_ = std::chrono::duration<double, std::milli>(
+                              std::chrono::steady_clock::now() - begin_time)
+                              .count();
+  report_.peak_rss_kb_ = PeakRssKb();
+
+  if (stats_) {
+    stats_->states_ += closures_.size();
+    for (const auto &closure : closures_) {
+      uint64_t items =
+          closure->kernel_items_.size() + closure->normal_items_.size();
+      stats_->kernel_items_ += closure->kernel_items_.size();
+      stats_->normal_items_ += closure->normal_items_.size();
+      stats_->max_items_per_state_ =
+          std::max(stats_->max_items_per_state_, items);
+      stats_->transitions_ += EdgesOf(closure).size();
+    }
+    stats_->peak_rss_kb_ = std::max(stats_->peak_rss_kb_, report_.peak_rss_kb_);
+  }
+}
+
+// Without lookahead propagation a complete item reduces on FOLLOW of its head
+// (SLR) or on every terminal (LR(0)).
+void LALRTableGenerator::AssignLR0Lookaheads() {
+  TokenPtrSet all_terminators(grammar_->terminators_.begin(),
+                              grammar_->terminators_.end());
+  all_terminators.insert(grammar_->end_);
+  if (mode_ == ConstructionMode::SLR) {
+    PhaseTimer timer(stats_, "follow sets");
+    ComputeFollowSets();
+  }
+  for (const auto &closure : closures_) {
+    for (size_t i = 0; i < closure->kernel_items_.size(); i++) {
+      const auto &head = ProductionOf(closure->kernel_items_[i])->head_;
+      auto &lookaheads = closure->kernel_lookaheads_[i];
+      if (head == grammar_->start_) {
+        lookaheads = {grammar_->end_};
+        continue;
+      }
+      lookaheads =
+          mode_ == ConstructionMode::SLR ? follow_of_[head] : all_terminators;
+    }
+  }
+}
+
+// Canonical LR(1) states sharing an LR(0) core are merged greedily as long as
+// the union of their lookaheads gives no token to two productions. The
+// partition is then refined until each block moves to a single block on every
+// symbol, so the merged automaton stays deterministic. When LALR(1) has no
+// conflicts this yields exactly the LALR(1) states.
+void LALRTableGenerator::MergeLR1States() {
+  typedef std::map<uint32_t, TokenPtrSet> ReduceLookaheads;
+  auto reduce_lookaheads_of = [&](const ClosurePtr &closure) {
+    ReduceLookaheads result;
+    for (size_t i = 0; i < closure->kernel_items_.size(); i++) {
+      auto item = closure->kernel_items_[i];
+      if (ItemDot(item) == ProductionOf(item)->body_.size()) {
+        result[ItemProduction(item)] = closure->kernel_lookaheads_[i];
+      }
+    }
+    return result;
+  };
+  auto compatible = [](const ReduceLookaheads &lhs,
+                       const ReduceLookaheads &rhs) {
+    for (const auto &[production, tokens] : rhs) {
+      for (const auto &[other, other_tokens] : lhs) {
+        if (other == production)
+          continue;
+        for (const auto &token : tokens) {
+          if (other_tokens.count(token)) {
+            return false;
+          }
+        }
+      }
+    }
+    return true;
+  };
+
+  // The kernel items are the LR(0) core.
+  std::map<ItemVec, std::vector<size_t>> blocks_of_core;
+  std::vector<ReduceLookaheads> block_lookaheads;
+  std::map<ClosurePtr, size_t> block_of;
+  for (const auto &closure : closures_) {
+    auto lookaheads = reduce_lookaheads_of(closure);
+    auto &candidates = blocks_of_core[closure->kernel_items_];
+    auto iter = std::find_if(candidates.begin(), candidates.end(),
+                             [&](size_t block) {
+                               return compatible(block_lookaheads[block],
+                                                 lookaheads);
+                             });
+    size_t block;
+    if (iter != candidates.end()) {
+      block = *iter;
+    } else {
+      block = block_lookaheads.size();
+      block_lookaheads.emplace_back();
+      candidates.push_back(block);
+    }
+    for (const auto &[production, tokens] : lookaheads) {
+      block_lookaheads[block][production].insert(tokens.begin(), tokens.end());
+    }
+    block_of[closure] = block;
+  }
+
+  size_t block_count = block_lookaheads.size();
+  while (true) {
+    typedef std::vector<std::pair<TokenPtr, size_t>> Moves;
+    std::map<std::pair<size_t, Moves>, size_t> signatures;
+    std::map<ClosurePtr, size_t> refined;
+    for (const auto &closure : closures_) {
+      Moves moves;
+      for (const auto &[token, next_closure] : EdgesOf(closure)) {
+        moves.emplace_back(token, block_of[next_closure]);
+      }
+      auto key = std::make_pair(block_of[closure], std::move(moves));
+      refined[closure] =
+          signatures.emplace(std::move(key), signatures.size()).first->second;
+    }
+    block_of = std::move(refined);
+    if (signatures.size() == block_count) {
+      break;
+    }
+    block_count = signatures.size();
+  }
+
+  std::vector<ClosurePtr> representative(block_count);
+  std::vector<ClosurePtr> closures;
+  std::vector<EdgeVec> action;
+  for (const auto &closure : closures_) {
+    auto &kept = representative[block_of[closure]];
+    if (kept == nullptr) {
+      kept = closure;
+      closures.push_back(closure);
+      action.push_back(std::move(EdgesOf(closure)));
+      continue;
+    }
+    // Same core, so the items line up.
+    for (size_t i = 0; i < kept->kernel_items_.size(); i++) {
+      const auto &other = closure->kernel_lookaheads_[i];
+      kept->kernel_lookaheads_[i].insert(other.begin(), other.end());
+    }
+  }
+  closures_ = std::move(closures);
+  action_ = std::move(action);
+  for (size_t i = 0; i < closures_.size(); i++) {
+    closures_[i]->id_ = i + 1;
+    for (auto &[token, next_closure] : action_[i]) {
+      next_closure = representative[block_of[next_closure]];
+    }
+    ComputeClosureLookaheads(closures_[i]);
+  }
+  RebuildClosureIndex();
+}
+
+void LALRTableGenerator::BuildStates(std::queue<ClosurePtr> &queue) {
   while (!queue.empty()) {
     auto closure = queue.front();
     queue.pop();
-    auto next_token_set = GetNextTokens(closure);
-    for (const auto &token : next_token_set) {
-      if (token->type_ == Token::Type::BLANK)
+    BuildTransitions(closure, queue);
+  }
+}
+
+void LALRTableGenerator::BuildTransitions(const ClosurePtr &closure,
+                                          std::queue<ClosurePtr> &queue) {
+  if (SplitsLookaheads()) {
+    ComputeClosureLookaheads(closure);
+  }
+  // One pass over the items moves each dot over its symbol into the bucket of
+  // that symbol. Buckets keep the order symbols are first seen in, which is
+  // the order new states are numbered in.
+  {
+    PhaseTimer timer(stats_, "goto");
+    buckets_.clear();
+    auto advance = [&](uint32_t symbol, Item item,
+                       const TokenPtrSet &lookaheads) {
+      auto &bucket = bucket_of_symbol_[symbol];
+      if (bucket == NO_BUCKET) {
+        bucket = buckets_.size();
+        buckets_.emplace_back();
+        buckets_.back().first = symbol;
+      }
+      buckets_[bucket].second.emplace_back(
+          item, SplitsLookaheads() ? lookaheads : TokenPtrSet());
+    };
+    for (size_t i = 0; i < closure->kernel_items_.size(); i++) {
+      auto item = closure->kernel_items_[i];
+      const auto &symbols = body_symbols_[ItemProduction(item)];
+      if (ItemDot(item) != symbols.size()) {
+        advance(symbols[ItemDot(item)], item + 1,
+                closure->kernel_lookaheads_[i]);
+      }
+    }
+    for (size_t i = 0; i < closure->normal_items_.size(); i++) {
+      for (auto production : productions_by_head_[closure->normal_items_[i]]) {
+        advance(body_symbols_[production].front(), MakeItem(production, 1),
+                closure->normal_lookaheads_[i]);
+      }
+    }
+    for (auto &[symbol, kernel] : buckets_) {
+      bucket_of_symbol_[symbol] = NO_BUCKET;
+      std::sort(kernel.begin(), kernel.end(),
+                [](const auto &lhs, const auto &rhs) {
+                  return lhs.first < rhs.first;
+                });
+    }
+  }
+
+  auto buckets = std::move(buckets_);
+  EdgeVec edges;
+  for (auto &[symbol, kernel] : buckets) {
+    const auto &token = symbols_[symbol];
+    if (token->type_ == Token::Type::BLANK)
+      continue;
+    ItemVec kernel_items;
+    std::vector<TokenPtrSet> kernel_lookaheads;
+    for (auto &[item, lookaheads] : kernel) {
+      kernel_items.push_back(item);
+      kernel_lookaheads.push_back(std::move(lookaheads));
+    }
+    auto next_closure_pair =
+        GetClosure(std::move(kernel_items), std::move(kernel_lookaheads));
+    const auto &next_closure = next_closure_pair.second;
+    edges.push_back({token, next_closure});
+    if (trace_) {
+      *trace_ << "------------------------\n";
+      *trace_ << ClosureToString(*closure) << " >> " << token->to_string()
+              << " >> \n"
+              << ClosureToString(*next_closure);
+      *trace_ << "------------------------\n";
+    }
+    if (!next_closure_pair.first) {
+      queue.push(next_closure);
+    }
+  }
+  buckets_ = std::move(buckets);
+  std::sort(edges.begin(), edges.end(), EdgeLess);
+  EdgesOf(closure) = std::move(edges);
+}
+
+void LALRTableGenerator::PropagateLookaheads(
+    const std::vector<ClosurePtr> &closures) {
+  std::queue<ClosurePtr> queue;
+  std::set<ClosurePtr> queued;
+  for (const auto &closure : closures) {
+    queue.push(closure);
+    queued.insert(closure);
+  }
+  auto propagate = [&](const TokenPtrSet &end_with, const ClosurePtr &next,
+                       Item item) {
+    auto index = next->GetKernelItem(item);
+    if (!index.has_value()) {
+      return;
+    }
+    auto &lookaheads = next->kernel_lookaheads_[*index];
+    auto old_size = lookaheads.size();
+    lookaheads.insert(end_with.begin(), end_with.end());
+    if (lookaheads.size() != old_size && queued.insert(next).second) {
+      queue.push(next);
+    }
+  };
+  while (!queue.empty()) {
+    auto closure = queue.front();
+    queue.pop();
+    queued.erase(closure);
+    if (stats_) {
+      stats_->lookahead_visits_++;
+    }
+    ComputeClosureLookaheads(closure);
+    const auto &edges = EdgesOf(closure);
+    for (size_t i = 0; i < closure->kernel_items_.size(); i++) {
+      auto item = closure->kernel_items_[i];
+      const auto &body = ProductionOf(item)->body_;
+      if (ItemDot(item) == body.size())
         continue;
-      auto next_closure_pair = GetNextClosureFor(token, closure);
-      const auto &next_closure = next_closure_pair.second;
-      action_[closure][token] = next_closure;
-#ifdef DEBUG_MODE
-      std::cerr << "------------------------\n";
-      std::cerr << closure->to_string(grammar_->productions_of_) << " >> "
-                << token->to_string() << " >> \n"
-                << next_closure->to_string(grammar_->productions_of_);
-      std::cerr << "------------------------\n";
-#endif
-      if (!next_closure_pair.first) {
-        queue.push(next_closure);
-      }
-    }
-
-    for (const auto &kernel_item : closure->kernel_items_) {
-      if (kernel_item.matched_ == kernel_item.production_->body_.size() ||
-          (kernel_item.production_->body_.size() == 1 &&
-           kernel_item.production_->body_.front()->type_ ==
-               Token::Type::BLANK)) {
-        for (const auto &token : kernel_item.end_with_) {
-          if (token->type_ == Token::Type::BLANK)
+      if (auto edge = FindEdge(edges, body[ItemDot(item)])) {
+        propagate(closure->kernel_lookaheads_[i], edge->next_, item + 1);
+      }
+    }
+    for (size_t i = 0; i < closure->normal_items_.size(); i++) {
+      for (auto production : productions_by_head_[closure->normal_items_[i]]) {
+        const auto &first = productions_[production]->body_.front();
+        if (auto edge = FindEdge(edges, first)) {
+          propagate(closure->normal_lookaheads_[i], edge->next_,
+                    MakeItem(production, 1));
+        }
+      }
+    }
+  }
+}
+
+void LALRTableGenerator::ComputeClosureLookaheads(const ClosurePtr &closure) {
+  for (auto &lookaheads : closure->normal_lookaheads_) {
+    lookaheads.clear();
+  }
+  for (size_t i = 0; i < closure->kernel_items_.size(); i++) {
+    auto item = closure->kernel_items_[i];
+    auto production = ItemProduction(item);
+    auto dot = ItemDot(item);
+    const auto &body = productions_[production]->body_;
+    if (dot == body.size() ||
+        body_nonterminals_[production][dot] == NOT_NONTERMINAL) {
+      continue;
+    }
+    auto &end_with = closure->normal_lookaheads_[*closure->GetNormalItem(
+        body_nonterminals_[production][dot])];
+    if (InsertFirstOf(body, dot + 1, end_with)) {
+      const auto &kernel_end_with = closure->kernel_lookaheads_[i];
+      end_with.insert(kernel_end_with.begin(), kernel_end_with.end());
+    }
+  }
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (size_t i = 0; i < closure->normal_items_.size(); i++) {
+      for (auto production : productions_by_head_[closure->normal_items_[i]]) {
+        auto first = body_nonterminals_[production].front();
+        if (first == NOT_NONTERMINAL)
+          continue;
+        auto &end_with =
+            closure->normal_lookaheads_[*closure->GetNormalItem(first)];
+        auto old_size = end_with.size();
+        if (InsertFirstOf(productions_[production]->body_, 1, end_with)) {
+          const auto &head_end_with = closure->normal_lookaheads_[i];
+          end_with.insert(head_end_with.begin(), head_end_with.end());
+        }
+        changed |= end_with.size() != old_size;
+      }
+    }
+  }
+}
+
+// Shift-reduce conflicts are settled with the precedence of the lookahead
+// and of the production the way yacc does it. The shift stays in action_ so
+// the automaton is unchanged; a reduce entry next to it wins, and a null
+// production marks a %nonassoc error. In GLR mode the remaining conflicts are
+// kept in conflicts_ next to the first action.
+void LALRTableGenerator::BuildReduces(const ClosurePtr &closure) {
+  auto &reduce = reduce_[closure];
+  reduce.clear();
+  conflicts_.erase(closure);
+  const auto &edges = EdgesOf(closure);
+  for (size_t i = 0; i < closure->kernel_items_.size(); i++) {
+    auto item = closure->kernel_items_[i];
+    const auto &production = ProductionOf(item);
+    if (ItemDot(item) == production->body_.size() ||
+        (production->body_.size() == 1 &&
+         production->body_.front()->type_ == Token::Type::BLANK)) {
+      for (const auto &token : closure->kernel_lookaheads_[i]) {
+        if (token->type_ == Token::Type::BLANK)
+          continue;
+        if (reduce.find(token) != reduce.end()) {
+          if (glr_) {
+            conflicts_[closure][token].push_back(production);
             continue;
-          if (reduce_[closure].find(token) != reduce_[closure].end()) {
-            throw std::invalid_argument(
-                std::string("Reduce-Reduce confliction found: ") +
-                token->to_string());
           }
-          if (action_[closure].find(token) != action_[closure].end()) {
-            throw std::invalid_argument(
-                std::string("Shift-Reduce confliction found: ") +
-                token->to_string());
+          throw std::invalid_argument(
+              std::string("Reduce-Reduce confliction found: ") +
+              token->to_string());
+        }
+        if (!FindEdge(edges, token)) {
+          reduce[token] = production;
+          continue;
+        }
+        auto token_precedence = grammar_->PrecedenceOf(token);
+        auto production_precedence = grammar_->PrecedenceOf(production);
+        if (!token_precedence.has_value() ||
+            !production_precedence.has_value()) {
+          if (glr_) {
+            conflicts_[closure][token].push_back(production);
+            continue;
           }
-          reduce_[closure][token] = kernel_item.production_;
+          throw std::invalid_argument(
+              std::string("Shift-Reduce confliction found: ") +
+              token->to_string());
+        }
+        if (production_precedence->level_ > token_precedence->level_ ||
+            (production_precedence->level_ == token_precedence->level_ &&
+             token_precedence->associativity_ == Associativity::Left)) {
+          reduce[token] = production;
+        } else if (production_precedence->level_ == token_precedence->level_ &&
+                   token_precedence->associativity_ ==
+                       Associativity::NonAssoc) {
+          reduce[token] = nullptr;
         }
       }
     }
   }
 }
 
+static bool SameProduction(const ProductionPtr &lhs, const ProductionPtr &rhs) {
+  if (lhs->head_->name_ != rhs->head_->name_ ||
+      lhs->body_.size() != rhs->body_.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < lhs->body_.size(); i++) {
+    if (lhs->body_[i]->name_ != rhs->body_[i]->name_ ||
+        lhs->body_[i]->type_ != rhs->body_[i]->type_) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::pair<ProductionPtrVec, ProductionPtrVec>
+LALRTableGenerator::DiffProductions(const Grammar &prev, const Grammar &next) {
+  auto missing_from = [](const ProductionPtrVec &from,
+                         const ProductionPtrVec &in) {
+    ProductionPtrVec result;
+    for (const auto &production : from) {
+      if (std::none_of(in.begin(), in.end(), [&](const ProductionPtr &other) {
+            return SameProduction(production, other);
+          })) {
+        result.push_back(production);
+      }
+    }
+    return result;
+  };
+  return {missing_from(next.productions_, prev.productions_),
+          missing_from(prev.productions_, next.productions_)};
+}
+
+void LALRTableGenerator::UpdateProductions(const ProductionPtrVec &added,
+                                           const ProductionPtrVec &removed) {
+  if (closures_.empty()) {
+    throw std::invalid_argument("Table not generated yet.");
+  }
+  if (mode_ != ConstructionMode::LALR) {
+    throw std::invalid_argument(
+        "Incremental update is only supported in LALR mode.");
+  }
+  TokenPtrSet changed_heads;
+  std::set<ProductionPtr> removed_productions;
+  for (const auto &production : removed) {
+    auto iter = std::find_if(
+        grammar_->productions_.begin(), grammar_->productions_.end(),
+        [&](const ProductionPtr &other) {
+          return SameProduction(production, other);
+        });
+    if (iter == grammar_->productions_.end()) {
+      throw std::invalid_argument("Removed production not in grammar: " +
+                                  production->to_string());
+    }
+    if (*iter == grammar_->productions_.front()) {
+      throw std::invalid_argument("Can not remove the start production.");
+    }
+    changed_heads.insert((*iter)->head_);
+    removed_productions.insert(*iter);
+    grammar_->productions_.erase(iter);
+  }
+  // The grammar holds its own tokens, see Grammar::Clone: the added
+  // productions are rebuilt from those, new symbols are copied in.
+  auto own = [this](const TokenPtr &token) -> TokenPtr {
+    if (!token) {
+      return token;
+    }
+    if (token->type_ == Token::Type::BLANK) {
+      return grammar_->blank_;
+    }
+    auto &symbols = token->type_ == Token::Type::Nonterminator
+                        ? grammar_->nonterminators_
+                        : grammar_->terminators_;
+    auto iter = symbols.find(token);
+    if (iter == symbols.end()) {
+      iter = symbols.insert(std::make_shared<Token>(*token)).first;
+    }
+    return *iter;
+  };
+  for (const auto &production : added) {
+    if (production->head_->type_ != Token::Type::Nonterminator) {
+      throw std::invalid_argument("Production head is not nonterminator");
+    }
+    TokenPtrVec body;
+    for (const auto &token : production->body_) {
+      body.push_back(own(token));
+    }
+    auto head = own(production->head_);
+    changed_heads.insert(head);
+    grammar_->productions_.push_back(
+        std::make_shared<Production>(head, body, own(production->prec_)));
+  }
+  grammar_->productions_of_.clear();
+  grammar_->BuildProductionsOf();
+  uint32_t idx = 0;
+  for (auto &production : grammar_->productions_) {
+    production->id_ = ++idx;
+  }
+  // The items still use the old numbering until RemapClosures.
+  auto old_productions = std::move(productions_);
+  auto old_nonterminals = std::move(nonterminals_);
+
+  auto old_first_of = std::move(first_of_);
+  ComputeFirstSets();
+  TokenPtrSet changed_first;
+  for (const auto &[token, first] : first_of_) {
+    auto iter = old_first_of.find(token);
+    if (iter == old_first_of.end() || iter->second != first) {
+      changed_first.insert(token);
+    }
+  }
+
+  // States whose LR(0) closure or closure lookaheads depend on the diff.
+  auto depends_on_changed_first = [&](const TokenPtrVec &body, size_t from) {
+    for (size_t i = from; i < body.size(); i++) {
+      if (changed_first.count(body[i])) {
+        return true;
+      }
+    }
+    return false;
+  };
+  std::vector<ClosurePtr> affected;
+  for (const auto &closure : closures_) {
+    bool is_affected = false;
+    for (auto item : closure->kernel_items_) {
+      const auto &production = old_productions[ItemProduction(item)];
+      is_affected |= removed_productions.count(production) > 0 ||
+                     depends_on_changed_first(production->body_,
+                                              ItemDot(item) + 1);
+    }
+    for (auto nonterminal : closure->normal_items_) {
+      const auto &head = old_nonterminals[nonterminal];
+      if (changed_heads.count(head)) {
+        is_affected = true;
+        break;
+      }
+      for (const auto &production : grammar_->productions_of_[head->name_]) {
+        is_affected |= depends_on_changed_first(production->body_, 1);
+      }
+    }
+    if (is_affected) {
+      affected.push_back(closure);
+    }
+  }
+  IndexGrammar();
+  RemapClosures(old_productions, old_nonterminals);
+
+  // Lookaheads can only have changed in states reachable from an affected
+  // one, by its old transitions or its new ones: a state an affected one no
+  // longer leads to may still be reachable by another path, with lookaheads
+  // that came through the dropped edge.
+  std::set<ClosurePtr> region;
+  std::vector<ClosurePtr> stack;
+  for (const auto &closure : affected) {
+    for (const auto &[token, next_closure] : EdgesOf(closure)) {
+      if (region.insert(next_closure).second) {
+        stack.push_back(next_closure);
+      }
+    }
+  }
+
+  // Dropping the items of removed productions can leave two states with one
+  // kernel, which a fresh build has as one state. The first is kept and
+  // rebuilt, edges to the others go to it, and the others become
+  // unreachable; what they fed stays in the region through them.
+  std::map<ClosurePtr, ClosurePtr> merged_into;
+  for (auto &[kernel, candidates] : closure_index_) {
+    if (candidates.size() < 2) {
+      continue;
+    }
+    for (size_t i = 1; i < candidates.size(); i++) {
+      merged_into[candidates[i]] = candidates.front();
+      if (region.insert(candidates[i]).second) {
+        stack.push_back(candidates[i]);
+      }
+    }
+    if (std::find(affected.begin(), affected.end(), candidates.front()) ==
+        affected.end()) {
+      affected.push_back(candidates.front());
+    }
+    candidates.resize(1);
+  }
+  if (!merged_into.empty()) {
+    affected.erase(std::remove_if(affected.begin(), affected.end(),
+                                  [&](const ClosurePtr &closure) {
+                                    return merged_into.count(closure) > 0;
+                                  }),
+                   affected.end());
+    for (const auto &closure : closures_) {
+      if (merged_into.count(closure)) {
+        continue;
+      }
+      for (auto &edge : EdgesOf(closure)) {
+        auto iter = merged_into.find(edge.next_);
+        if (iter != merged_into.end()) {
+          edge.next_ = iter->second;
+        }
+      }
+    }
+  }
+
+  size_t old_closure_count = closures_.size();
+  std::queue<ClosurePtr> queue;
+  for (const auto &closure : affected) {
+    BuildNormalItems(closure);
+    BuildTransitions(closure, queue);
+  }
+  BuildStates(queue);
+  for (size_t i = old_closure_count; i < closures_.size(); i++) {
+    affected.push_back(closures_[i]);
+  }
+  for (const auto &closure : affected) {
+    if (region.insert(closure).second) {
+      stack.push_back(closure);
+    }
+  }
+  // States about to become unreachable still have their edges here, so
+  // what they fed is in the region as well.
+  while (!stack.empty()) {
+    auto closure = stack.back();
+    stack.pop_back();
+    for (const auto &[token, next_closure] : EdgesOf(closure)) {
+      if (region.insert(next_closure).second) {
+        stack.push_back(next_closure);
+      }
+    }
+  }
+  RemoveUnreachableClosures();
+  // Everything else keeps its lookaheads and seeds the propagation.
+  std::vector<ClosurePtr> worklist;
+  for (const auto &closure : closures_) {
+    if (region.count(closure)) {
+      for (auto &lookaheads : closure->kernel_lookaheads_) {
+        lookaheads.clear();
+      }
+      worklist.push_back(closure);
+      continue;
+    }
+    for (const auto &[token, next_closure] : EdgesOf(closure)) {
+      if (region.count(next_closure)) {
+        worklist.push_back(closure);
+        break;
+      }
+    }
+  }
+  closures_.front()->kernel_lookaheads_.front().insert(grammar_->end_);
+  PropagateLookaheads(worklist);
+  for (const auto &closure : closures_) {
+    if (region.count(closure)) {
+      BuildReduces(closure);
+    }
+  }
+}
+
+void LALRTableGenerator::RemoveUnreachableClosures() {
+  std::set<ClosurePtr> reachable = {closures_.front()};
+  std::vector<ClosurePtr> stack = {closures_.front()};
+  while (!stack.empty()) {
+    auto closure = stack.back();
+    stack.pop_back();
+    for (const auto &[token, next_closure] : EdgesOf(closure)) {
+      if (reachable.insert(next_closure).second) {
+        stack.push_back(next_closure);
+      }
+    }
+  }
+  std::vector<ClosurePtr> closures;
+  std::vector<EdgeVec> action;
+  for (const auto &closure : closures_) {
+    if (reachable.count(closure)) {
+      closures.push_back(closure);
+      action.push_back(std::move(EdgesOf(closure)));
+    } else {
+      reduce_.erase(closure);
+      conflicts_.erase(closure);
+    }
+  }
+  closures_ = std::move(closures);
+  action_ = std::move(action);
+  for (size_t i = 0; i < closures_.size(); i++) {
+    closures_[i]->id_ = i + 1;
+  }
+  RebuildClosureIndex();
+}
+
+// Renumbers the items of every state after IndexGrammar. Items of removed
+// productions are dropped; the states holding them are rebuilt or become
+// unreachable.
+void LALRTableGenerator::RemapClosures(
+    const std::vector<ProductionPtr> &old_productions,
+    const TokenPtrVec &old_nonterminals) {
+  std::map<ProductionPtr, uint32_t> production_index;
+  for (uint32_t i = 1; i < productions_.size(); i++) {
+    production_index[productions_[i]] = i;
+  }
+  for (const auto &closure : closures_) {
+    std::vector<std::pair<Item, TokenPtrSet>> kernel;
+    for (size_t i = 0; i < closure->kernel_items_.size(); i++) {
+      auto item = closure->kernel_items_[i];
+      auto iter = production_index.find(old_productions[ItemProduction(item)]);
+      if (iter != production_index.end()) {
+        kernel.emplace_back(MakeItem(iter->second, ItemDot(item)),
+                            std::move(closure->kernel_lookaheads_[i]));
+      }
+    }
+    std::sort(kernel.begin(), kernel.end(),
+              [](const auto &lhs, const auto &rhs) {
+                return lhs.first < rhs.first;
+              });
+    closure->kernel_items_.clear();
+    closure->kernel_lookaheads_.clear();
+    for (auto &[item, lookaheads] : kernel) {
+      closure->kernel_items_.push_back(item);
+      closure->kernel_lookaheads_.push_back(std::move(lookaheads));
+    }
+
+    std::vector<std::pair<uint32_t, TokenPtrSet>> normal;
+    for (size_t i = 0; i < closure->normal_items_.size(); i++) {
+      normal.emplace_back(
+          nonterminal_index_.at(old_nonterminals[closure->normal_items_[i]]),
+          std::move(closure->normal_lookaheads_[i]));
+    }
+    std::sort(normal.begin(), normal.end(),
+              [](const auto &lhs, const auto &rhs) {
+                return lhs.first < rhs.first;
+              });
+    closure->normal_items_.clear();
+    closure->normal_lookaheads_.clear();
+    for (auto &[nonterminal, lookaheads] : normal) {
+      closure->normal_items_.push_back(nonterminal);
+      closure->normal_lookaheads_.push_back(std::move(lookaheads));
+    }
+  }
+  RebuildClosureIndex();
+}
+
+void LALRTableGenerator::RebuildClosureIndex() {
+  closure_index_.clear();
+  for (const auto &closure : closures_) {
+    closure_index_[closure->kernel_items_].push_back(closure);
+  }
+}
+
 void LALRTableGenerator::PrintLALRTable() {
   std::cout << std::setw(10) << "name";
   for (const auto &terminator : grammar_->terminators_) {
@@ -184,24 +1141,22 @@ void LALRTableGenerator::PrintLALRTable() {
   for (const auto &closure : closures_) {
     std::cout << std::setw(10) << std::to_string(closure->id_) + "|";
     for (const auto &terminator : grammar_->terminators_) {
-      if (action_[closure].find(terminator) != action_[closure].end()) {
+      if (reduce_[closure].find(terminator) != reduce_[closure].end()) {
+        const auto &production = reduce_[closure][terminator];
         std::cout << std::setw(10)
-                  << std::string("s") +
-                         std::to_string(action_[closure][terminator]->id_) +
-                         "|";
-      } else if (reduce_[closure].find(terminator) != reduce_[closure].end()) {
+                  << (production ? std::string("r") +
+                                       std::to_string(production->id_) + "|"
+                                 : std::string("e|"));
+      } else if (auto edge = FindEdge(EdgesOf(closure), terminator)) {
         std::cout << std::setw(10)
-                  << std::string("r") +
-                         std::to_string(reduce_[closure][terminator]->id_) +
-                         "|";
+                  << std::string("s") + std::to_string(edge->next_->id_) + "|";
       } else {
         std::cout << std::setw(10) << "|";
       }
     }
     for (const auto &nonterminator : grammar_->nonterminators_) {
-      if (action_[closure].find(nonterminator) != action_[closure].end()) {
-        std::cout << std::setw(10)
-                  << std::to_string(action_[closure][nonterminator]->id_) + "|";
+      if (auto edge = FindEdge(EdgesOf(closure), nonterminator)) {
+        std::cout << std::setw(10) << std::to_string(edge->next_->id_) + "|";
       } else {
         std::cout << std::setw(10) << "|";
       }
@@ -211,17 +1166,26 @@ void LALRTableGenerator::PrintLALRTable() {
 }
 
 std::pair<bool, ClosurePtr>
-LALRTableGenerator::GetClosure(KernelItemVec &&kernel_items) {
-  for (uint32_t i = 0; i < closures_.size(); i++) {
-    const auto &closure = closures_[i];
-    if (*closure == kernel_items) {
+LALRTableGenerator::GetClosure(ItemVec &&kernel_items,
+                               std::vector<TokenPtrSet> &&kernel_lookaheads) {
+  PhaseTimer timer(stats_, "closure");
+  if (stats_) {
+    stats_->closure_lookups_++;
+  }
+  auto &candidates = closure_index_[kernel_items];
+  for (const auto &closure : candidates) {
+    if (!SplitsLookaheads() ||
+        closure->kernel_lookaheads_ == kernel_lookaheads) {
+      if (stats_) {
+        stats_->closure_hits_++;
+      }
       return {true, closure};
     }
   }
 
   size_t blank_production_count = 0;
-  for (const auto &kernel_item : kernel_items) {
-    if (kernel_item.production_->body_.front()->type_ == Token::Type::BLANK) {
+  for (auto item : kernel_items) {
+    if (ProductionOf(item)->body_.front()->type_ == Token::Type::BLANK) {
       blank_production_count++;
       if (blank_production_count > 1) {
         throw std::invalid_argument("Found two blank production in one kernel");
@@ -231,138 +1195,104 @@ LALRTableGenerator::GetClosure(KernelItemVec &&kernel_items) {
 
   auto new_closure = std::make_shared<Closure>();
   new_closure->kernel_items_ = std::move(kernel_items);
+  new_closure->kernel_lookaheads_ = std::move(kernel_lookaheads);
   new_closure->id_ = closures_.size() + 1;
-  std::queue<TokenPtr> queue;
-  for (const auto &kernel_item : new_closure->kernel_items_) {
-    if (kernel_item.matched_ != kernel_item.production_->body_.size()) {
-      const auto &token = kernel_item.production_->body_[kernel_item.matched_];
-      auto normal_item_opt = new_closure->GetNormalItem(token);
-      size_t idx;
-      if (!normal_item_opt.has_value()) {
-        new_closure->normal_items_.push_back(NormalItem{token});
-        idx = new_closure->normal_items_.size() - 1;
-        queue.push(token);
-      }
-      auto &end_with = new_closure->normal_items_[idx].end_with_;
-      if (kernel_item.matched_ + 1 < kernel_item.production_->body_.size()) {
-        const auto &first = GetFirstOf(
-            kernel_item.production_->body_[kernel_item.matched_ + 1]);
-        end_with.insert(first.begin(), first.end());
-      } else {
-        end_with.insert(kernel_item.end_with_.begin(),
-                        kernel_item.end_with_.end());
-      }
-    }
-  }
-  while (!queue.empty()) {
-    auto token = queue.front();
-    queue.pop();
-    for (const auto &production : grammar_->productions_of_[token->name_]) {
-      if (production->body_.empty())
-        continue;
-      const auto &new_token = production->body_.front();
-      if (new_token->type_ != Token::Type::Nonterminator)
-        continue;
-      auto normal_item_opt = new_closure->GetNormalItem(new_token);
-      size_t idx;
-      if (!normal_item_opt.has_value()) {
-        queue.push(new_token);
-        new_closure->normal_items_.push_back(NormalItem{new_token});
-        idx = new_closure->normal_items_.size() - 1;
-      } else {
-        idx = normal_item_opt.value();
-      }
-      auto &end_with = new_closure->normal_items_[idx].end_with_;
-      if (production->body_.size() == 1) {
-        auto old_normal_item_idx = new_closure->GetNormalItem(token).value();
-        const auto &old_normal_item =
-            new_closure->normal_items_[old_normal_item_idx];
-        end_with.insert(old_normal_item.end_with_.begin(),
-                        old_normal_item.end_with_.end());
-      } else {
-        const auto &first = GetFirstOf(production->body_[1]);
-        end_with.insert(first.begin(), first.end());
-      }
-    }
-  }
+  BuildNormalItems(new_closure);
   closures_.emplace_back(new_closure);
+  action_.emplace_back();
+  candidates.push_back(new_closure);
   return {false, new_closure};
 }
 
-TokenPtrVec LALRTableGenerator::GetNextTokens(const ClosurePtr &closure) {
-  TokenPtrVec result;
-  for (const auto &kernel_item : closure->kernel_items_) {
-    if (kernel_item.matched_ != kernel_item.production_->body_.size()) {
-      const auto &token = kernel_item.production_->body_[kernel_item.matched_];
-      if (std::find(result.begin(), result.end(), token) == result.end()) {
-        result.push_back(token);
-      }
+// LR(0) part of the closure: one normal item per predicted nonterminal, the
+// union of the prediction sets of the nonterminals after the dots. Their
+// lookaheads are filled in by ComputeClosureLookaheads.
+void LALRTableGenerator::BuildNormalItems(const ClosurePtr &closure) {
+  std::vector<uint64_t> predicted((nonterminals_.size() + 63) / 64, 0);
+  for (auto item : closure->kernel_items_) {
+    auto production = ItemProduction(item);
+    auto dot = ItemDot(item);
+    if (dot == body_nonterminals_[production].size() ||
+        body_nonterminals_[production][dot] == NOT_NONTERMINAL) {
+      continue;
+    }
+    const auto &prediction =
+        predictions_[body_nonterminals_[production][dot]];
+    for (size_t w = 0; w < predicted.size(); w++) {
+      predicted[w] |= prediction[w];
     }
   }
-  for (const auto &normal_item : closure->normal_items_) {
-    for (const auto &production :
-         grammar_->productions_of_[normal_item.head_->name_]) {
-      if (!production->body_.empty()) {
-        const auto &token = production->body_.front();
-        if (std::find(result.begin(), result.end(), token) == result.end()) {
-          result.push_back(token);
+  closure->normal_items_.clear();
+  for (size_t w = 0; w < predicted.size(); w++) {
+    for (auto bits = predicted[w]; bits != 0; bits &= bits - 1) {
+      closure->normal_items_.push_back(w * 64 + __builtin_ctzll(bits));
+    }
+  }
+  closure->normal_lookaheads_.assign(closure->normal_items_.size(), {});
+}
+
+void LALRTableGenerator::ComputeFollowSets() {
+  follow_of_.clear();
+  follow_of_[grammar_->start_] = {grammar_->end_};
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (const auto &production : grammar_->productions_) {
+      const auto &body = production->body_;
+      for (size_t i = 0; i < body.size(); i++) {
+        if (body[i]->type_ != Token::Type::Nonterminator)
+          continue;
+        auto &follow = follow_of_[body[i]];
+        auto old_size = follow.size();
+        if (InsertFirstOf(body, i + 1, follow) && body[i] != production->head_) {
+          const auto &head_follow = follow_of_[production->head_];
+          follow.insert(head_follow.begin(), head_follow.end());
         }
+        changed |= follow.size() != old_size;
       }
     }
   }
-  return result;
 }
 
-std::pair<bool, ClosurePtr>
-LALRTableGenerator::GetNextClosureFor(const TokenPtr &token,
-                                      const ClosurePtr &closure) {
-  KernelItemVec new_closure_kernel;
-  for (const auto &kernel_item : closure->kernel_items_) {
-    if (kernel_item.matched_ != kernel_item.production_->body_.size() &&
-        kernel_item.production_->body_[kernel_item.matched_] == token) {
-      KernelItem new_item(kernel_item.production_, kernel_item.matched_ + 1);
-      new_item.end_with_ = kernel_item.end_with_;
-      new_closure_kernel.push_back(std::move(new_item));
-    }
+void LALRTableGenerator::ComputeFirstSets() {
+  first_of_.clear();
+  for (const auto &nonterminator : grammar_->nonterminators_) {
+    first_of_[nonterminator] = {};
   }
-  for (const auto &normal_item : closure->normal_items_) {
-    for (const auto &production :
-         grammar_->productions_of_[normal_item.head_->name_]) {
-      if (!production->body_.empty() && production->body_.front() == token) {
-        KernelItem new_item(production, 1);
-        new_item.end_with_ = normal_item.end_with_;
-        new_closure_kernel.push_back(std::move(new_item));
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (const auto &production : grammar_->productions_) {
+      auto &first = first_of_[production->head_];
+      auto old_size = first.size();
+      if (InsertFirstOf(production->body_, 0, first)) {
+        first.insert(grammar_->blank_);
       }
+      changed |= first.size() != old_size;
     }
   }
-  return GetClosure(std::move(new_closure_kernel));
 }
 
-const TokenPtrSet &LALRTableGenerator::getFollowOf(const TokenPtr &token) {
-  auto iter = follow_of_.find(token);
-  if (iter != follow_of_.end())
-    return iter->second;
-
-  follow_of_[token] = {};
-  if (token->type_ != Token::Type::Nonterminator) {
-    return follow_of_[token];
-  }
-
-  for (const auto &production : grammar_->productions_) {
-    if (production->body_.empty())
-      continue;
-    for (size_t i = 0; i + 1 < production->body_.size(); i++) {
-      if (production->body_[i] == token) {
-        const auto &other_follow = getFollowOf(production->body_[i + 1]);
-        follow_of_[token].insert(other_follow.begin(), other_follow.end());
+// Inserts FIRST(body[from..]) without blank into `result`. Returns true when
+// that suffix can derive blank, in which case the caller has to add whatever
+// follows it.
+bool LALRTableGenerator::InsertFirstOf(const TokenPtrVec &body, size_t from,
+                                       TokenPtrSet &result) {
+  for (size_t i = from; i < body.size(); i++) {
+    const auto &first = GetFirstOf(body[i]);
+    bool has_blank = false;
+    for (const auto &token : first) {
+      if (token == grammar_->blank_) {
+        has_blank = true;
+      } else {
+        result.insert(token);
       }
     }
-    if (production->body_.back() == token) {
-      const auto &other_follow = getFollowOf(production->head_);
-      follow_of_[token].insert(other_follow.begin(), other_follow.end());
+    if (!has_blank) {
+      return false;
     }
   }
-  return follow_of_[token];
+  return true;
 }
 
 const TokenPtrSet &LALRTableGenerator::GetFirstOf(const TokenPtr &token) {
@@ -370,32 +1300,11 @@ const TokenPtrSet &LALRTableGenerator::GetFirstOf(const TokenPtr &token) {
   if (iter != first_of_.end())
     return iter->second;
 
-  first_of_[token] = {};
+  auto &first = first_of_[token];
   if (token->type_ != Token::Type::Nonterminator) {
-    first_of_[token].insert(token);
-    return first_of_[token];
-  }
-
-  for (const auto &production : grammar_->productions_of_[token->name_]) {
-    bool blank_ntil_the_end = true;
-    for (size_t i = 0; i < production->body_.size(); i++) {
-      const auto &other_first = GetFirstOf(production->body_[i]);
-      first_of_[token].insert(other_first.begin(), other_first.end());
-      if (other_first.find(grammar_->blank_) == other_first.end()) {
-        blank_ntil_the_end = false;
-        break;
-      }
-    }
-    if (blank_ntil_the_end) {
-      const auto &follows = getFollowOf(production->head_);
-      for (const auto &follow : follows) {
-        const auto &other_first = GetFirstOf(follow);
-        first_of_[token].insert(other_first.begin(), other_first.end());
-      }
-    }
+    first.insert(token);
   }
-
-  return first_of_[token];
+  return first;
 }
 } // namespace LALR
-} // namespace siicc
\ No newline at end of file
+} // namespace siicc
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "LALR_common.h"
+#include "LALR_generation_stats.h"
 #include <algorithm>
 #include <iomanip>
 #include <iostream>
@@ -9,38 +10,207 @@
 
 namespace siicc {
 namespace LALR {
+// How lookaheads are attached to the automaton.
+//   LR0   reduce on every terminal.
+//   SLR   reduce on FOLLOW of the production head.
+//   LALR  lookaheads propagated over the LR(0) states.
+//   IELR  canonical LR(1) states sharing a core are merged unless the merge
+//         introduces a reduce-reduce conflict.
+//   LR1   canonical LR(1), states split by lookahead.
+enum class ConstructionMode { LR0, SLR, LALR, IELR, LR1 };
+
+const char *ConstructionModeName(ConstructionMode mode);
+ConstructionMode ParseConstructionMode(const std::string &name);
+
+// What ReduceGrammar took out of a grammar.
+struct GrammarReduction {
+  // Nonterminals that derive no string of terminals.
+  TokenPtrVec unproductive_;
+  // Nonterminals the start symbol never derives.
+  TokenPtrVec unreachable_;
+  // Terminals no remaining production uses, in its body or as its %prec.
+  TokenPtrVec unused_terminators_;
+  ProductionPtrVec removed_productions_;
+
+  bool Empty() const {
+    return unproductive_.empty() && unreachable_.empty() &&
+           unused_terminators_.empty();
+  }
+  std::string to_string() const;
+};
+
+// Removes unproductive nonterminals, then nonterminals unreachable from the
+// start symbol, with every production that mentions them, and finally the
+// terminals left unused, blank included. End and error are kept, blank_
+// stays set as the generator needs it as a marker. Run it on a grammar
+// before handing it to LALRTableGenerator; tables updated with
+// UpdateProductions need the full grammar, as later diffs may reach the
+// removed symbols. Throws when the start symbol itself is unproductive.
+GrammarReduction ReduceGrammar(Grammar &grammar);
+
+struct GenerationReport {
+  ConstructionMode mode_ = ConstructionMode::LALR;
+  size_t state_count_ = 0;
+  // Dense action and goto table, one int32_t per cell.
+  size_t table_bytes_ = 0;
+  double milliseconds_ = 0;
+  // Peak resident set of the whole process so far.
+  long peak_rss_kb_ = 0;
+
+  std::string to_string() const;
+};
+
 class LALRTableGenerator {
 public:
-  LALRTableGenerator(const Grammar &grammar);
+  // With `glr` set, conflicts precedence can not settle are kept as extra
+  // reductions in the conflict map instead of being reported.
+  LALRTableGenerator(const Grammar &grammar,
+                     ConstructionMode mode = ConstructionMode::LALR,
+                     bool glr = false);
 
   void GenerateLALRTable();
 
+  // Applies a production diff to an already generated table. Only states
+  // whose closures predict a changed nonterminal (or whose lookaheads depend
+  // on a FIRST set that changed) are rebuilt, states left with the same
+  // kernel are merged, lookaheads are re-propagated through the states
+  // reachable from rebuilt ones by their old or new transitions, and
+  // unreachable states are dropped and the rest renumbered. The result is
+  // the automaton of a fresh build up to state numbers, which diff_harness
+  // checks. Only supported in LALR mode.
+  void UpdateProductions(const ProductionPtrVec &added,
+                         const ProductionPtrVec &removed);
+
+  // Productions of `next` missing from `prev` and the other way round,
+  // compared by head and body names.
+  static std::pair<ProductionPtrVec, ProductionPtrVec>
+  DiffProductions(const Grammar &prev, const Grammar &next);
+
   void PrintLALRTable();
 
   auto MoveAction() { return std::move(action_); }
   auto MoveReduce() { return std::move(reduce_); }
   auto MoveClosures() { return std::move(closures_); }
   auto MoveGrammar() { return grammar_; }
+  auto MoveConflicts() { return std::move(conflicts_); }
+
+  const auto &GetAction() const { return action_; }
+  const auto &GetReduce() const { return reduce_; }
+  const auto &GetConflicts() const { return conflicts_; }
+  const auto &GetClosures() const { return closures_; }
+  const GenerationReport &Report() const { return report_; }
+
+  // Phase timers and counters go to `stats` when set.
+  void SetStats(GenerationStats *stats) { stats_ = stats; }
+  // Every state transition is written to `trace` when set.
+  void SetTrace(std::ostream *trace) { trace_ = trace; }
 
 private:
-  TokenPtrVec GetNextTokens(const ClosurePtr &closure);
+  void BuildStates(std::queue<ClosurePtr> &queue);
+
+  void BuildTransitions(const ClosurePtr &closure,
+                        std::queue<ClosurePtr> &queue);
+
+  void PropagateLookaheads(const std::vector<ClosurePtr> &closures);
+
+  void ComputeClosureLookaheads(const ClosurePtr &closure);
 
-  std::pair<bool, ClosurePtr> GetNextClosureFor(const TokenPtr &token,
-                                                const ClosurePtr &closure);
+  void AssignLR0Lookaheads();
 
-  std::pair<bool, ClosurePtr> GetClosure(KernelItemVec &&kernel_items);
+  void MergeLR1States();
 
-  const TokenPtrSet &getFollowOf(const TokenPtr &token);
+  bool SplitsLookaheads() const {
+    return mode_ == ConstructionMode::IELR || mode_ == ConstructionMode::LR1;
+  }
+
+  void BuildReduces(const ClosurePtr &closure);
+
+  void BuildNormalItems(const ClosurePtr &closure);
+
+  EdgeVec &EdgesOf(const ClosurePtr &closure) {
+    return action_[closure->id_ - 1];
+  }
+
+  bool IsLive(const ClosurePtr &closure) const {
+    return closure->id_ >= 1 && closure->id_ <= closures_.size() &&
+           closures_[closure->id_ - 1] == closure;
+  }
+
+  std::pair<bool, ClosurePtr>
+  GetClosure(ItemVec &&kernel_items,
+             std::vector<TokenPtrSet> &&kernel_lookaheads);
+
+  void RemoveUnreachableClosures();
+
+  void IndexGrammar();
+
+  void ComputePredictions();
+
+  void RemapClosures(const std::vector<ProductionPtr> &old_productions,
+                     const TokenPtrVec &old_nonterminals);
+
+  void RebuildClosureIndex();
+
+  std::string ClosureToString(const Closure &closure) const;
+
+  const ProductionPtr &ProductionOf(Item item) const {
+    return productions_[ItemProduction(item)];
+  }
+
+  void ComputeFirstSets();
+
+  bool InsertFirstOf(const TokenPtrVec &body, size_t from,
+                     TokenPtrSet &result);
+
+  void ComputeFollowSets();
 
   const TokenPtrSet &GetFirstOf(const TokenPtr &token);
 
 private:
+  static constexpr uint32_t NOT_NONTERMINAL = UINT32_MAX;
+
   std::vector<ClosurePtr> closures_;
+  // States by kernel. In IELR and LR1 mode several states share a kernel.
+  std::map<ItemVec, std::vector<ClosurePtr>> closure_index_;
+  // The grammar as IndexGrammar numbers it for the items. Production i is
+  // productions_[i], 0 is unused; nonterminal i is nonterminals_[i] in
+  // TokenPtrSet order. Independent of Token::id_ and Production::id_, which
+  // the parser generator renumbers.
+  std::vector<ProductionPtr> productions_;
+  TokenPtrVec nonterminals_;
+  std::map<TokenPtr, uint32_t, TokenPtrLess> nonterminal_index_;
+  // Productions of each nonterminal.
+  std::vector<std::vector<uint32_t>> productions_by_head_;
+  // Nonterminal index of every body symbol, NOT_NONTERMINAL for the others.
+  std::vector<std::vector<uint32_t>> body_nonterminals_;
+  // Every symbol found in a body, nonterminals first so a nonterminal's
+  // symbol index is its nonterminal index, and the symbol index of every
+  // body symbol.
+  TokenPtrVec symbols_;
+  std::vector<std::vector<uint32_t>> body_symbols_;
+  // Goto scratch, see BuildTransitions: the bucket of each symbol or
+  // NO_BUCKET, and the buckets of the state being expanded.
+  static constexpr uint32_t NO_BUCKET = UINT32_MAX;
+  std::vector<uint32_t> bucket_of_symbol_;
+  std::vector<std::pair<uint32_t, std::vector<std::pair<Item, TokenPtrSet>>>>
+      buckets_;
+  // Per nonterminal a bitset of the nonterminals it predicts, itself
+  // included: the LR(0) closure of an item with the dot in front of it.
+  std::vector<std::vector<uint64_t>> predictions_;
   GrammarPtr grammar_;
+  ConstructionMode mode_;
+  bool glr_;
+  GenerationReport report_;
+  GenerationStats *stats_ = nullptr;
+  std::ostream *trace_ = nullptr;
   std::map<TokenPtr, TokenPtrSet> follow_of_;
   std::map<TokenPtr, TokenPtrSet> first_of_;
-  std::map<ClosurePtr, std::map<TokenPtr, ClosurePtr>> action_;
+  // Transitions of closures_[i] at action_[i]; a state's id_ is i + 1.
+  std::vector<EdgeVec> action_;
   std::map<ClosurePtr, std::map<TokenPtr, ProductionPtr>> reduce_;
+  // Reductions competing with the shift or reduce already in action_ and
+  // reduce_ for the same token. Only filled in GLR mode.
+  std::map<ClosurePtr, std::map<TokenPtr, ProductionPtrVec>> conflicts_;
 };
 } // namespace LALR
 } // namespace siicc
\ No newline at end of file
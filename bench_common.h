@@ -0,0 +1,162 @@
+#pragma once
+
+// Shared by the bench_* and diff_harness executables. Include it from exactly
+// one translation unit per executable: it replaces the global operator new
+// and delete to count allocations.
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+namespace siicc {
+namespace bench {
+inline std::atomic<uint64_t> allocations{0};
+inline std::atomic<uint64_t> allocated_bytes{0};
+
+struct AllocationCount {
+  uint64_t count_;
+  uint64_t bytes_;
+
+  static AllocationCount Now() {
+    return {allocations.load(std::memory_order_relaxed),
+            allocated_bytes.load(std::memory_order_relaxed)};
+  }
+  AllocationCount operator-(const AllocationCount &other) const {
+    return {count_ - other.count_, bytes_ - other.bytes_};
+  }
+};
+
+inline double MillisecondsSince(std::chrono::steady_clock::time_point begin) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - begin)
+      .count();
+}
+
+// Resets the kernel's peak RSS counter, so PeakRssKb covers only what runs
+// after it. Linux only; elsewhere the peak stays that of the whole process.
+inline void ResetPeakRss() {
+  std::ofstream os("/proc/self/clear_refs");
+  os << "5";
+}
+
+// Parses a byte count with an optional K, M or G suffix, e.g. "64K".
+inline uint64_t ParseSize(const std::string &text) {
+  size_t used = 0;
+  uint64_t value = std::stoull(text, &used);
+  if (used + 1 == text.size()) {
+    switch (text.back()) {
+    case 'K': return value << 10;
+    case 'M': return value << 20;
+    case 'G': return value << 30;
+    }
+  }
+  if (used != text.size()) {
+    throw std::invalid_argument("Invalid size " + text);
+  }
+  return value;
+}
+
+// One result as a single line of JSON. Fields keep the order they are added
+// in; the lines of a run form a JSON Lines file.
+class Record {
+public:
+  explicit Record(const std::string &bench) { Add("bench", bench); }
+
+  Record &Add(const std::string &key, const std::string &value) {
+    auto &os = Key(key) << "\"";
+    for (char ch : value) {
+      if (ch == '"' || ch == '\\') {
+        os << '\\';
+      }
+      os << (ch == '\n' ? ' ' : ch);
+    }
+    os << "\"";
+    return *this;
+  }
+  Record &Add(const std::string &key, const char *value) {
+    return Add(key, std::string(value));
+  }
+  template <class T> Record &Add(const std::string &key, T value) {
+    Key(key) << value;
+    return *this;
+  }
+  // `json` is written as is.
+  Record &AddRaw(const std::string &key, const std::string &json) {
+    Key(key) << json;
+    return *this;
+  }
+
+  // Appends the fields of `object`, a JSON object on one line.
+  Record &Merge(const std::string &object) {
+    auto begin = object.find('{');
+    auto end = object.rfind('}');
+    if (begin == std::string::npos || end == std::string::npos || end <= begin) {
+      throw std::invalid_argument("Not a JSON object: " + object);
+    }
+    auto fields = object.substr(begin + 1, end - begin - 1);
+    if (fields.find_first_not_of(' ') != std::string::npos) {
+      (ss_.tellp() > 0 ? ss_ << ", " : ss_) << fields;
+    }
+    return *this;
+  }
+
+  std::string to_string() const { return "{" + ss_.str() + "}\n"; }
+
+private:
+  std::ostream &Key(const std::string &key) {
+    if (ss_.tellp() > 0) {
+      ss_ << ", ";
+    }
+    ss_ << "\"" << key << "\": ";
+    return ss_;
+  }
+
+  std::stringstream ss_;
+};
+
+// Writes records to stdout, and appends them to `path` when it is set.
+class RecordSink {
+public:
+  explicit RecordSink(const std::string &path) {
+    if (!path.empty()) {
+      file_.open(path, std::ios::app);
+      if (!file_) {
+        throw std::invalid_argument("Can not open " + path);
+      }
+    }
+  }
+
+  void Write(const Record &record) {
+    auto line = record.to_string();
+    std::cout << line << std::flush;
+    if (file_.is_open()) {
+      file_ << line << std::flush;
+    }
+  }
+
+private:
+  std::ofstream file_;
+};
+} // namespace bench
+} // namespace siicc
+
+void *operator new(std::size_t size) {
+  siicc::bench::allocations.fetch_add(1, std::memory_order_relaxed);
+  siicc::bench::allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+  if (void *p = std::malloc(size ? size : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+void *operator new[](std::size_t size) { return operator new(size); }
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
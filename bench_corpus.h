@@ -0,0 +1,125 @@
+#pragma once
+
+#include "LALR_common.h"
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace siicc {
+namespace bench {
+// An LALR(1) grammar whose states, productions and terminals grow linearly
+// with `size`: `size` statement keywords, each followed by an expression and
+// `;`, over `size` levels of left-associative binary operators.
+//
+//   Program ::= Statements
+//   Statements ::= Statement | Statements Statement
+//   Statement ::= kw<j> E0 ;                       for j < size
+//   E<i> ::= E<i> op<i> E<i+1> | E<i+1>            for i < size
+//   E<size> ::= id | ( E0 )
+inline LALR::Grammar SyntheticGrammar(uint32_t size) {
+  using namespace LALR;
+  Grammar grammar;
+  auto blank = NewBlank();
+  auto end = NewTerminator("end", "$");
+  auto id = NewTerminator("id", "id");
+  auto semicolon = NewTerminator("semicolon", ";");
+  auto lparen = NewTerminator("lparen", "(");
+  auto rparen = NewTerminator("rparen", ")");
+  auto program = NewNonTerminator("Program");
+  auto statements = NewNonTerminator("Statements");
+  auto statement = NewNonTerminator("Statement");
+  grammar.start_ = program;
+  grammar.end_ = end;
+  grammar.blank_ = blank;
+  grammar.terminators_ = {blank, end, id, semicolon, lparen, rparen};
+  grammar.nonterminators_ = {program, statements, statement};
+
+  TokenPtrVec levels;
+  for (uint32_t i = 0; i <= size; i++) {
+    levels.push_back(NewNonTerminator("E" + std::to_string(i)));
+    grammar.nonterminators_.insert(levels.back());
+  }
+  grammar.productions_ = {
+      std::make_shared<Production>(program, TokenPtrVec{statements}),
+      std::make_shared<Production>(statements, TokenPtrVec{statement}),
+      std::make_shared<Production>(statements,
+                                   TokenPtrVec{statements, statement}),
+  };
+  for (uint32_t j = 0; j < size; j++) {
+    auto keyword = NewTerminator("kw" + std::to_string(j),
+                                 "kw" + std::to_string(j));
+    grammar.terminators_.insert(keyword);
+    grammar.productions_.push_back(std::make_shared<Production>(
+        statement, TokenPtrVec{keyword, levels.front(), semicolon}));
+  }
+  for (uint32_t i = 0; i < size; i++) {
+    auto op = NewTerminator("op" + std::to_string(i), "op" + std::to_string(i));
+    grammar.terminators_.insert(op);
+    grammar.productions_.push_back(std::make_shared<Production>(
+        levels[i], TokenPtrVec{levels[i], op, levels[i + 1]}));
+    grammar.productions_.push_back(
+        std::make_shared<Production>(levels[i], TokenPtrVec{levels[i + 1]}));
+  }
+  grammar.productions_.push_back(
+      std::make_shared<Production>(levels.back(), TokenPtrVec{id}));
+  grammar.productions_.push_back(std::make_shared<Production>(
+      levels.back(), TokenPtrVec{lparen, levels.front(), rparen}));
+  return grammar;
+}
+
+// Random, syntactically valid input for the EBNF grammar parser of about
+// `bytes` bytes (never less). The same seed gives the same text.
+inline std::string SyntheticEBNF(uint64_t bytes, uint32_t seed = 1) {
+  std::mt19937 random(seed);
+  // Enough distinct names that longer inputs do not just repeat themselves.
+  uint32_t names = static_cast<uint32_t>(std::max<uint64_t>(16, bytes / 256));
+  auto pick = [&](uint32_t n) {
+    return std::uniform_int_distribution<uint32_t>(0, n - 1)(random);
+  };
+  auto rule = [&]() { return "<r" + std::to_string(pick(names)) + ">"; };
+
+  std::string text;
+  text.reserve(bytes + 256);
+  while (text.size() < bytes) {
+    text += rule();
+    text += " ::=";
+    uint32_t bodies = 1 + pick(3);
+    for (uint32_t b = 0; b < bodies; b++) {
+      if (b) {
+        text += " |";
+      }
+      uint32_t items = 1 + pick(5);
+      for (uint32_t i = 0; i < items; i++) {
+        text += " ";
+        switch (pick(5)) {
+        case 0: text += "t" + std::to_string(pick(names)); break;
+        case 1: text += rule(); break;
+        case 2: text += "{" + rule() + "}*"; break;
+        case 3: text += "{" + rule() + "}?"; break;
+        default: text += "{" + rule() + "}+"; break;
+        }
+      }
+    }
+    text += " ;\n";
+  }
+  return text;
+}
+
+// Frees a parse tree without recursing: trees of right recursive lists are
+// too deep for the recursive destructor.
+template <class NodePtr> void ReleaseTree(NodePtr root) {
+  std::vector<NodePtr> pending;
+  pending.push_back(std::move(root));
+  while (!pending.empty()) {
+    auto node = std::move(pending.back());
+    pending.pop_back();
+    if (node.use_count() == 1) {
+      for (auto &child : node->children_) {
+        pending.push_back(std::move(child));
+      }
+    }
+  }
+}
+} // namespace bench
+} // namespace siicc
@@ -0,0 +1,96 @@
+#include "bench_common.h"
+#include "bench_corpus.h"
+#include "LALR_parser_generator.h"
+#include "LALR_table_generator.h"
+#include <cstring>
+#include <limits>
+#include <sstream>
+
+// Times table and parser generation for synthetic grammars of growing size,
+// one JSON line per size:
+//
+//   bench_generate [--sizes 8,16,32,64,128] [--mode lalr] [--repeat 3]
+//                  [--out results.jsonl]
+//
+// `ms` is the fastest of the repeats, from the grammar to the emitted header
+// and source text; the other fields are from the last repeat.
+
+using namespace siicc::LALR;
+using namespace siicc::bench;
+
+static std::vector<uint32_t> ParseSizes(const std::string &text) {
+  std::vector<uint32_t> sizes;
+  std::stringstream ss(text);
+  std::string size;
+  while (std::getline(ss, size, ',')) {
+    sizes.push_back(static_cast<uint32_t>(std::stoul(size)));
+  }
+  return sizes;
+}
+
+int main(int argc, char **argv) {
+  std::vector<uint32_t> sizes = {8, 16, 32, 64, 128};
+  ConstructionMode mode = ConstructionMode::LALR;
+  uint32_t repeat = 3;
+  std::string out_path;
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "--sizes") == 0 && i + 1 < argc) {
+      sizes = ParseSizes(argv[++i]);
+    } else if (std::strcmp(argv[i], "--mode") == 0 && i + 1 < argc) {
+      mode = ParseConstructionMode(argv[++i]);
+    } else if (std::strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+      repeat = std::max(1, std::atoi(argv[++i]));
+    } else if (std::strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+      out_path = argv[++i];
+    } else {
+      throw std::invalid_argument(std::string("Unknown argument: ") + argv[i]);
+    }
+  }
+
+  RecordSink sink(out_path);
+  for (auto size : sizes) {
+    auto grammar = SyntheticGrammar(size);
+    double best_ms = std::numeric_limits<double>::max();
+    GenerationStats stats;
+    AllocationCount allocated{0, 0};
+    long peak_rss_kb = 0;
+    for (uint32_t run = 0; run < repeat; run++) {
+      stats = GenerationStats();
+      ResetPeakRss();
+      auto allocated_before = AllocationCount::Now();
+      auto begin = std::chrono::steady_clock::now();
+      {
+        LALRTableGenerator t_generator(grammar, mode);
+        t_generator.SetStats(&stats);
+        t_generator.GenerateLALRTable();
+        ParserGeneratorOptions options;
+        options.stats_ = &stats;
+        LALRParserGenerator p_generator(
+            t_generator.MoveAction(), t_generator.MoveReduce(),
+            t_generator.MoveClosures(), t_generator.MoveGrammar(), options);
+        std::stringstream header_stream, cpp_stream;
+        p_generator.OutputHeader(header_stream);
+        p_generator.OutputCpp("bench.h", cpp_stream);
+      }
+      best_ms = std::min(best_ms, MillisecondsSince(begin));
+      allocated = AllocationCount::Now() - allocated_before;
+      peak_rss_kb = PeakRssKb();
+    }
+
+    auto stats_json = stats.to_json();
+    stats_json.pop_back();
+    Record record("generate");
+    record.Add("size", size)
+        .Add("mode", ConstructionModeName(mode))
+        .Add("terminals", grammar.terminators_.size())
+        .Add("nonterminals", grammar.nonterminators_.size())
+        .Add("productions", grammar.productions_.size())
+        .Add("states", stats.states_)
+        .Add("ms", best_ms)
+        .Add("peak_rss_kb", peak_rss_kb)
+        .Add("allocations", allocated.count_)
+        .Add("allocated_bytes", allocated.bytes_)
+        .AddRaw("stats", stats_json);
+    sink.Write(record);
+  }
+}
@@ -0,0 +1,112 @@
+#include "bench_common.h"
+#include "bench_corpus.h"
+#include "LALR_EBNF_lexer.h"
+#include "LALR_generation_stats.h"
+#include "LALR_incremental.h"
+#include "LALR_parallel.h"
+#include "siicc_EBNF.h"
+#include <cstring>
+#include <limits>
+
+// Parses one synthetic EBNF input with ParallelParser on a growing number of
+// threads, one JSON line per thread count:
+//
+//   bench_parallel [--size 256M] [--threads 1,2,4,8] [--chunk 64K]
+//                  [--repeat 3] [--out results.jsonl]
+//
+// The thread counts default to the powers of two up to the hardware threads;
+// 1 is the serial parser. `--chunk` is ParallelOptions::chunk_tokens_. The
+// tree of a 256M input takes several GB. `ms` is the fastest of the repeats
+// and covers lexing and parsing up to the stitched tree, `speedup` is
+// relative to the first thread count.
+
+using namespace siicc;
+using namespace siicc::bench;
+
+namespace {
+class CountingLexer : public BNFLexer {
+public:
+  using BNFLexer::BNFLexer;
+  Token Next() override {
+    count_++;
+    return BNFLexer::Next();
+  }
+  uint64_t count_ = 0;
+};
+
+std::vector<uint32_t> ParseThreads(const std::string &text) {
+  std::vector<uint32_t> threads;
+  std::stringstream ss(text);
+  std::string count;
+  while (std::getline(ss, count, ',')) {
+    threads.push_back(std::max(1, std::stoi(count)));
+  }
+  return threads;
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  uint64_t size = 256 << 20;
+  uint32_t hardware = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<uint32_t> threads;
+  for (uint32_t count = 1; count < hardware; count *= 2) {
+    threads.push_back(count);
+  }
+  threads.push_back(hardware);
+  ParallelOptions options;
+  uint32_t repeat = 3;
+  std::string out_path;
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+      size = ParseSize(argv[++i]);
+    } else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      threads = ParseThreads(argv[++i]);
+    } else if (std::strcmp(argv[i], "--chunk") == 0 && i + 1 < argc) {
+      options.chunk_tokens_ = std::max<uint64_t>(1, ParseSize(argv[++i]));
+    } else if (std::strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+      repeat = std::max(1, std::atoi(argv[++i]));
+    } else if (std::strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+      out_path = argv[++i];
+    } else {
+      throw std::invalid_argument(std::string("Unknown argument: ") + argv[i]);
+    }
+  }
+
+  RecordSink sink(out_path);
+  auto text = SyntheticEBNF(size);
+  double base_ms = 0;
+  for (auto count : threads) {
+    options.threads_ = count;
+    double best_ms = std::numeric_limits<double>::max();
+    uint64_t tokens = 0;
+    long peak_rss_kb = 0;
+    for (uint32_t run = 0; run < repeat; run++) {
+      ResetPeakRss();
+      SpanBuf buf(text.data(), text.data() + text.size());
+      std::istream is(&buf);
+      auto lexer = std::make_shared<CountingLexer>(is);
+      auto begin = std::chrono::steady_clock::now();
+      auto root = ParallelParser<ParserTables>::Parse(lexer, options);
+      best_ms = std::min(best_ms, MillisecondsSince(begin));
+      peak_rss_kb = LALR::PeakRssKb();
+      tokens = lexer->count_;
+      ReleaseTree(std::move(root));
+    }
+    if (base_ms == 0) {
+      base_ms = best_ms;
+    }
+
+    double seconds = best_ms / 1000;
+    Record record("parallel_parse");
+    record.Add("bytes", text.size())
+        .Add("tokens", tokens)
+        .Add("threads", count)
+        .Add("hardware_threads", hardware)
+        .Add("chunk_tokens", options.chunk_tokens_)
+        .Add("ms", best_ms)
+        .Add("mb_per_s", text.size() / seconds / (1 << 20))
+        .Add("speedup", base_ms / best_ms)
+        .Add("peak_rss_kb", peak_rss_kb);
+    sink.Write(record);
+  }
+}
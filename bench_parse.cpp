@@ -0,0 +1,266 @@
+#include "bench_common.h"
+#include "bench_corpus.h"
+#include "LALR_EBNF_lexer.h"
+#include "LALR_flat_tree.h"
+#include "LALR_generation_stats.h"
+#include "LALR_incremental.h"
+#include "LALR_linear_tree.h"
+#include "siicc_EBNF.h"
+#include <cstring>
+#include <filesystem>
+#include <limits>
+
+// Parses synthetic EBNF inputs of growing size with the generated EBNF
+// parser, one JSON line per size:
+//
+//   bench_parse [--sizes 1K,64K,1M,16M] [--repeat 3] [--out results.jsonl]
+//
+// Sizes take a K, M or G suffix; 1G works but needs tens of GB for the tree.
+// `ms` is the fastest of the repeats and covers lexing and parsing up to the
+// finished tree, not generating the input or freeing the tree.
+//
+// A second line per size times the tree written with WriteFlatTree to a
+// temporary file, and `load_ms`, mapping it again with MappedFlatTree, next
+// to `walk_ms`, visiting every node through the view.
+//
+// A third line parses with LinearParser into a LinearTree and compares a
+// preorder walk of it, `preorder_ms`, and a postorder scan, `postorder_ms`,
+// with the same preorder walk over the ASTNodes, `pointer_walk_ms`.
+//
+// A fourth line parses with IncrementalParser, `ms`, and then times edits
+// inside the first production, alternately adding an item and taking it out
+// again, after one untimed pair. `edit_us` is the mean per edit and should
+// not grow with the input, next to the tokens the last edit relexed and
+// reused.
+
+using namespace siicc;
+using namespace siicc::bench;
+
+namespace {
+class CountingLexer : public BNFLexer {
+public:
+  using BNFLexer::BNFLexer;
+  Token Next() override {
+    count_++;
+    return BNFLexer::Next();
+  }
+  uint64_t count_ = 0;
+};
+
+// Sums type, value length and child count over the ASTNodes in preorder.
+uint64_t WalkPointerTree(const ASTNode *root) {
+  uint64_t checksum = 0;
+  std::vector<const ASTNode *> pending = {root};
+  while (!pending.empty()) {
+    auto node = pending.back();
+    pending.pop_back();
+    checksum += static_cast<uint32_t>(node->type_) +
+                (node->value_ ? node->value_->size() : 0) +
+                node->children_.size();
+    for (auto child = node->children_.rbegin();
+         child != node->children_.rend(); ++child) {
+      pending.push_back(child->get());
+    }
+  }
+  return checksum;
+}
+
+// The same sum over a LinearTree in preorder.
+template <class Tree> uint64_t WalkLinearTree(const Tree &tree) {
+  uint64_t checksum = 0;
+  typename Tree::PreorderCursor cursor(tree, tree.Root());
+  uint32_t node;
+  while (cursor.Next(node)) {
+    uint32_t children = 0;
+    typename Tree::ChildCursor child_cursor(tree, node);
+    for (uint32_t child; child_cursor.Next(child);) {
+      children++;
+    }
+    checksum += tree.Type(node) + tree.Value(node).size() + children;
+  }
+  return checksum;
+}
+
+std::vector<uint64_t> ParseSizes(const std::string &text) {
+  std::vector<uint64_t> sizes;
+  std::stringstream ss(text);
+  std::string size;
+  while (std::getline(ss, size, ',')) {
+    sizes.push_back(ParseSize(size));
+  }
+  return sizes;
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  std::vector<uint64_t> sizes = {1 << 10, 64 << 10, 1 << 20, 16 << 20};
+  uint32_t repeat = 3;
+  std::string out_path;
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "--sizes") == 0 && i + 1 < argc) {
+      sizes = ParseSizes(argv[++i]);
+    } else if (std::strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+      repeat = std::max(1, std::atoi(argv[++i]));
+    } else if (std::strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+      out_path = argv[++i];
+    } else {
+      throw std::invalid_argument(std::string("Unknown argument: ") + argv[i]);
+    }
+  }
+
+  RecordSink sink(out_path);
+  constexpr uint32_t EDITS = 200;
+  for (auto size : sizes) {
+    auto text = SyntheticEBNF(size);
+    double best_ms = std::numeric_limits<double>::max();
+    double free_ms = 0;
+    uint64_t tokens = 0;
+    AllocationCount allocated{0, 0};
+    long peak_rss_kb = 0;
+    auto flat_path = std::filesystem::temp_directory_path() /
+                     ("bench_parse_" + std::to_string(::getpid()) + ".flat");
+    double write_ms = 0;
+    double pointer_walk_ms = 0;
+    uint64_t pointer_checksum = 0;
+    for (uint32_t run = 0; run < repeat; run++) {
+      ResetPeakRss();
+      SpanBuf buf(text.data(), text.data() + text.size());
+      std::istream is(&buf);
+      auto lexer = std::make_shared<CountingLexer>(is);
+      auto allocated_before = AllocationCount::Now();
+      auto begin = std::chrono::steady_clock::now();
+      auto root = Parse(lexer);
+      best_ms = std::min(best_ms, MillisecondsSince(begin));
+      allocated = AllocationCount::Now() - allocated_before;
+      peak_rss_kb = LALR::PeakRssKb();
+      tokens = lexer->count_;
+      if (run + 1 == repeat) {
+        begin = std::chrono::steady_clock::now();
+        std::ofstream os(flat_path, std::ios::binary);
+        WriteFlatTree(root, os);
+        os.close();
+        write_ms = MillisecondsSince(begin);
+        begin = std::chrono::steady_clock::now();
+        pointer_checksum = WalkPointerTree(root.get());
+        pointer_walk_ms = MillisecondsSince(begin);
+      }
+      begin = std::chrono::steady_clock::now();
+      ReleaseTree(std::move(root));
+      free_ms = MillisecondsSince(begin);
+    }
+
+    double seconds = best_ms / 1000;
+    Record record("parse");
+    record.Add("bytes", text.size())
+        .Add("tokens", tokens)
+        .Add("ms", best_ms)
+        .Add("free_ms", free_ms)
+        .Add("tokens_per_s", tokens / seconds)
+        .Add("mb_per_s", text.size() / seconds / (1 << 20))
+        .Add("peak_rss_kb", peak_rss_kb)
+        .Add("allocations", allocated.count_)
+        .Add("allocated_bytes", allocated.bytes_)
+        .Add("allocations_per_token",
+             static_cast<double>(allocated.count_) / tokens);
+    sink.Write(record);
+
+    double load_ms = std::numeric_limits<double>::max();
+    double walk_ms = 0;
+    uint64_t nodes = 0, checksum = 0;
+    for (uint32_t run = 0; run < repeat; run++) {
+      auto begin = std::chrono::steady_clock::now();
+      MappedFlatTree tree(flat_path.string());
+      load_ms = std::min(load_ms, MillisecondsSince(begin));
+      begin = std::chrono::steady_clock::now();
+      const auto &view = tree.View();
+      nodes = view.NodeCount();
+      for (uint32_t node = 0; node < nodes; node++) {
+        checksum += view.Type(node) + view.Value(node).size() +
+                    view.Children(node).size();
+      }
+      walk_ms = MillisecondsSince(begin);
+    }
+    Record flat("flat_tree");
+    flat.Add("bytes", text.size())
+        .Add("nodes", nodes)
+        .Add("file_bytes", std::filesystem::file_size(flat_path))
+        .Add("write_ms", write_ms)
+        .Add("load_ms", load_ms)
+        .Add("walk_ms", walk_ms)
+        .Add("parse_to_load", best_ms / load_ms)
+        .Add("checksum", checksum);
+    sink.Write(flat);
+    std::filesystem::remove(flat_path);
+
+    double linear_ms = std::numeric_limits<double>::max();
+    double preorder_ms = 0, postorder_ms = 0;
+    uint64_t linear_checksum = 0, postorder_checksum = 0;
+    for (uint32_t run = 0; run < repeat; run++) {
+      SpanBuf buf(text.data(), text.data() + text.size());
+      std::istream is(&buf);
+      auto begin = std::chrono::steady_clock::now();
+      auto tree = LinearParser<ParserTables>::Parse(
+          std::make_shared<BNFLexer>(is), nodes);
+      linear_ms = std::min(linear_ms, MillisecondsSince(begin));
+      begin = std::chrono::steady_clock::now();
+      linear_checksum = WalkLinearTree(tree);
+      preorder_ms = MillisecondsSince(begin);
+      begin = std::chrono::steady_clock::now();
+      LinearTree<ParserTables>::PostorderCursor cursor(tree, tree.Root());
+      postorder_checksum = 0;
+      for (uint32_t node; cursor.Next(node);) {
+        postorder_checksum += tree.Type(node) + tree.Value(node).size();
+      }
+      postorder_ms = MillisecondsSince(begin);
+    }
+    Record linear("linear_tree");
+    linear.Add("bytes", text.size())
+        .Add("nodes", nodes)
+        .Add("ms", linear_ms)
+        .Add("parse_speedup", best_ms / linear_ms)
+        .Add("pointer_walk_ms", pointer_walk_ms)
+        .Add("preorder_ms", preorder_ms)
+        .Add("postorder_ms", postorder_ms)
+        .Add("walk_speedup", pointer_walk_ms / preorder_ms)
+        .AddRaw("checksum_match",
+                linear_checksum == pointer_checksum ? "true" : "false")
+        .Add("postorder_checksum", postorder_checksum);
+    sink.Write(linear);
+
+    double incremental_ms = std::numeric_limits<double>::max();
+    double edit_us = std::numeric_limits<double>::max();
+    size_t relexed = 0, reused = 0;
+    size_t offset = text.find("::=") + 3;
+    const std::string item = " t0";
+    for (uint32_t run = 0; run < repeat; run++) {
+      IncrementalParser<ParserTables, BNFLexer> parser;
+      auto begin = std::chrono::steady_clock::now();
+      parser.Parse(text);
+      incremental_ms = std::min(incremental_ms, MillisecondsSince(begin));
+      // The first edit moves the gap of the text from its end to the edit.
+      parser.Edit(offset, 0, item);
+      parser.Edit(offset, item.size(), "");
+      begin = std::chrono::steady_clock::now();
+      for (uint32_t i = 0; i < EDITS; i++) {
+        if (i % 2 == 0) {
+          parser.Edit(offset, 0, item);
+        } else {
+          parser.Edit(offset, item.size(), "");
+        }
+      }
+      edit_us = std::min(edit_us, MillisecondsSince(begin) * 1000 / EDITS);
+      relexed = parser.RelexedTokenCount();
+      reused = parser.ReusedTokenCount();
+      ReleaseTree(parser.Release());
+    }
+    Record incremental("incremental");
+    incremental.Add("bytes", text.size())
+        .Add("tokens", tokens)
+        .Add("ms", incremental_ms)
+        .Add("edits", EDITS)
+        .Add("edit_us", edit_us)
+        .Add("relexed_tokens", relexed)
+        .Add("reused_tokens", reused);
+    sink.Write(incremental);
+  }
+}
@@ -0,0 +1,791 @@
+#include "bench_common.h"
+#include "LALR_parser_generator.h"
+#include "LALR_table_generator.h"
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <random>
+#include <regex>
+#include <thread>
+#include <tuple>
+
+// Differential test of the generated parsers. For every random grammar it
+// emits a parser per mode (construction mode, table options, profile layout,
+// GLR generation, embedded tables), compiles them into one runner with the
+// compiler the tool was built with, and checks that every backend of every
+// mode (LR, recovering, GLR and incremental parse) accepts and rejects the
+// same random token streams as the plain LR parser of the dense LALR table,
+// with the same tree and node spans. Every other grammar has conflicts
+// instead: only the GLR modes build it, and their forests must hold as many
+// derivations of each stream as an exhaustive count finds. Before that,
+// ReduceGrammar is checked on the grammar with useless symbols and a
+// %prec-only terminal added, and UpdateProductions against a fresh build
+// after each of --updates random production diffs.
+//
+//   diff_harness [--grammars 4] [--streams 200] [--updates 50] [--seed 1]
+//                [--jobs N] [--work-dir diff_harness_work] [--keep]
+//                [--out FILE] [--cxx COMPILER]
+//
+// Prints one JSON line per generated mode and per mode and backend run, with
+// timings, and one per check. Work directories of grammars with mismatches
+// are kept. Exits with 1 when any outcome differs or any check fails.
+
+using namespace siicc::LALR;
+using namespace siicc::bench;
+namespace fs = std::filesystem;
+
+namespace {
+// Nonterminal i's first production only uses terminals and nonterminals
+// after i, so following first productions always ends.
+struct RandomGrammar {
+  Grammar grammar_;
+  TokenPtrVec terminals_;
+  std::vector<std::vector<TokenPtrVec>> rules_;
+};
+
+// No blank productions: the runtime has no transition on blank, so they are
+// left out until it does.
+RandomGrammar MakeRandomGrammar(std::mt19937 &random) {
+  auto pick = [&](uint32_t n) {
+    return std::uniform_int_distribution<uint32_t>(0, n - 1)(random);
+  };
+  RandomGrammar result;
+  auto &grammar = result.grammar_;
+  grammar.blank_ = NewBlank();
+  grammar.end_ = NewTerminator("end", "$");
+  grammar.terminators_ = {grammar.blank_, grammar.end_};
+  uint32_t terminal_count = 2 + pick(5);
+  for (uint32_t i = 0; i < terminal_count; i++) {
+    auto name = "t" + std::to_string(i);
+    result.terminals_.push_back(NewTerminator(name, name));
+    grammar.terminators_.insert(result.terminals_.back());
+  }
+  // NameLexer looks the terminals up by name.
+  grammar.Keywords(result.terminals_);
+  TokenPtrVec nonterminals;
+  uint32_t nonterminal_count = 2 + pick(5);
+  for (uint32_t i = 0; i < nonterminal_count; i++) {
+    nonterminals.push_back(NewNonTerminator("N" + std::to_string(i)));
+    grammar.nonterminators_.insert(nonterminals.back());
+  }
+  grammar.start_ = nonterminals.front();
+
+  result.rules_.resize(nonterminal_count);
+  for (uint32_t i = 0; i < nonterminal_count; i++) {
+    uint32_t production_count = 1 + pick(3);
+    for (uint32_t p = 0; p < production_count; p++) {
+      TokenPtrVec body;
+      uint32_t length = 1 + pick(4);
+      for (uint32_t k = 0; k < length; k++) {
+        uint32_t lowest = p == 0 ? i + 1 : 0;
+        if (pick(2) == 0 || lowest >= nonterminal_count) {
+          body.push_back(result.terminals_[pick(terminal_count)]);
+        } else {
+          body.push_back(
+              nonterminals[lowest + pick(nonterminal_count - lowest)]);
+        }
+      }
+      result.rules_[i].push_back(body);
+      grammar.productions_.push_back(
+          std::make_shared<Production>(nonterminals[i], body));
+    }
+  }
+  return result;
+}
+
+void Derive(const RandomGrammar &grammar, const TokenPtr &symbol,
+            uint32_t depth, std::mt19937 &random,
+            std::vector<std::string> &out) {
+  if (symbol->type_ != Token::Type::Nonterminator) {
+    out.push_back(symbol->name_);
+    return;
+  }
+  uint32_t index = std::stoul(symbol->name_.substr(1));
+  const auto &rules = grammar.rules_[index];
+  size_t choice = 0;
+  if (depth < 8 && out.size() < 64) {
+    choice =
+        std::uniform_int_distribution<size_t>(0, rules.size() - 1)(random);
+  }
+  for (const auto &token : rules[choice]) {
+    Derive(grammar, token, depth + 1, random, out);
+  }
+}
+
+// Whether some nonterminal derives itself through unit productions alone,
+// which gives a string infinitely many derivations.
+bool HasUnitCycle(const RandomGrammar &grammar) {
+  auto count = grammar.rules_.size();
+  std::vector<std::vector<uint32_t>> units(count);
+  for (size_t i = 0; i < count; i++) {
+    for (const auto &body : grammar.rules_[i]) {
+      if (body.size() == 1 && body[0]->type_ == Token::Type::Nonterminator) {
+        units[i].push_back(std::stoul(body[0]->name_.substr(1)));
+      }
+    }
+  }
+  // 0 unvisited, 1 on the path, 2 done.
+  std::vector<uint8_t> state(count, 0);
+  std::function<bool(uint32_t)> visit = [&](uint32_t i) {
+    state[i] = 1;
+    for (auto next : units[i]) {
+      if (state[next] == 1 || (state[next] == 0 && visit(next))) {
+        return true;
+      }
+    }
+    state[i] = 2;
+    return false;
+  };
+  for (uint32_t i = 0; i < count; i++) {
+    if (state[i] == 0 && visit(i)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// The number of derivations of `tokens` from the start symbol, counted
+// exhaustively over every split of every span, saturating at UINT64_MAX. The
+// reference for the GLR forests of grammars with conflicts, which has to be
+// free of unit cycles.
+class DerivationCounter {
+public:
+  DerivationCounter(const RandomGrammar &grammar,
+                    const std::vector<std::string> &tokens)
+      : grammar_(grammar), tokens_(tokens) {}
+
+  uint64_t Count() {
+    return Count(grammar_.grammar_.start_, 0, tokens_.size());
+  }
+
+private:
+  static uint64_t Add(uint64_t lhs, uint64_t rhs) {
+    uint64_t sum;
+    return __builtin_add_overflow(lhs, rhs, &sum) ? UINT64_MAX : sum;
+  }
+
+  static uint64_t Multiply(uint64_t lhs, uint64_t rhs) {
+    uint64_t product;
+    return __builtin_mul_overflow(lhs, rhs, &product) ? UINT64_MAX : product;
+  }
+
+  uint64_t Count(const TokenPtr &symbol, size_t begin, size_t end) {
+    if (symbol->type_ != Token::Type::Nonterminator) {
+      return end == begin + 1 && tokens_[begin] == symbol->name_;
+    }
+    auto key = std::make_tuple(symbol.get(), begin, end);
+    if (auto iter = symbol_counts_.find(key); iter != symbol_counts_.end()) {
+      return iter->second;
+    }
+    uint64_t count = 0;
+    for (const auto &body :
+         grammar_.rules_[std::stoul(symbol->name_.substr(1))]) {
+      count = Add(count, CountBody(body, 0, begin, end));
+    }
+    return symbol_counts_[key] = count;
+  }
+
+  // Derivations of the span by body[index..], every symbol taking at least
+  // one token as there are no blank productions.
+  uint64_t CountBody(const TokenPtrVec &body, size_t index, size_t begin,
+                     size_t end) {
+    auto rest = body.size() - index;
+    if (end - begin < rest) {
+      return 0;
+    }
+    if (rest == 1) {
+      return Count(body[index], begin, end);
+    }
+    auto key = std::make_tuple(&body, index, begin, end);
+    if (auto iter = body_counts_.find(key); iter != body_counts_.end()) {
+      return iter->second;
+    }
+    uint64_t count = 0;
+    for (size_t split = begin + 1; split + rest - 1 <= end; split++) {
+      if (auto head = Count(body[index], begin, split)) {
+        count =
+            Add(count, Multiply(head, CountBody(body, index + 1, split, end)));
+      }
+    }
+    return body_counts_[key] = count;
+  }
+
+  const RandomGrammar &grammar_;
+  const std::vector<std::string> &tokens_;
+  std::map<std::tuple<const Token *, size_t, size_t>, uint64_t> symbol_counts_;
+  std::map<std::tuple<const TokenPtrVec *, size_t, size_t, size_t>, uint64_t>
+      body_counts_;
+};
+
+// Deletes, inserts, replaces or swaps one token. The result may still be in
+// the language; the reference decides.
+void Mutate(const RandomGrammar &grammar, std::mt19937 &random,
+            std::vector<std::string> &tokens) {
+  auto pick = [&](size_t n) {
+    return std::uniform_int_distribution<size_t>(0, n - 1)(random);
+  };
+  const auto &terminal = grammar.terminals_[pick(grammar.terminals_.size())];
+  switch (pick(4)) {
+  case 0:
+    tokens.erase(tokens.begin() + pick(tokens.size()));
+    break;
+  case 1:
+    tokens.insert(tokens.begin() + pick(tokens.size() + 1), terminal->name_);
+    break;
+  case 2:
+    tokens[pick(tokens.size())] = terminal->name_;
+    break;
+  default:
+    if (tokens.size() > 1) {
+      auto i = pick(tokens.size() - 1);
+      std::swap(tokens[i], tokens[i + 1]);
+    }
+  }
+}
+
+// The automaton with states numbered breadth first over transitions in
+// symbol name order and productions spelled out, so tables built from
+// differently ordered grammars compare equal when they parse alike.
+std::string TableSignature(const LALRTableGenerator &generator) {
+  const auto &closures = generator.GetClosures();
+  const auto &action = generator.GetAction();
+  const auto &reduce = generator.GetReduce();
+  const auto &conflicts = generator.GetConflicts();
+  std::map<ClosurePtr, size_t> number = {{closures.front(), 0}};
+  std::vector<ClosurePtr> order = {closures.front()};
+  std::stringstream ss;
+  for (size_t i = 0; i < order.size(); i++) {
+    auto closure = order[i];
+    auto edges = action[closure->id_ - 1];
+    std::sort(edges.begin(), edges.end(), [](const Edge &lhs, const Edge &rhs) {
+      return TokenPtrLess()(lhs.token_, rhs.token_);
+    });
+    ss << i << ":";
+    for (const auto &[token, next] : edges) {
+      if (number.emplace(next, order.size()).second) {
+        order.push_back(next);
+      }
+      ss << " " << token->name_ << ">" << number[next];
+    }
+    std::map<std::string, std::vector<std::string>> reductions;
+    if (auto iter = reduce.find(closure); iter != reduce.end()) {
+      for (const auto &[token, production] : iter->second) {
+        reductions[token->name_].push_back(
+            production ? production->to_string() : "error");
+      }
+    }
+    if (auto iter = conflicts.find(closure); iter != conflicts.end()) {
+      for (const auto &[token, productions] : iter->second) {
+        for (const auto &production : productions) {
+          reductions[token->name_].push_back(production->to_string());
+        }
+      }
+    }
+    for (auto &[token, productions] : reductions) {
+      std::sort(productions.begin(), productions.end());
+      for (const auto &production : productions) {
+        ss << " " << token << "/" << production;
+      }
+    }
+    ss << "\n";
+  }
+  return ss.str();
+}
+
+std::set<std::string> NamesOf(const TokenPtrVec &tokens) {
+  std::set<std::string> names;
+  for (const auto &token : tokens) {
+    names.insert(token->name_);
+  }
+  return names;
+}
+
+// yacc's unary minus: UMINUS only appears as a %prec tag. Returns what went
+// wrong, empty if nothing did.
+std::string CheckPrecedenceTag() {
+  Grammar grammar;
+  grammar.blank_ = NewBlank();
+  grammar.end_ = NewTerminator("end", "$");
+  auto minus = NewTerminator("minus", "-");
+  auto a = NewTerminator("a", "a");
+  auto uminus = NewTerminator("UMINUS", "UMINUS");
+  auto e = NewNonTerminator("E");
+  grammar.terminators_ = {grammar.blank_, grammar.end_, minus, a, uminus};
+  grammar.nonterminators_ = {e};
+  grammar.start_ = e;
+  grammar.productions_ = {
+      std::make_shared<Production>(e, TokenPtrVec{e, minus, e}),
+      std::make_shared<Production>(e, TokenPtrVec{minus, e}, uminus),
+      std::make_shared<Production>(e, TokenPtrVec{a}),
+  };
+  grammar.Left({minus});
+  grammar.Right({uminus});
+  ReduceGrammar(grammar);
+  try {
+    LALRTableGenerator(grammar).GenerateLALRTable();
+  } catch (const std::invalid_argument &e) {
+    return std::string("reduced %prec grammar: ") + e.what();
+  }
+  return "";
+}
+
+// ReduceGrammar on `grammar` with an unproductive and an unreachable
+// nonterminal, a terminal only they use and a %prec-only terminal added has
+// to take out exactly those on top of what it takes out of `grammar`, and
+// leave the same tables. Returns what went wrong, empty if nothing did.
+std::string CheckReduction(const RandomGrammar &random_grammar) {
+  auto plain = random_grammar.grammar_.Clone();
+  auto expected = ReduceGrammar(plain);
+
+  auto padded = random_grammar.grammar_.Clone();
+  auto unused = NewTerminator("x_unused", "x_unused");
+  auto tag = NewTerminator("x_tag", "x_tag");
+  auto unproductive = NewNonTerminator("X_unproductive");
+  auto unreachable = NewNonTerminator("X_unreachable");
+  padded.terminators_.insert({unused, tag});
+  padded.nonterminators_.insert({unproductive, unreachable});
+  padded.Right({tag});
+  auto first = padded.productions_.front();
+  first->prec_ = tag;
+  padded.productions_.push_back(std::make_shared<Production>(
+      unproductive, TokenPtrVec{unproductive, unused}));
+  padded.productions_.push_back(std::make_shared<Production>(
+      first->head_, TokenPtrVec{unproductive, first->body_.front()}));
+  padded.productions_.push_back(
+      std::make_shared<Production>(unreachable, TokenPtrVec{unused}));
+  auto reduction = ReduceGrammar(padded);
+
+  auto with = [](const TokenPtrVec &tokens, const std::string &name) {
+    auto names = NamesOf(tokens);
+    names.insert(name);
+    return names;
+  };
+  if (NamesOf(reduction.unproductive_) !=
+          with(expected.unproductive_, unproductive->name_) ||
+      NamesOf(reduction.unreachable_) !=
+          with(expected.unreachable_, unreachable->name_) ||
+      NamesOf(reduction.unused_terminators_) !=
+          with(expected.unused_terminators_, unused->name_) ||
+      reduction.removed_productions_.size() !=
+          expected.removed_productions_.size() + 3) {
+    return "unexpected reduction:\n" + reduction.to_string();
+  }
+  if (!padded.terminators_.count(tag) || !padded.PrecedenceOf(tag)) {
+    return "%prec-only terminal removed";
+  }
+  // GLR, so conflicts do not throw.
+  LALRTableGenerator plain_tables(plain, ConstructionMode::LALR, true);
+  LALRTableGenerator padded_tables(padded, ConstructionMode::LALR, true);
+  plain_tables.GenerateLALRTable();
+  padded_tables.GenerateLALRTable();
+  if (TableSignature(plain_tables) != TableSignature(padded_tables)) {
+    return "tables differ after the reduction";
+  }
+  return "";
+}
+
+// Applies `steps` random production diffs to the tables of `grammar` with
+// UpdateProductions, one after another, and compares the result of each with
+// tables built from scratch. Returns what went wrong, empty if nothing did.
+std::string CheckUpdates(const RandomGrammar &random_grammar, uint32_t steps,
+                         std::mt19937 &random) {
+  auto pick = [&](size_t n) {
+    return std::uniform_int_distribution<size_t>(0, n - 1)(random);
+  };
+  auto prev = random_grammar.grammar_;
+  TokenPtrVec nonterminals(prev.nonterminators_.begin(),
+                           prev.nonterminators_.end());
+  TokenPtrVec symbols = random_grammar.terminals_;
+  symbols.insert(symbols.end(), nonterminals.begin(), nonterminals.end());
+  // GLR, so conflicts do not throw and have to match as well.
+  LALRTableGenerator updated(prev, ConstructionMode::LALR, true);
+  updated.GenerateLALRTable();
+  for (uint32_t step = 0; step < steps; step++) {
+    auto next = prev;
+    auto &productions = next.productions_;
+    // DiffProductions goes by spelling, so copies of a production are
+    // removed together and added once.
+    auto remove = [&](const std::string &spelling) {
+      productions.erase(
+          std::remove_if(productions.begin(), productions.end(),
+                         [&](const ProductionPtr &production) {
+                           return production->to_string() == spelling;
+                         }),
+          productions.end());
+    };
+    // Removes one, adds one or both.
+    auto kind = pick(3);
+    if (kind != 1 && productions.size() > 1) {
+      remove(productions[pick(productions.size())]->to_string());
+    }
+    if (kind != 0) {
+      TokenPtrVec body;
+      for (size_t k = 1 + pick(4); k > 0; k--) {
+        body.push_back(symbols[pick(symbols.size())]);
+      }
+      auto production = std::make_shared<Production>(
+          nonterminals[pick(nonterminals.size())], body);
+      remove(production->to_string());
+      productions.push_back(production);
+    }
+    auto [added, removed] = LALRTableGenerator::DiffProductions(prev, next);
+    updated.UpdateProductions(added, removed);
+    LALRTableGenerator fresh(next, ConstructionMode::LALR, true);
+    fresh.GenerateLALRTable();
+    if (TableSignature(updated) != TableSignature(fresh)) {
+      std::stringstream ss;
+      ss << "step " << step << " differs from a fresh build, added:";
+      for (const auto &production : added) {
+        ss << " " << production->to_string();
+      }
+      ss << " removed:";
+      for (const auto &production : removed) {
+        ss << " " << production->to_string();
+      }
+      return ss.str();
+    }
+    prev = std::move(next);
+  }
+  return "";
+}
+
+std::string Join(const std::vector<std::string> &tokens) {
+  std::string text;
+  for (const auto &token : tokens) {
+    text += (text.empty() ? "" : " ") + token;
+  }
+  return text;
+}
+
+struct ModeSpec {
+  std::string name_;
+  ConstructionMode construction_ = ConstructionMode::LALR;
+  bool glr_ = false;
+  ParserGeneratorOptions options_;
+  bool profile_ = false;
+  // Tables embedded from a blob, see ParserGeneratorOptions::blob_path_.
+  bool blob_ = false;
+};
+
+ParserGeneratorOptions AllOptions(bool enabled) {
+  ParserGeneratorOptions options;
+  options.terminal_classes_ = enabled;
+  options.merge_states_ = enabled;
+  options.default_reductions_ = enabled;
+  options.share_rows_ = enabled;
+  return options;
+}
+
+// The first mode is the reference. Every combination of the table options
+// on LALR, the profile layout, GLR generation, embedded tables, and the other
+// construction modes without and with all options.
+std::vector<ModeSpec> AllModes() {
+  std::vector<ModeSpec> modes;
+  for (uint32_t mask = 0; mask < 16; mask++) {
+    ModeSpec mode;
+    mode.name_ = "lalr";
+    mode.options_.terminal_classes_ = mask & 1;
+    mode.options_.merge_states_ = mask & 2;
+    mode.options_.default_reductions_ = mask & 4;
+    mode.options_.share_rows_ = mask & 8;
+    mode.name_ += mask == 0 ? "-dense" : "";
+    mode.name_ += mask & 1 ? "+classes" : "";
+    mode.name_ += mask & 2 ? "+merge" : "";
+    mode.name_ += mask & 4 ? "+default" : "";
+    mode.name_ += mask & 8 ? "+share" : "";
+    modes.push_back(mode);
+  }
+  ModeSpec profiled;
+  profiled.name_ = "lalr-all+profile";
+  profiled.options_ = AllOptions(true);
+  profiled.profile_ = true;
+  modes.push_back(profiled);
+  for (bool enabled : {false, true}) {
+    ModeSpec glr;
+    glr.name_ = enabled ? "lalr-all-glr" : "lalr-dense-glr";
+    glr.options_ = AllOptions(enabled);
+    glr.glr_ = true;
+    modes.push_back(glr);
+  }
+  for (bool is_glr : {false, true}) {
+    ModeSpec blob;
+    blob.name_ = is_glr ? "lalr-all-glr+blob" : "lalr-all+blob";
+    blob.options_ = AllOptions(true);
+    blob.glr_ = is_glr;
+    blob.blob_ = true;
+    modes.push_back(blob);
+  }
+  for (auto construction : {ConstructionMode::LR0, ConstructionMode::SLR,
+                            ConstructionMode::IELR, ConstructionMode::LR1}) {
+    for (bool enabled : {false, true}) {
+      ModeSpec mode;
+      mode.name_ = ConstructionModeName(construction) +
+                   std::string(enabled ? "-all" : "-dense");
+      mode.construction_ = construction;
+      mode.options_ = AllOptions(enabled);
+      modes.push_back(mode);
+    }
+  }
+  return modes;
+}
+
+// Visit and token counts for the states of `header`, a parser generated
+// with the same options and no profile.
+RecordedProfile RandomProfile(const Grammar &grammar, const std::string &header,
+                              std::mt19937 &random) {
+  std::smatch match;
+  if (!std::regex_search(header, match,
+                         std::regex("STATE_COUNT = ([0-9]+)"))) {
+    throw std::invalid_argument("No STATE_COUNT in generated header");
+  }
+  RecordedProfile profile;
+  profile.state_count_ = std::stoul(match[1]);
+  profile.terminal_count_ = grammar.terminators_.size();
+  // The generator adds the START production.
+  profile.production_count_ = grammar.productions_.size() + 1;
+  std::uniform_int_distribution<uint64_t> count(0, 1000);
+  for (uint32_t i = 0; i < profile.state_count_; i++) {
+    profile.visits_.push_back(count(random));
+  }
+  for (uint32_t i = 0; i <= profile.terminal_count_; i++) {
+    profile.terminals_.push_back(count(random));
+  }
+  return profile;
+}
+
+// Returns the source; the header and, in blob modes, the tables to embed
+// from `blob_path` go to `header` and `tables`.
+std::string Generate(const Grammar &grammar, const ModeSpec &mode,
+                     const RecordedProfile *profile, const std::string &name,
+                     const std::string &blob_path, std::string &header,
+                     std::string &tables) {
+  LALRTableGenerator t_generator(grammar, mode.construction_, mode.glr_);
+  t_generator.GenerateLALRTable();
+  auto options = mode.options_;
+  options.profile_ = profile;
+  if (mode.blob_) {
+    options.blob_path_ = blob_path;
+  }
+  LALRParserGenerator p_generator(
+      t_generator.MoveAction(), t_generator.MoveReduce(),
+      t_generator.MoveClosures(), t_generator.MoveGrammar(), options,
+      t_generator.MoveConflicts());
+  std::stringstream header_stream, cpp_stream;
+  p_generator.OutputHeader(header_stream);
+  p_generator.OutputCpp(name + ".h", cpp_stream);
+  header = header_stream.str();
+  std::stringstream tables_stream;
+  p_generator.OutputBlob(tables_stream);
+  tables = tables_stream.str();
+  return cpp_stream.str();
+}
+
+void WriteFile(const fs::path &path, const std::string &content) {
+  std::ofstream os(path, std::ios::binary);
+  os << content;
+  if (!os) {
+    throw std::invalid_argument("Can not write " + path.string());
+  }
+}
+
+// Runs `commands` through the shell, `jobs` at a time. Returns false if any
+// failed.
+bool RunAll(const std::vector<std::string> &commands, uint32_t jobs) {
+  std::atomic<size_t> next{0};
+  std::atomic<bool> ok{true};
+  std::vector<std::thread> workers;
+  for (uint32_t i = 0; i < jobs; i++) {
+    workers.emplace_back([&]() {
+      for (size_t k = next++; k < commands.size(); k = next++) {
+        if (std::system(commands[k].c_str()) != 0) {
+          ok = false;
+        }
+      }
+    });
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  return ok;
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  uint32_t grammar_count = 4;
+  uint32_t stream_count = 200;
+  uint32_t update_count = 50;
+  uint32_t seed = 1;
+  uint32_t jobs = std::max(1u, std::thread::hardware_concurrency());
+  fs::path work_dir = "diff_harness_work";
+  bool keep = false;
+  std::string out_path;
+  std::string cxx = SIICC_CXX;
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "--grammars") == 0 && i + 1 < argc) {
+      grammar_count = std::stoul(argv[++i]);
+    } else if (std::strcmp(argv[i], "--streams") == 0 && i + 1 < argc) {
+      stream_count = std::max(2ul, std::stoul(argv[++i]));
+    } else if (std::strcmp(argv[i], "--updates") == 0 && i + 1 < argc) {
+      update_count = std::stoul(argv[++i]);
+    } else if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+      seed = std::stoul(argv[++i]);
+    } else if (std::strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+      jobs = std::max(1ul, std::stoul(argv[++i]));
+    } else if (std::strcmp(argv[i], "--work-dir") == 0 && i + 1 < argc) {
+      work_dir = argv[++i];
+    } else if (std::strcmp(argv[i], "--keep") == 0) {
+      keep = true;
+    } else if (std::strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+      out_path = argv[++i];
+    } else if (std::strcmp(argv[i], "--cxx") == 0 && i + 1 < argc) {
+      cxx = argv[++i];
+    } else {
+      throw std::invalid_argument(std::string("Unknown argument: ") + argv[i]);
+    }
+  }
+
+  RecordSink sink(out_path);
+  std::mt19937 random(seed);
+  auto modes = AllModes();
+  uint32_t failed = 0;
+  // Checks of the grammar passes, `failure` set when one went wrong.
+  uint32_t failed_checks = 0;
+  auto check = [&](Record &record, const std::string &failure) {
+    record.AddRaw("ok", failure.empty() ? "true" : "false");
+    if (!failure.empty()) {
+      record.Add("failure", failure);
+      failed_checks++;
+    }
+    sink.Write(record);
+  };
+  Record precedence_record("diff_reduce");
+  precedence_record.Add("grammar", "UMINUS");
+  check(precedence_record, CheckPrecedenceTag());
+  for (uint32_t g = 0; g < grammar_count; g++) {
+    // Even grammars are LALR(1). Odd ones have conflicts, so only the GLR
+    // modes parse them, and the GLR backends are compared with the number
+    // of derivations of each stream.
+    bool conflicting = g % 2 == 1;
+    RandomGrammar grammar;
+    while (true) {
+      grammar = MakeRandomGrammar(random);
+      bool lalr1 = true;
+      try {
+        LALRTableGenerator(grammar.grammar_).GenerateLALRTable();
+      } catch (const std::invalid_argument &) {
+        lalr1 = false;
+      }
+      if (conflicting ? !lalr1 && !HasUnitCycle(grammar) : lalr1) {
+        break;
+      }
+    }
+
+    Record reduce_record("diff_reduce");
+    reduce_record.Add("grammar", g);
+    check(reduce_record, CheckReduction(grammar));
+    Record update_record("diff_update");
+    update_record.Add("grammar", g).Add("steps", update_count);
+    check(update_record, CheckUpdates(grammar, update_count, random));
+
+    auto dir = work_dir / ("grammar_" + std::to_string(g));
+    fs::create_directories(dir);
+    std::string streams, reference;
+    auto add_stream = [&](const std::vector<std::string> &tokens) {
+      streams += Join(tokens) + "\n";
+      if (conflicting) {
+        auto count = DerivationCounter(grammar, tokens).Count();
+        reference +=
+            count ? "accept " + std::to_string(count) + "\n" : "reject\n";
+      }
+    };
+    for (uint32_t i = 0; i < stream_count / 2; i++) {
+      std::vector<std::string> tokens;
+      Derive(grammar, grammar.grammar_.start_, 0, random, tokens);
+      add_stream(tokens);
+      Mutate(grammar, random, tokens);
+      add_stream(tokens);
+    }
+    WriteFile(dir / "streams.txt", streams);
+    if (conflicting) {
+      WriteFile(dir / "reference.txt", reference);
+    }
+
+    std::string modes_inc;
+    std::vector<std::string> commands;
+    std::string objects;
+    std::string all_header;
+    for (size_t m = 0; m < modes.size(); m++) {
+      const auto &mode = modes[m];
+      auto name = "mode_" + std::to_string(m);
+      Record record("diff_generate");
+      record.Add("grammar", g).Add("mode", mode.name_);
+      std::string header, cpp, tables;
+      auto blob_path = fs::absolute(dir / (name + ".tables")).string();
+      auto begin = std::chrono::steady_clock::now();
+      try {
+        RecordedProfile profile;
+        if (mode.profile_) {
+          profile = RandomProfile(grammar.grammar_, all_header, random);
+        }
+        cpp = Generate(grammar.grammar_, mode, mode.profile_ ? &profile : nullptr,
+                       name, blob_path, header, tables);
+      } catch (const std::invalid_argument &e) {
+        // LR(0) and SLR reject many LALR(1) grammars, and all but the GLR
+        // modes those with conflicts.
+        sink.Write(record.Add("skipped", e.what()));
+        continue;
+      }
+      record.Add("ms", MillisecondsSince(begin));
+      sink.Write(record);
+      if (mode.name_ == "lalr+classes+merge+default+share") {
+        all_header = header;
+      }
+      WriteFile(dir / (name + ".h"), header);
+      WriteFile(dir / (name + ".cpp"), cpp);
+      if (mode.blob_) {
+        WriteFile(blob_path, tables);
+      }
+      auto ns = "siicc_" + name;
+      WriteFile(dir / (name + "_run.cpp"),
+                "#define siicc " + ns + "\n#include \"" + name +
+                    ".cpp\"\n#include \"diff_harness_driver.h\"\n");
+      modes_inc += "SIICC_DIFF_MODE(" + ns + ", \"" + mode.name_ + "\")\n";
+      commands.push_back(cxx + " -std=c++17 -O1 -I" + SIICC_SOURCE_DIR +
+                         " -c " + (dir / (name + "_run.cpp")).string() +
+                         " -o " + (dir / (name + ".o")).string());
+      objects += " " + (dir / (name + ".o")).string();
+    }
+    WriteFile(dir / "modes.inc", modes_inc);
+
+    auto runner = (dir / "runner").string();
+    if (!RunAll(commands, jobs) ||
+        std::system((cxx + " -std=c++17 -O1 -I" + dir.string() + " " +
+                     SIICC_SOURCE_DIR + "/diff_harness_runner.cpp" + objects +
+                     " -o " + runner)
+                        .c_str()) != 0) {
+      throw std::runtime_error("Can not build the runner in " + dir.string());
+    }
+    auto results = dir / "results.jsonl";
+    auto arguments = " " + (dir / "streams.txt").string();
+    if (conflicting) {
+      arguments += " " + (dir / "reference.txt").string();
+    }
+    int status = std::system(
+        (runner + arguments + " > " + results.string()).c_str());
+    std::ifstream is(results);
+    for (std::string line; std::getline(is, line);) {
+      Record record("diff_run");
+      sink.Write(record.Add("grammar", g).Merge(line));
+    }
+    if (status != 0) {
+      failed++;
+      std::cerr << "grammar " << g << ": mismatches, see " << dir << "\n";
+    } else if (!keep) {
+      fs::remove_all(dir);
+    }
+  }
+  std::cerr << failed << " of " << grammar_count
+            << " grammars with mismatches, " << failed_checks
+            << " failed checks\n";
+  return failed || failed_checks ? 1 : 0;
+}
@@ -0,0 +1,220 @@
+#pragma once
+
+// Runs one generated parser over the streams of diff_harness. Included after
+// the generated source, with `siicc` defined to a namespace of its own so the
+// parsers of several modes link into one runner, see diff_harness.cpp.
+
+#include "LALR_glr.h"
+#include "LALR_incremental.h"
+#include <cctype>
+#include <chrono>
+#include <map>
+#include <sstream>
+
+namespace siicc {
+namespace diff {
+// Whitespace separated terminal names, as written by diff_harness.
+class NameLexer : public Lexer {
+public:
+  NameLexer(std::istream &is) : is_(is) {}
+
+  Token Next() override {
+    std::string name;
+    auto ch = is_.get();
+    while (ch != std::char_traits<char>::eof() && std::isspace(ch)) {
+      offset_++;
+      ch = is_.get();
+    }
+    token_begin_ = offset_;
+    while (ch != std::char_traits<char>::eof() && !std::isspace(ch)) {
+      name.push_back(ch);
+      offset_++;
+      ch = is_.get();
+    }
+    token_end_ = offset_;
+    if (ch != std::char_traits<char>::eof()) {
+      offset_++;
+    }
+    if (name.empty()) {
+      return Token(static_cast<Token::TokenType>(ParserTables::END_TOKEN), "$",
+                   token_begin_);
+    }
+    if (auto id = MatchKeyword<ParserTables>(name.data(), name.size())) {
+      return Token(static_cast<Token::TokenType>(id), name, token_begin_);
+    }
+    throw std::invalid_argument("Unknown terminal " + name);
+  }
+
+  uint32_t TokenBegin() const { return token_begin_; }
+  uint32_t TokenEnd() const { return token_end_; }
+
+private:
+  std::istream &is_;
+  uint32_t offset_ = 0;
+  uint32_t token_begin_ = 0;
+  uint32_t token_end_ = 0;
+};
+
+inline void Print(const ASTNodePtr &node, std::ostream &os) {
+  if (ASTNode::IsLeaf(node->type_)) {
+    os << *node->value_;
+    return;
+  }
+  os << "(" << ASTNode::TypeToStr(node->type_);
+  for (const auto &child : node->children_) {
+    os << " ";
+    Print(child, os);
+  }
+  os << ")";
+}
+
+// The tree, then the spans of its nodes in preorder. IncrementalParser keeps
+// spans relative to the parent, see VisitSpans.
+inline std::string Outcome(const ASTNodePtr &root,
+                           bool relative_spans = false) {
+  std::stringstream ss;
+  ss << "accept ";
+  Print(root, ss);
+  ss << " @";
+  if (relative_spans) {
+    VisitSpans(root, [&](const ASTNode &, uint32_t begin, uint32_t end) {
+      ss << " " << begin << "-" << end;
+    });
+  } else {
+    std::vector<const ASTNode *> pending = {root.get()};
+    while (!pending.empty()) {
+      auto node = pending.back();
+      pending.pop_back();
+      ss << " " << node->begin_ << "-" << node->end_;
+      for (auto iter = node->children_.rbegin();
+           iter != node->children_.rend(); iter++) {
+        pending.push_back(iter->get());
+      }
+    }
+  }
+  return ss.str();
+}
+
+template <class Parse>
+std::vector<std::string> Run(const std::vector<std::string> &streams,
+                             double &milliseconds, Parse &&parse) {
+  std::vector<std::string> outcomes;
+  auto begin = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < streams.size(); i++) {
+    try {
+      outcomes.push_back(parse(i));
+    } catch (const std::exception &) {
+      outcomes.push_back("reject");
+    }
+  }
+  milliseconds = std::chrono::duration<double, std::milli>(
+                     std::chrono::steady_clock::now() - begin)
+                     .count();
+  return outcomes;
+}
+
+// Derivations in the packed forest below `node`, saturating at UINT64_MAX
+// like the count diff_harness compares them with.
+template <class Node>
+uint64_t CountDerivations(const std::shared_ptr<Node> &node,
+                          std::map<const Node *, uint64_t> &counts) {
+  if (node->children_.empty()) {
+    return 1;
+  }
+  auto iter = counts.find(node.get());
+  if (iter != counts.end()) {
+    return iter->second;
+  }
+  auto count_of = [&](const Node &derivation) {
+    uint64_t count = 1;
+    for (const auto &child : derivation.children_) {
+      if (__builtin_mul_overflow(count, CountDerivations(child, counts),
+                                 &count)) {
+        count = UINT64_MAX;
+      }
+    }
+    return count;
+  };
+  uint64_t count = count_of(*node);
+  for (const auto &alternative : node->alternatives_) {
+    if (__builtin_add_overflow(count, count_of(*alternative), &count)) {
+      count = UINT64_MAX;
+    }
+  }
+  return counts[node.get()] = count;
+}
+
+// See RunBackends.
+template <class Tables>
+std::vector<std::vector<std::string>>
+RunBackendsOf(const std::vector<std::string> &streams,
+              std::vector<double> &milliseconds) {
+  milliseconds.assign(4, 0);
+  std::vector<std::vector<std::string>> outcomes(4);
+  if constexpr (Tables::CONFLICT_COUNT > 0) {
+    // Only GLR parses these, the outcome is the number of derivations.
+    outcomes[2] = Run(streams, milliseconds[2], [&](size_t i) {
+      std::stringstream ss(streams[i]);
+      std::map<const typename Tables::Node *, uint64_t> counts;
+      return "accept " + std::to_string(CountDerivations(
+                             GLRParser<Tables>::Parse(
+                                 std::make_shared<NameLexer>(ss)),
+                             counts));
+    });
+    return outcomes;
+  }
+  outcomes[0] = Run(streams, milliseconds[0], [&](size_t i) {
+    std::stringstream ss(streams[i]);
+    return Outcome(Parse(std::make_shared<NameLexer>(ss)));
+  });
+  outcomes[1] = Run(streams, milliseconds[1], [&](size_t i) {
+    std::stringstream ss(streams[i]);
+    std::vector<SyntaxError> errors;
+    auto root = Parse(std::make_shared<NameLexer>(ss), errors);
+    return errors.empty() ? Outcome(root) : std::string("reject");
+  });
+  outcomes[2] = Run(streams, milliseconds[2], [&](size_t i) {
+    std::stringstream ss(streams[i]);
+    return Outcome(
+        GLRParser<Tables>::Parse(std::make_shared<NameLexer>(ss)));
+  });
+  IncrementalParser<Tables, NameLexer> incremental;
+  outcomes[3] = Run(streams, milliseconds[3], [&](size_t i) {
+    if (i == 0) {
+      return Outcome(incremental.Parse(streams[i]), true);
+    }
+    const auto &old_text = incremental.Text();
+    const auto &new_text = streams[i];
+    size_t prefix = 0;
+    while (prefix < old_text.size() && prefix < new_text.size() &&
+           old_text[prefix] == new_text[prefix]) {
+      prefix++;
+    }
+    size_t suffix = 0;
+    while (suffix + prefix < old_text.size() &&
+           suffix + prefix < new_text.size() &&
+           old_text[old_text.size() - 1 - suffix] ==
+               new_text[new_text.size() - 1 - suffix]) {
+      suffix++;
+    }
+    return Outcome(incremental.Edit(
+        prefix, old_text.size() - prefix - suffix,
+        new_text.substr(prefix, new_text.size() - prefix - suffix)),
+        true);
+  });
+  return outcomes;
+}
+
+// One outcome per stream, "reject" or "accept <tree>", for each backend in
+// the order of BACKENDS in diff_harness_runner.cpp: the plain LR parser, the
+// recovering parser (accepting only without errors), the GLR parser and the
+// incremental parser, which reaches each stream by editing the previous one.
+// Tables with conflicts only run the GLR parser, with "accept <number of
+// derivations>" as the outcome; the others are left empty.
+std::vector<std::vector<std::string>>
+RunBackends(const std::vector<std::string> &streams,
+            std::vector<double> &milliseconds) {
+  return RunBackendsOf<ParserTables>(streams, milliseconds);
+}
+} // namespace diff
+} // namespace siicc
@@ -0,0 +1,105 @@
+// Main of the runner diff_harness builds for each grammar. `modes.inc` in the
+// work directory lists the modes as SIICC_DIFF_MODE(namespace, name), the
+// first one being the reference. Reads the streams, one per line, from
+// argv[1], prints one JSON line per mode and backend, and describes the first
+// mismatches on stderr. Exits with 1 when any outcome differs from the
+// reference. For grammars with conflicts argv[2] holds the reference instead,
+// one outcome per stream, and only the GLR backends run.
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+typedef std::vector<std::vector<std::string>> (*RunBackendsFn)(
+    const std::vector<std::string> &, std::vector<double> &);
+
+#define SIICC_DIFF_MODE(ns, name)                                              \
+  namespace ns {                                                               \
+  namespace diff {                                                             \
+  std::vector<std::vector<std::string>>                                        \
+  RunBackends(const std::vector<std::string> &, std::vector<double> &);        \
+  }                                                                            \
+  }
+#include "modes.inc"
+#undef SIICC_DIFF_MODE
+
+namespace {
+struct Mode {
+  const char *name_;
+  RunBackendsFn run_;
+};
+
+const Mode MODES[] = {
+#define SIICC_DIFF_MODE(ns, name) {name, ns::diff::RunBackends},
+#include "modes.inc"
+#undef SIICC_DIFF_MODE
+};
+
+const char *const BACKENDS[] = {"lr", "recover", "glr", "incremental"};
+
+// Mismatches described per mode and backend.
+constexpr size_t MAX_REPORTED = 3;
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argc != 2 && argc != 3) {
+    std::cerr << "usage: " << argv[0] << " STREAMS [REFERENCE]\n";
+    return 2;
+  }
+  auto read_lines = [](const char *path) {
+    std::ifstream is(path);
+    std::vector<std::string> lines;
+    for (std::string line; std::getline(is, line);) {
+      lines.push_back(line);
+    }
+    return lines;
+  };
+  auto streams = read_lines(argv[1]);
+
+  std::vector<std::string> reference;
+  if (argc == 3) {
+    reference = read_lines(argv[2]);
+    if (reference.size() != streams.size()) {
+      std::cerr << argv[2] << ": expected " << streams.size()
+                << " outcomes, got " << reference.size() << "\n";
+      return 2;
+    }
+  }
+  bool mismatch = false;
+  for (const auto &mode : MODES) {
+    std::vector<double> milliseconds;
+    auto outcomes = mode.run_(streams, milliseconds);
+    if (reference.empty()) {
+      reference = outcomes.front();
+    }
+    for (size_t backend = 0; backend < outcomes.size(); backend++) {
+      // Left empty by backends that cannot parse the grammar.
+      if (outcomes[backend].empty() && !streams.empty()) {
+        continue;
+      }
+      size_t accepted = 0;
+      size_t mismatches = 0;
+      for (size_t i = 0; i < streams.size(); i++) {
+        const auto &outcome = outcomes[backend][i];
+        accepted += outcome != "reject";
+        if (outcome == reference[i]) {
+          continue;
+        }
+        if (mismatches++ < MAX_REPORTED) {
+          std::cerr << mode.name_ << "/" << BACKENDS[backend] << " stream " << i
+                    << ": " << streams[i] << "\n  expected: " << reference[i]
+                    << "\n  got:      " << outcome << "\n";
+        }
+      }
+      mismatch |= mismatches != 0;
+      std::cout << "{\"mode\": \"" << mode.name_ << "\", \"backend\": \""
+                << BACKENDS[backend] << "\", \"streams\": " << streams.size()
+                << ", \"accepted\": " << accepted
+                << ", \"mismatches\": " << mismatches
+                << ", \"ms\": " << milliseconds[backend] << "}\n";
+    }
+  }
+  return mismatch ? 1 : 0;
+}
@@ -3,22 +3,25 @@
 #include <memory>
 #include <cstdint>
 #include <vector>
-#define DEBUG_MODE
+#include "LALR_runtime.h"
 namespace siicc {
 struct Token {
   enum class TokenType : int32_t {
-    TOKEN_Blank = 1, // Blank
-    TOKEN_terminator = 2, // terminator
+    TOKEN_end = 1, // $
+    TOKEN_equals = 2, // ::=
     TOKEN_nonterminator = 3, // nonterminator
-    TOKEN_nonterminator_repreated = 4, // nonterminator_repeated
+    TOKEN_nonterminator_one_more = 4, // nonterminator_one_more
     TOKEN_nonterminator_optional = 5, // nonterminator_optional
-    TOKEN_nonterminator_one_more = 6, // nonterminator_one_more
+    TOKEN_nonterminator_repreated = 6, // nonterminator_repeated
     TOKEN_or = 7, // |
-    TOKEN_equals = 8, // ::=
-    TOKEN_semicolon = 9, // ;
-    TOKEN_end = 10, // $
+    TOKEN_semicolon = 8, // ;
+    TOKEN_terminator = 9, // terminator
   };
-  Token(TokenType type, const std::string& value) : type_(type), value_(std::make_shared<std::string>(value)) {}  TokenType type_;
+  Token(TokenType type, const std::string& value, uint32_t offset = 0)
+      : type_(type), offset_(offset), value_(std::make_shared<std::string>(value)) {}
+  TokenType type_;
+  // Byte offset of the token in the input.
+  uint32_t offset_;
   std::shared_ptr<std::string> value_;
 };
 
@@ -26,30 +29,126 @@ class Lexer { public: virtual Token Next() = 0; };
 
 struct ASTNode {
   enum class Type : int {
-    LEAF_Blank = 1,
-    LEAF_terminator = 2,
+    LEAF_end = 1,
+    LEAF_equals = 2,
     LEAF_nonterminator = 3,
-    LEAF_nonterminator_repreated = 4,
+    LEAF_nonterminator_one_more = 4,
     LEAF_nonterminator_optional = 5,
-    LEAF_nonterminator_one_more = 6,
+    LEAF_nonterminator_repreated = 6,
     LEAF_or = 7,
-    LEAF_equals = 8,
-    LEAF_semicolon = 9,
-    LEAF_end = 10,
-    NODE_Productions = 11,
-    NODE_Production = 12,
-    NODE_Production_Bodies = 13,
-    NODE_Production_Body = 14,
-    NODE_Production_Items = 15,
-    NODE_Production_Item = 16,
-    NODE_START = 17,
+    LEAF_semicolon = 8,
+    LEAF_terminator = 9,
+    NODE_Production = 10,
+    NODE_Production_Bodies = 11,
+    NODE_Production_Body = 12,
+    NODE_Production_Item = 13,
+    NODE_Production_Items = 14,
+    NODE_Productions = 15,
+    NODE_START = 16,
   };
   Type type_;
+  // Byte offsets of the first and the last token covered, see LALR_location.h.
+  uint32_t begin_ = 0;
+  uint32_t end_ = 0;
   std::shared_ptr<std::string> value_;
   std::vector<std::shared_ptr<ASTNode>> children_;
-  static bool IsLeaf(Type type) { return static_cast<int>(type) <= 10; }
+  int32_t state_ = 0;
+  uint32_t token_count_ = 0;
+  static bool IsLeaf(Type type) { return static_cast<int>(type) <= 9; }
   static std::string TypeToStr(Type type);
 };
 typedef std::shared_ptr<ASTNode> ASTNodePtr;
+
+struct ParserTables {
+  typedef ASTNode Node;
+  typedef Lexer LexerType;
+  static constexpr uint32_t TERMINATOR_COUNT = 9;
+  static constexpr uint32_t SYMBOL_COUNT = 16;
+  static constexpr uint32_t STATE_COUNT = 19;
+  static constexpr uint32_t MAX_REDUCE_LENGTH = 4;
+  static constexpr uint32_t reduce_result[15] = {
+    0,    16,    15,    15,    10,    11,    11,    12,    14,    14,    13,    13,    13,    13,    13 
+  };
+  static constexpr uint32_t reduce_length[15] = {
+    0,    1,    1,    2,    4,    1,    3,    1,    1,    2,    1,    1,    1,    1,    1 
+  };
+  static constexpr uint32_t CLASS_COUNT = 10;
+  static constexpr uint8_t terminal_class[10] = {0,1,2,3,4,5,6,7,8,9 };
+  static constexpr int32_t default_reduce[19] = {0,0,0,0,0,-3,0,0,-7,-10,-11,-12,-13,-14,0,-4,0,-9,-6 };
+  static constexpr uint32_t ROW_COUNT = 10;
+  static constexpr uint8_t row_of[19] = {0,1,2,3,4,5,6,7,5,5,5,5,5,5,8,5,9,5,5 };
+  static constexpr int32_t action_table[10][17] = {
+    {  0,  0,  0,  2,  0,  0,  0,  0,  0,  0,  3,  0,  0,  0,  0,  1,  0,},
+    {  0, -1,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,},
+    {  0,  0,  4,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,},
+    {  0, -2,  0,  2,  0,  0,  0,  0,  0,  0,  3,  0,  0,  0,  0,  5,  0,},
+    {  0,  0,  0, 10, 11, 13, 12,  0,  0,  9,  0,  6,  7, 14,  8,  0,  0,},
+    {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,},
+    {  0,  0,  0,  0,  0,  0,  0,  0, 15,  0,  0,  0,  0,  0,  0,  0,  0,},
+    {  0,  0,  0,  0,  0,  0,  0, 16, -5,  0,  0,  0,  0,  0,  0,  0,  0,},
+    {  0,  0,  0, 10, 11, 13, 12, -8, -8,  9,  0,  0,  0, 14, 17,  0,  0,},
+    {  0,  0,  0, 10, 11, 13, 12,  0,  0,  9,  0, 18,  7, 14,  8,  0,  0,},
+  };
+  static constexpr int32_t Action(uint32_t state, uint32_t terminal) {
+    return default_reduce[state] ? default_reduce[state] : action_table[row_of[state]][terminal_class[terminal]];
+  }
+  static constexpr int32_t Goto(uint32_t state, uint32_t nonterminal) {
+    return action_table[row_of[state]][nonterminal - 0];
+  }
+  static constexpr uint32_t CONFLICT_COUNT = 0;
+  static constexpr uint32_t ACCEPT_TOKEN = 16;
+  static constexpr uint32_t END_TOKEN = 1;
+  // 0 when the grammar has no error token.
+  static constexpr uint32_t ERROR_TOKEN = 0;
+  // The input is a list of SYNC_LIST units and every sync token ends one,
+  // see LALR_parallel.h. 0 when the grammar has no such list.
+  static constexpr uint32_t SYNC_LIST = 15;
+  static constexpr bool SYNC_LEFT_RECURSIVE = false;
+  static constexpr bool is_sync_token[10] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 0
+  };
+  // Keywords by hash slot, see LALR_keywords.h.
+  static constexpr uint32_t KEYWORD_COUNT = 3;
+  static constexpr uint32_t KEYWORD_POSITION_COUNT = 1;
+  static constexpr int32_t keyword_position[1] = {
+    0
+  };
+  static constexpr uint32_t KEYWORD_BUCKET_COUNT = 2;
+  static constexpr uint32_t keyword_seed[2] = {
+    2, 1
+  };
+  static constexpr const char *keyword_text[3] = {
+    "::=", ";", "|"
+  };
+  static constexpr uint32_t keyword_length[3] = {
+    3, 1, 1
+  };
+  static constexpr uint32_t keyword_id[3] = {
+    2, 8, 7
+  };
+  static constexpr const char *DEBUG_INFO_TABLE[16] = {
+    "$",
+    "::=",
+    "nonterminator",
+    "nonterminator_one_more",
+    "nonterminator_optional",
+    "nonterminator_repeated",
+    "|",
+    ";",
+    "terminator",
+    "Production",
+    "Production_Bodies",
+    "Production_Body",
+    "Production_Item",
+    "Production_Items",
+    "Productions",
+    "START",
+  };
+  static ASTNodePtr CreateNode(uint32_t token_id, std::shared_ptr<std::string> value);
+};
+
 ASTNodePtr Parse(std::shared_ptr<Lexer> lexer);
+// Repairs syntax errors and reports them in `errors`.
+ASTNodePtr Parse(std::shared_ptr<Lexer> lexer, std::vector<SyntaxError> &errors,
+                 const RecoveryOptions &options = {});
 } // namespace sii